@@ -0,0 +1,218 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <execinfo.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "headers/allocguard.h"
+#include "headers/logging.h"
+
+#ifndef ALLOC_GUARD
+#error "This module is built only with --enable-alloc-guard"
+#endif
+
+/* This module replaces the allocator entry points of the C library: the
+ * allocation itself is still done by glibc, through its internal names. */
+extern void * __libc_malloc (size_t size);
+extern void * __libc_calloc (size_t nmemb, size_t size);
+extern void * __libc_realloc (void *ptr, size_t size);
+extern void __libc_free (void *ptr);
+extern void * __libc_memalign (size_t alignment, size_t size);
+extern void * __libc_valloc (size_t size);
+extern void * __libc_pvalloc (size_t size);
+
+/* A violation */
+struct record {
+    int ready;                      /* Filled, published last; */
+    const char *task;               /* Name of the task; */
+    const char *op;                 /* Offending call; */
+    size_t size;                    /* Requested size; */
+    int depth;                      /* Size of the backtrace; */
+    void *frames[ALLOCGUARD_DEPTH]; /* Backtrace. */
+};
+
+static struct record records[ALLOCGUARD_RECORDS];
+static unsigned violations;
+
+/* Task running a callback on the calling thread, NULL if none. */
+static __thread const char *guarded;
+
+/* backtrace() loads libgcc on its first call, which allocates: this must
+ * not happen within a callback. */
+static void warm_up (void) __attribute__((constructor));
+
+static
+void warm_up (void)
+{
+    void *frame;
+
+    backtrace(&frame, 1);
+}
+
+/* Records a violation. The guard is lifted meanwhile, in case the
+ * backtrace allocates. */
+static
+void violation (const char *op, size_t size)
+{
+    const char *task = guarded;
+    struct record *r;
+    unsigned n;
+
+    guarded = NULL;
+    n = __atomic_fetch_add(&violations, 1, __ATOMIC_RELAXED);
+    if (n < ALLOCGUARD_RECORDS) {
+        r = &records[n];
+        r->task = task;
+        r->op = op;
+        r->size = size;
+        r->depth = backtrace(r->frames, ALLOCGUARD_DEPTH);
+        __atomic_store_n(&r->ready, 1, __ATOMIC_RELEASE);
+    }
+    guarded = task;
+}
+
+void * malloc (size_t size)
+{
+    if (guarded) {
+        violation("malloc", size);
+    }
+    return __libc_malloc(size);
+}
+
+void * calloc (size_t nmemb, size_t size)
+{
+    if (guarded) {
+        violation("calloc", nmemb * size);
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void * realloc (void *ptr, size_t size)
+{
+    if (guarded) {
+        violation("realloc", size);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free (void *ptr)
+{
+    if (guarded && ptr) {
+        violation("free", 0);
+    }
+    __libc_free(ptr);
+}
+
+/* The aligned allocators are replaced as well: e.g. fftw_malloc() goes
+ * trough posix_memalign(). glibc has no internal name for the latter two,
+ * which are implemented on top of __libc_memalign(). */
+void * memalign (size_t alignment, size_t size)
+{
+    if (guarded) {
+        violation("memalign", size);
+    }
+    return __libc_memalign(alignment, size);
+}
+
+void * valloc (size_t size)
+{
+    if (guarded) {
+        violation("valloc", size);
+    }
+    return __libc_valloc(size);
+}
+
+void * pvalloc (size_t size)
+{
+    if (guarded) {
+        violation("pvalloc", size);
+    }
+    return __libc_pvalloc(size);
+}
+
+int posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (guarded) {
+        violation("posix_memalign", size);
+    }
+    if (alignment % sizeof(void *) != 0
+            || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+        return EINVAL;
+    }
+    if ((ptr = __libc_memalign(alignment, size)) == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void * aligned_alloc (size_t alignment, size_t size)
+{
+    if (guarded) {
+        violation("aligned_alloc", size);
+    }
+    return __libc_memalign(alignment, size);
+}
+
+void allocguard_enter (const char *task)
+{
+    guarded = task ? task : "Thread";
+}
+
+void allocguard_leave (void)
+{
+    guarded = NULL;
+}
+
+unsigned allocguard_report (void)
+{
+    unsigned n, i;
+
+    n = __atomic_load_n(&violations, __ATOMIC_ACQUIRE);
+    if (n == 0) {
+        LOG_MSG("Allocation guard: PASS, no allocation in the callbacks");
+        return 0;
+    }
+    ERR_FMT("Allocation guard: FAIL, %u allocations in the callbacks", n);
+
+    for (i = 0; i < n && i < ALLOCGUARD_RECORDS; i ++) {
+        const struct record *r = &records[i];
+
+        /* Still being written by a running thread */
+        if (!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        ERR_FMT("%s(%lu) in '%s':", r->op, (unsigned long) r->size,
+                r->task);
+        fflush(stderr);
+        backtrace_symbols_fd((void * const *) r->frames, r->depth,
+                             STDERR_FILENO);
+    }
+    if (n > ALLOCGUARD_RECORDS) {
+        ERR_FMT("(%u more not recorded)", n - ALLOCGUARD_RECORDS);
+    }
+    return n;
+}
@@ -20,6 +20,7 @@
 
 #include "headers/alsagw.h"
 #include "headers/rtutils.h"
+#include "headers/thrd.h"
 #include "headers/logging.h"
 #include "headers/config.h"
 
@@ -34,6 +35,12 @@ struct samp {
     unsigned rate;
     snd_pcm_uframes_t nframes;
     struct timespec period;
+
+    /* Statistics, written by the reading thread under a sequence lock
+     * (odd seq while updating). */
+    uint32_t seq;
+    uint64_t first;             /* Time of the first read (ns); */
+    alsagw_stats_t stats;
 };
 
 static
@@ -129,8 +136,11 @@ void alsagw_destroy (alsagw_t *s)
     }
 }
 
-int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
-                 snd_pcm_uframes_t bufsize, int maxwait)
+/* Reads the frames, recovering from errors. The overruns are counted in
+ * the given variable. */
+static
+int read_frames (alsagw_t *samp, alsagw_frame_t *buffer,
+                 snd_pcm_uframes_t bufsize, int maxwait, unsigned *xruns)
 {
     int nread;
     snd_pcm_t *pcm = samp->pcm;
@@ -144,6 +154,8 @@ int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
     /* Note: alsa errors are unix ones, but negative */
     switch (nread) {
         case -EPIPE:
+            thrd_trace(THRD_EVENT_XRUN, 0);
+            (*xruns) ++;
             LOG_MSG("Got overrun");
             if (snd_pcm_recover(pcm, nread, 0)) {
                 LOG_MSG("Overrun handling failure");
@@ -167,6 +179,8 @@ int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
         case 0:
             return -EAGAIN;
         case -EPIPE:
+            thrd_trace(THRD_EVENT_XRUN, 0);
+            (*xruns) ++;
             return snd_pcm_recover(pcm, nread, 0);
         default:
             /* Everything is badly documented here. Let the snd_strerr
@@ -175,3 +189,60 @@ int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
     }
 }
 
+int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
+                 snd_pcm_uframes_t bufsize, int maxwait)
+{
+    alsagw_stats_t *stats = &samp->stats;
+    snd_pcm_sframes_t avail;
+    struct timespec now;
+    unsigned xruns = 0;
+    uint64_t t;
+    uint32_t seq;
+    int nread;
+
+    nread = read_frames(samp, buffer, bufsize, maxwait, &xruns);
+    avail = snd_pcm_avail_update(samp->pcm);
+    rtutils_get_now(&now);
+    t = rtutils_time2ns(&now);
+
+    seq = samp->seq;
+    __atomic_store_n(&samp->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (samp->first == 0) {
+        samp->first = t;
+    } else {
+        stats->elapsed = t - samp->first;
+        if (nread > 0) {
+            stats->frames += nread;
+        }
+    }
+    stats->xruns += xruns;
+    stats->backlog = avail > 0 ? avail : 0;
+
+    __atomic_store_n(&samp->seq, seq + 2, __ATOMIC_RELEASE);
+    return nread;
+}
+
+void alsagw_get_stats (const alsagw_t *samp, alsagw_stats_t *stats)
+{
+    uint32_t seq;
+
+    do {
+        while ((seq = __atomic_load_n(&samp->seq, __ATOMIC_ACQUIRE)) & 1);
+        memcpy((void *)stats, (const void *)&samp->stats,
+               sizeof(alsagw_stats_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&samp->seq, __ATOMIC_RELAXED) != seq);
+}
+
+double alsagw_drift (const alsagw_stats_t *stats, unsigned rate)
+{
+    double actual;
+
+    if (stats->elapsed == 0 || rate == 0) {
+        return 0;
+    }
+    actual = (double) stats->frames * SECOND_nS / stats->elapsed;
+    return (actual / rate - 1.0) * 1e6;
+}
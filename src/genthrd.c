@@ -19,6 +19,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "headers/logging.h"
 #include "headers/constants.h"
@@ -35,44 +36,36 @@ struct genth_data {
     thrd_cb_t init;
     thrd_cb_t callback;
     thrd_cb_t destroy;
+    thrd_overrun_cb_t on_overrun;
 	void *context;
 
-    thrd_info_t user;
-
-    struct {
-        int active;             /* 1 if the thread is running; */
-        pthread_t self;         /* Handler used for termination; */
-    } thread;
-
+    /* Pool and descriptor of the thread, used for termination. */
+    thrd_pool_t *pool;
+    const thrd_rtstats_t *stats;
 };
 
 static
 int init_cb (void *arg)
 {
     struct genth_data *ctx = (struct genth_data *)arg;
-    thrd_info_t *user;
 
-    user = &ctx->user;
-    if (user->init != NULL && user->init(user->context)) {
+    if (ctx->init != NULL && ctx->init(ctx->context)) {
         return 1;
     }
-
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
-
-    ctx->thread.active = 1;
-    ctx->thread.self = pthread_self();
     return 0;
 }
 
+/* Called by the pool when the thread terminates. The handle itself is
+ * owned by the user, and released by genth_sendkill(). */
 static
-void destroy_cb (void *arg)
+int destroy_cb (void *arg)
 {
     struct genth_data *ctx = (struct genth_data *)arg;
 
     if (ctx->destroy) {
         ctx->destroy(ctx->context);
     }
-    free(arg);
+    return 0;
 }
 
 static
@@ -80,20 +73,15 @@ int thread_cb (void *arg)
 {
     struct genth_data *ctx = (struct genth_data *)arg;
 
-    if (ctx->callback(ctx->context)) {
-        destroy_cb(arg);
-        return 1;
-    }
+    return ctx->callback(ctx->context);
+}
 
-    /* Check cancellations. If it is the case the destroy_cb will manage
-     * memory deallocation. */
-    pthread_cleanup_push(destroy_cb, arg);
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_testcancel();
-    pthread_cleanup_pop(0);
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+static
+void overrun_cb (void *arg, unsigned missed)
+{
+    struct genth_data *ctx = (struct genth_data *)arg;
 
-    return 0;
+    ctx->on_overrun(ctx->context, missed);
 }
 
 const thrd_rtstats_t *genth_subscribe (genth_t **handle,
@@ -104,11 +92,23 @@ const thrd_rtstats_t *genth_subscribe (genth_t **handle,
     struct genth_data *ctx;
     const thrd_rtstats_t *ret;
 
+    memset(&thi, 0, sizeof(thrd_info_t));
     thi.init = init_cb;
     thi.callback = thread_cb;
-    thi.destroy = NULL;
+    thi.destroy = destroy_cb;
+    thi.overrun = info->overrun;
+    thi.catchup = info->catchup;
+    thi.wake = info->wake;
+    thi.name = info->name;
+    thi.stack_size = info->stack_size;
+    if (info->on_overrun) {
+        thi.on_overrun = overrun_cb;
+    }
     rtutils_time_copy(&thi.delay, &info->delay);
     rtutils_time_copy(&thi.period, &info->period);
+    rtutils_time_copy(&thi.deadline, &info->deadline);
+    rtutils_time_copy(&thi.runtime, &info->runtime);
+    memcpy(&thi.cpus, &info->cpus, sizeof(cpu_set_t));
 
     ctx = (struct genth_data *) calloc(1, sizeof(struct genth_data));
     assert(ctx);
@@ -117,13 +117,15 @@ const thrd_rtstats_t *genth_subscribe (genth_t **handle,
     ctx->init = info->init;
     ctx->callback = info->callback;
     ctx->destroy = info->destroy;
+    ctx->on_overrun = info->on_overrun;
     ctx->context = info->context;
-    ctx->thread.active = 0;
+    ctx->pool = pool;
 
     if ((ret = thrd_add(pool, &thi)) == NULL) {
         free(ctx);
         *handle = NULL;
     } else {
+        ctx->stats = ret;
         *handle = ctx;
     }
     return ret;
@@ -134,20 +136,12 @@ int genth_sendkill (genth_t *handle)
     if (handle == NULL) {
         return -1;
     }
-    if (handle->thread.active) {
-        int err;
-        
-        /* The cancellation will be checked explicitly in thread_cb().
-         * Also note that the thread pool (see headers/thrd.h) is in
-         * charge of joining the thread.
-         */
-        err = pthread_cancel(handle->thread.self);
-
-        assert(!err);
-        return 0;
-    } else {
-        return -1;
-    }
+
+    /* The pool stops the thread at its next activation, calls
+     * destroy_cb() and joins it. */
+    thrd_remove(handle->pool, handle->stats);
+    free(handle);
+    return 0;
 }
 
 void * genth_get_context (const genth_t *handle)
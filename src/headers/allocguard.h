@@ -0,0 +1,91 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** @file allocguard.h */
+/** @addtogroup AllocGuard */
+/*@{*/
+
+#ifndef __defined_headers_allocguard_h
+#define __defined_headers_allocguard_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "headers/config.h"
+
+/** Number of allocations recorded with their backtrace. */
+#define ALLOCGUARD_RECORDS  64
+
+/** Depth of the recorded backtraces. */
+#define ALLOCGUARD_DEPTH    16
+
+#ifdef ALLOC_GUARD
+
+/** Mark the calling thread as running a real time callback.
+ *
+ * Until allocguard_leave() each malloc(), calloc(), realloc(), free(),
+ * and each aligned allocation (posix_memalign(), aligned_alloc(),
+ * memalign(), valloc() and pvalloc()) of the thread is counted as a
+ * violation.
+ *
+ * @param task The name of the task, reported with the violations. It may
+ *             be NULL.
+ */
+void allocguard_enter (const char *task);
+
+/** Mark the calling thread as out of the real time callback. */
+void allocguard_leave (void);
+
+/** Report the violations.
+ *
+ * Logs the outcome (PASS or FAIL) and, on the standard error, the task,
+ * the operation and the backtrace of the first ALLOCGUARD_RECORDS
+ * violations.
+ *
+ * @return The number of violations.
+ */
+unsigned allocguard_report (void);
+
+#else
+
+static inline
+void allocguard_enter (const char *task)
+{
+}
+
+static inline
+void allocguard_leave (void)
+{
+}
+
+static inline
+unsigned allocguard_report (void)
+{
+    return 0;
+}
+
+#endif
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __defined_headers_allocguard_h
@@ -49,6 +49,20 @@ typedef struct {
     int16_t ch1;    /**< Channel 1. */
 } alsagw_frame_t;
 
+/** @brief Capture statistics.
+ *
+ * The statistics are updated by alsagw_read(): a consistent copy can be
+ * obtained at any time with alsagw_get_stats().
+ */
+typedef struct {
+    uint64_t frames;    /**< Frames read after the first read; */
+    uint64_t elapsed;   /**< Time between the first and the last read
+                         *   (ns); */
+    uint64_t xruns;     /**< Overruns of the capture buffer; */
+    uint64_t backlog;   /**< Frames left in the capture buffer after the
+                         *   last read. */
+} alsagw_stats_t;
+
 /** @brief Constructor for the sampler.
  *
  * @param device The alsa device (e.g. "hw0:0");
@@ -115,6 +129,28 @@ int alsagw_read (alsagw_t *samp, alsagw_frame_t *buffer,
  */
 unsigned alsagw_get_rate (const alsagw_t *samp);
 
+/** @brief Get a consistent copy of the capture statistics.
+ *
+ * This never blocks the thread reading the samples, and can be called
+ * from any thread.
+ *
+ * @param samp The sampler;
+ * @param stats The structure to be filled.
+ */
+void alsagw_get_stats (const alsagw_t *samp, alsagw_stats_t *stats);
+
+/** @brief Estimate the drift of the sound card clock.
+ *
+ * The actual rate is given by the frames read over the elapsed
+ * monotonic time, and it is compared with the nominal one.
+ *
+ * @param stats The statistics of the sampler;
+ * @param rate The nominal rate (see alsagw_get_rate()).
+ * @return The drift in parts per million, positive if the sound card is
+ *         faster than the system clock. Zero before the second read.
+ */
+double alsagw_drift (const alsagw_stats_t *stats, unsigned rate);
+
 /** @brief Sampler destroyer.
  *
  * @warning Please do not forget to disable any thread using the sampler
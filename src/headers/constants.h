@@ -56,14 +56,42 @@ extern "C" {
  */
 #define PLOT_PERIOD_nSEC        35714286     
 
+/** @brief Default shortest period of the plotting thread (ms).
+ *
+ * This is used when the frame pacing is enabled, and corresponds to 60
+ * refreshes per second.
+ */
+#define PLOT_PERIOD_MIN_mSEC    16
+
+/** @brief Default longest period of the plotting thread (ms).
+ *
+ * This corresponds to 10 refreshes per second.
+ */
+#define PLOT_PERIOD_MAX_mSEC    100
+
+/** @brief Default target utilization of the plotting thread (percent).
+ *
+ * Zero disables the frame pacing.
+ */
+#define PLOT_UTILIZATION        20
+
+/** @brief Number of activations between two frame pacing adjustments.
+ *
+ * Roughly one second at the default period.
+ */
+#define PLOT_PACING_WINDOW      28
+
 /** @brief Proportion divisor between sampling thread period and sampling wait in
  * case of failure. The period will be divided by this in sampthread.c.
  * Set it to 0 in order to remove the waiting.
  */
 #define ALSA_WAIT_PROPORTION    0
 
-/** @brief Size of the graphical window used for plotting. */
-#define PLOT_BITMAPSIZE         "400x250"
+/** @brief Width of the graphical window used for plotting. */
+#define PLOT_WIDTH              400
+
+/** @brief Height of the graphical window used for plotting. */
+#define PLOT_HEIGHT             250
 
 /** @brief Color of the plotting line. */
 #define PLOT_LINECOLOR          "green"
@@ -71,6 +99,26 @@ extern "C" {
 /** @brief Color of the plotting background. */
 #define PLOT_BGCOLOR            "black"
 
+/** @brief Number of colors of the phosphor heatmap. */
+#define PLOT_PHOSPHOR_LEVELS    16
+
+/** @brief Intensity deposited by a trace on a phosphor cell. */
+#define PLOT_PHOSPHOR_HIT       8192
+
+/** @brief Intensity deposited by a point of a scatter graphic.
+ *
+ * Scatter graphics receive a whole buffer of points at once, thus the
+ * contribution of each one is smaller than a trace's.
+ */
+#define PLOT_SCATTER_HIT        1024
+
+/** @brief Decay of the phosphor at each trace, as a shift.
+ *
+ * Each trace the intensity loses 1/2^n of its value: with 3 a cell
+ * halves its intensity in about 5 traces.
+ */
+#define PLOT_PHOSPHOR_DECAY     3
+
 /** @brief Minimum plotable value. */
 #define PLOT_MIN_Y              INT16_MAX
 
@@ -84,9 +132,29 @@ extern "C" {
  */
 #define PLOT_PERIOD_TIMES       10
 
+/** @brief Decay of the XY density plot at each buffer, as a shift. */
+#define XY_DECAY                2
+
+/** @brief Forgetting factor of the stereo correlation.
+ *
+ * The sums used for the correlation are multiplied by this at each
+ * buffer, before adding the new frames.
+ */
+#define XY_CORR_FORGET          0.5
+
+/** @brief Number of samples of the correlation meter history. */
+#define XY_CORR_HISTORY         PLOT_WIDTH
+
 /** @brief Number of sampling used in averaging samples. */
 #define PLOT_AVERAGE_LEN        50
 
+/** @brief Stack size of the real time threads (bytes).
+ *
+ * The whole stack is locked and touched before the first activation,
+ * thus it should not be much larger than needed.
+ */
+#define TASK_STACK_SIZE         (256 * 1024)
+
 /** @brief Default rate used in the options module. */
 #define DEFAULT_RATE            44100
 
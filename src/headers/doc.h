@@ -17,9 +17,9 @@
 
     Depending on the command line options, three to five threads may be
     involved simultaneously with the purpose of displaying either the
-    @ref BizSignal "audio signal", @ref BizSpectrum "its spectrum" or
-    both. This also influences the number of priority level taken by the
-    application.
+    @ref BizSignal "audio signal", @ref BizSpectrum "its spectrum",
+    the @ref BizXY "stereo image" or any combination of them. This also
+    influences the number of priority level taken by the application.
 
     The application comes with two general purpose modules that are
     heavvily used but not strictly related with the application's purpose.
@@ -38,6 +38,7 @@
     @arg @ref BizSampling;
     @arg @ref BizSignal;
     @arg @ref BizSpectrum;
+    @arg @ref BizXY;
     @arg @ref BizOptions;
 
     @note You may read this text on both the html reference and the report
@@ -58,7 +59,7 @@ make install
 @endverbatim
 
     More information is provided by the INSTALL file, which is
-    included in the software package, however three special non-standard
+    included in the software package, however four special non-standard
     options can be provided to the configure script:
 
     @arg @c --enable-debug (which will give a more verbose output on
@@ -66,7 +67,10 @@ make install
     @arg @c --disable-realtime (which will disable real-time
          programming).
     @arg @c --enable-alsa-hack (which will try to fix a
-         @ref Issues "known issue").
+         @ref Issues "known issue");
+    @arg @c --enable-alloc-guard (which will report the memory
+         allocations made by the real time threads, see
+         @ref AllocGuard).
 
 @section License
 
@@ -85,6 +89,7 @@ make install
 
     @arg Alsa Soundlib (v. 1.0.20-3);
     @arg GNU Plotutils libplot (v. 2.5-4);
+    @arg Xlib (libX11) and the X extension library (libXext);
     @arg LibDacav (v. 0.4.2);
     @arg Fftw3 (v. 3.2.1).
 
@@ -111,6 +116,10 @@ Usage: ./soto [options]
   --show-signal[={bool}] | -u [{bool}] 
         Show the signal of the audio stream (default: no);
 
+  --show-xy[={bool}] | -x [{bool}] 
+        Show channel 0 against channel 1 (goniometer) and their
+        correlation (default: no);
+
   --buffer-scale={factor} | -s {factor}
         Provide the proportion between sampling buffer and read buffer
         (default: 10);
@@ -126,11 +135,88 @@ Usage: ./soto [options]
         By providing 0 (which is the default) the program will run
         until interrupted;
 
+  --xshm[={bool}] | -X [{bool}]
+        Rasterize the plots and push them trough the MIT-SHM X extension
+        instead of using libplot (default: no);
+
+  --phosphor[={bool}] | -P [{bool}]
+        Show the signal as a digital phosphor: traces are accumulated
+        into a decaying heatmap (default: no);
+
+  --plot-period={min}:{max} | -p {min}:{max}
+        Bounds in milliseconds for the refresh period of the plots
+        (default: 16:100);
+
+  --plot-util={percent} | -F {percent}
+        Target CPU utilization for the plotting thread, which adapts its
+        refresh period accordingly. By providing 0 the refresh period is
+        fixed (default: 20);
+
+  --sched={rm|edf|cyclic} | -S {rm|edf|cyclic}
+        Scheduling policy for the real-time threads: Rate Monotonic
+        priorities on SCHED_FIFO, Earliest Deadline First on
+        SCHED_DEADLINE, or a cyclic executive running all the tasks on
+        a single thread (default: rm);
+
+  --partition[={bool}] | -C [{bool}]
+        Pin each thread on a single CPU, placing them first-fit by
+        decreasing utilization, as measured by --admission (without
+        it each thread counts as 10% of a CPU). Allowed only with
+        --sched=rm (default: no);
+
+  --admission={off|warn|reject} | -A {off|warn|reject}
+        Measure the execution time of each thread before starting, and
+        check whether the threads can meet their deadlines. Either warn
+        or refuse to run if they can't (default: off);
+
+  --stats-interval={seconds} | -I {seconds}
+        Report the statistics of the threads periodically while they
+        are running. By providing 0 (which is the default) they are
+        reported only at exit;
+
+  --lock-stats[={bool}] | -L [{bool}]
+        Measure wait time, hold time and contentions of the locks
+        shared among threads, and report them along with the
+        statistics of the threads (default: no);
+
+  --spin-wake[={bool}] | -W [{bool}]
+        Wake up the sampling thread by sleeping until shortly before
+        its activation, then busy waiting. This reduces the activation
+        jitter, at the price of some CPU time (default: no);
+
+  --trace={file} | -T {file}
+        Write the recent activations of the threads to the given file
+        on exit and on SIGHUP, in the format of chrome://tracing
+        (default: no trace);
+
+  --metrics={path} | -M {path}
+        Serve the statistics in the Prometheus text format on a Unix
+        domain socket having the given path (default: no server);
+
+  --perf-counters[={bool}] | -H [{bool}]
+        Count cycles, instructions, cache misses and branch misses of
+        each activation of the threads with the hardware performance
+        counters, and report them along with the statistics of the
+        threads (default: no);
+
+  --watchdog={periods} | -D {periods}
+        Report on stderr the threads not completing an activation for
+        the given number of their periods, along with their recent
+        events and their stack. By providing 0 (which is the default)
+        the watchdog is disabled;
+
   --help  | -h
         Print this help.
 
 @endverbatim
 
+    While running, the analyzers can be turned on and off without
+    restarting the program: SIGUSR1 toggles the Spectrum analyzer, SIGUSR2
+    the Signal analyzer (e.g. <tt>kill -USR1 $(pidof soto)</tt>). The
+    sampler keeps running meanwhile. With <tt>--trace</tt>, SIGHUP writes
+    the traces of the threads without stopping them; otherwise it
+    terminates the program, as usual.
+
 @section Issues Known issues
 
     This program has been tested to be working correctly on both a
@@ -186,6 +272,328 @@ Usage: ./soto [options]
     current absolute time against the Posix monotonic system clock
     (CLOCK_MONOTONIC).
 
+@section Thrd_Faults Page faults
+
+    A page fault in a callback costs microseconds (a minor one) to
+    milliseconds (a major one), so they must happen before the first
+    activation. The program locks its memory with mlockall() before
+    creating the pool, so that the memory mapped afterwards, thread
+    stacks included, is locked and populated as well.
+
+    Each thread gets the stack size in thrd_info_t::stack_size, and
+    touches its stack before calling thrd_info_t::init: the pages are
+    mapped at startup even where mlockall() is not available. Under
+    THRD_POLICY_CYCLIC the dispatcher gets the largest stack required
+    by the tasks.
+
+    The page faults of each callback are read by getrusage(RUSAGE_THREAD)
+    before and after it, and summed in the statistics: an activation hit
+    by faults is counted in thrd_rtstats_t::fault_count, and it is
+    flagged in the trace (see @ref Thrd_Trace). This costs two more
+    system calls per activation.
+
+@section Thrd_EDF Earliest Deadline First
+
+    By calling thrd_set_policy() with THRD_POLICY_EDF before starting the
+    pool, the threads are scheduled under SCHED_DEADLINE. Each thread
+    moves itself under the new policy once its startup delay is elapsed,
+    with the reservation described by thrd_info_t: budget
+    (thrd_info_t::runtime), relative deadline (thrd_info_t::deadline) and
+    period.
+
+    A thread declaring a null budget is measured: during its first
+    activations it runs with its Rate Monotonic priority while the worst
+    execution time is tracked on the thread CPU-time clock, then it
+    switches to SCHED_DEADLINE with a budget which is a bit larger than
+    the measured one.
+
+    If the kernel refuses the reservation (e.g. the total bandwidth is
+    exceeded, or the privileges are not enough) the thread keeps running
+    under SCHED_FIFO.
+
+@section Thrd_Affinity CPU affinity
+
+    A thread can be restricted to a set of CPUs by filling the
+    thrd_info_t::cpus field. The affinity is part of the thread creation
+    attributes, thus it holds since the very first instruction.
+
+    By calling thrd_set_partitioned() the pool pins every other thread on
+    a single CPU: threads are sorted by decreasing utilization and each
+    one goes on the first CPU which still has room for it (first-fit
+    decreasing). A CPU is full at the Liu-Layland bound (69%) under Rate
+    Monotonic. If no CPU has room left the thread goes on the least
+    loaded one.
+
+    The utilization comes from the execution times measured by the
+    admission control (see @ref Thrd_Admission): in that case the
+    threads are created unpinned, calibrated, and moved on their CPU
+    before the first activation. Without admission control the budget
+    in thrd_info_t::runtime is used, and threads having none are assumed
+    to use 10% of a CPU, so that a few of them fill the first CPU and the
+    placement spreads little.
+
+    Since SCHED_DEADLINE doesn't admit threads with restricted affinity,
+    under THRD_POLICY_EDF both the partitioning and the pinned threads
+    make thrd_start() fail with THRD_ERR_AFFINITY. The same goes for
+    THRD_POLICY_CYCLIC, which has a single thread.
+
+@section Thrd_Cyclic Cyclic executive
+
+    With a few short tasks, like the ones of this program, one thread for
+    each task means a context switch for each activation: the sampler
+    alone is activated thousands of times per second. The
+    THRD_POLICY_CYCLIC policy runs instead all the callbacks on a single
+    dispatcher thread, having the highest Rate Monotonic priority of the
+    task set.
+
+    The dispatcher follows a static table covering the hyperperiod. The
+    minor frame is the greatest common divisor of the periods or, when
+    this is too short (less than 100 us), the shortest period. Periods
+    are rounded down to a multiple of the minor frame: a task may be
+    activated slightly more often than required, never less. If the
+    hyperperiod would be longer than 4096 frames the periods are further
+    rounded down to a power of two frames, making them harmonic. Each
+    changed period is logged, and the statistics refer to the quantized
+    one. On each frame the released tasks are dispatched in Rate
+    Monotonic order.
+
+    The statistics, the overrun policies and thrd_set_period() keep
+    their meaning: a period change rebuilds the table starting from the
+    next frame. Adding or removing a task pauses the dispatcher at the
+    end of a frame, then restarts it with a new table. Under admission
+    control the test checks that the calibrated execution times of the
+    tasks released on each frame fit in the frame.
+
+@section Thrd_Wake Wake up modes
+
+    A sleeping thread is woken up by the kernel timer some microseconds
+    after the requested time, and the amount varies from one activation
+    to the next. Setting thrd_info_t::wake to THRD_WAKE_SPIN makes the
+    thread sleep only until a margin before the activation, then busy
+    wait on the clock, with the CPU relax instruction, up to the exact
+    time.
+
+    The margin starts at 50 us and is tuned on each activation: an
+    overshoot larger than the margin widens it to 125% of the overshoot,
+    while a shorter one lets it slowly shrink towards the observed
+    value. The margin is kept between 2 us and 200 us, and never beyond a
+    quarter of the period.
+
+    The busy waiting time is accounted in thrd_rtstats_t::spin_time, so
+    that the CPU cost of the mode can be compared with the lateness
+    statistics. Under THRD_POLICY_EDF the threads always sleep, since
+    spinning would consume the SCHED_DEADLINE budget. Under
+    THRD_POLICY_CYCLIC the dispatcher busy waits the frames releasing at
+    least one spinning task.
+
+@section Thrd_Admission Admission control
+
+    Deadline misses of a bad designed task set (e.g. a huge FFT because of
+    a large buffer scale) would show up only in the final statistics. With
+    thrd_set_admission() the pool checks the task set before going live.
+
+    Once created, each thread runs its "Start" callback and then calls the
+    "Business" one several times, keeping track of the worst execution
+    time on its CPU-time clock. The calibration runs with the default
+    scheduling, so that a thread added to a running pool doesn't starve
+    the admitted ones with its back to back runs; being on the CPU-time
+    clock, the measure is not inflated by preemptions. When all the
+    threads are calibrated,
+    thrd_start() runs a schedulability test:
+
+    @arg Under Rate Monotonic, the Response Time Analysis: a thread is
+         interfered by the higher priority threads which may share its
+         CPU. Threads which are free to migrate are pessimistically
+         considered as sharing a single CPU;
+    @arg Under EDF, each budget must fit its deadline and the total
+         density must fit the available CPUs, which is the same test
+         applied by the kernel to SCHED_DEADLINE. Threads without a budget
+         get the calibrated one.
+
+    The outcome for each thread is logged. Depending on the mode an
+    unschedulable task set is just reported, or thrd_start() fails with
+    THRD_ERR_UNSCHED and the threads terminate. Otherwise the threads are
+    released, and their startup delays count from the end of the
+    calibration.
+
+    @note The calibration executes the business logic for real, so its
+          side effects (e.g. samples read from the audio device) are not
+          discarded.
+
+@section Thrd_Statistics Statistics
+
+    For each thread the pool keeps a thrd_rtstats_t structure, returned
+    by thrd_add(). Besides average and worst case response time and the
+    deadline misses count, two log-bucketed histograms record the
+    distribution of response times and of activation lateness (the delay
+    between the scheduled activation and the actual one). Recording a
+    sample costs a few instructions and no allocation; percentiles can be
+    extracted with thrd_hist_percentile().
+
+    The response time of each activation is also broken down in three
+    parts, each one with its own histogram: the lateness (release
+    latency), the execution time, read on the CPU-time clock of the
+    thread, and the preemption time, namely the rest of the time between
+    the start and the end, spent by the thread preempted or blocked. A
+    long execution time asks for a lighter callback, while a long
+    lateness or preemption time points at the scheduling. Measuring the
+    execution time costs two more clock readings per activation.
+
+    After thrd_set_counters() each thread also counts the cycles,
+    instructions, cache misses and branch misses of its activations
+    (see @ref PerfCtr), and sums them in the <tt>events</tt> field.
+
+    The structure is updated by its thread under a sequence lock, so
+    that thrd_rtstats_snapshot() can get a consistent copy at any time
+    without ever blocking the real-time thread.
+
+@section Thrd_Trace Tracing
+
+    A deadline miss counted by the statistics doesn't tell what happened
+    around it. For this each thread always records its last 4096 events
+    in a ring of fixed size records: releases, starts and ends of the
+    activations, deadline misses, skipped activations and page faults
+    within the callbacks. Other modules add their own events by calling
+    thrd_trace(): the real time locks record the time spent waiting for a
+    contended lock, the Alsa gateway records the overruns of the sound
+    card.
+
+    The events use the timestamps already taken for the statistics, so
+    tracing costs a few stores per activation. Only the thread running a
+    task writes its ring, and no lock is involved.
+
+    thrd_trace_dump() writes the rings in the JSON format of
+    chrome://tracing, which is also accepted by Perfetto
+    (https://ui.perfetto.dev): each thread is a track, each activation a
+    slice. The program does this on exit and on SIGHUP when the
+    <tt>--trace</tt> option is given. Under THRD_POLICY_CYCLIC the tracks
+    are still one per task, even if a single thread runs them.
+
+    The metadata of each track also carries the period, the relative
+    deadline and the overrun policy of the task, and each slice carries
+    the CPU time of its activation (<tt>exec_ns</tt>), so that a trace
+    is enough to replay the task set (see @ref Thrd_Simulation).
+
+@section Thrd_Simulation Simulation
+
+    Before changing the task set, e.g. adding an analyzer or raising the
+    frame rate, it's worth knowing whether the deadlines would still be
+    met. thrd_simulate() answers without running anything: the threads
+    are placed and prioritized exactly as thrd_start() would do, then
+    their activations are simulated in virtual time, with the execution
+    times given by a callback. The outcome lands in the usual statistics,
+    including the histogram of the response times.
+
+    The simulation models the release of the threads at the critical
+    instant (all together, apart from thrd_info_t::delay), the
+    preemption among them, the overrun policies and the migration of the
+    threads which are not pinned. It doesn't model the overheads of the
+    kernel, the blocking on locks and the budget of the CBS servers:
+    under THRD_POLICY_EDF the threads are scheduled by global EDF, and a
+    thread exceeding its runtime is not throttled. Under
+    THRD_POLICY_CYCLIC the dispatcher runs on a single CPU, as it does
+    on the real system.
+
+    The <tt>sotosim</tt> program feeds thrd_simulate() with a trace
+    written by <tt>soto --trace</tt> (see @ref Thrd_Trace): each task
+    replays the execution times it recorded, possibly scaled, and new
+    tasks can be added with the execution times of an existing one. The
+    exit status is 2 when some deadline miss is predicted, or when the
+    schedulability test refuses the task set.
+
+@verbatim
+dacav@mithril:<src>$ ./sotosim -h
+
+soto 0.2.10 - schedulability simulator
+Usage: ./sotosim [options] {trace}
+
+  Replays the execution times recorded in a trace written by soto
+  --trace, and reports the deadline misses and the response times the
+  threads would have.
+
+  --sched={rm|edf|cyclic} | -S {rm|edf|cyclic}
+        Scheduling policy: Rate Monotonic priorities, Earliest Deadline
+        First, or a cyclic executive running all the tasks on a single
+        thread (default: rm);
+
+  --partition[={bool}] | -C [{bool}]
+        Pin each task on a single CPU, placing them first-fit by
+        decreasing utilization. Allowed only with --sched=rm
+        (default: no);
+
+  --cpus={n} | -c {n}
+        Number of CPUs of the simulated machine (default: 1);
+
+  --sim-for={time in seconds} | -t {time in seconds}
+        Simulated time (default: 60);
+
+  --scale=[{task}:]{factor} | -s [{task}:]{factor}
+        Multiply the execution times of the given task, or of all the
+        tasks, by the given factor. Can be repeated;
+
+  --add={name}:{period in us}:{task}[:{factor}]
+  | -a {name}:{period in us}:{task}[:{factor}]
+        Add a task having the given period, and the execution times of
+        the given task multiplied by the factor (default: 1). Can be
+        repeated;
+
+  --random={seed} | -R {seed}
+        Draw the execution times at random among the recorded ones,
+        instead of replaying them in order;
+
+  --help  | -h
+        Print this help.
+
+@endverbatim
+
+@section Thrd_Watchdog Watchdog
+
+    A callback blocked forever, e.g. in snd_pcm_wait() or in an X11
+    call, would go unnoticed. After thrd_set_watchdog() each thread
+    moves a heartbeat counter on entering and on leaving its callback,
+    which costs two stores per activation, and a monitor thread checks
+    the counters every 10 ms. The monitor runs with the highest
+    SCHED_FIFO priority, so that a thread spinning in its callback
+    cannot starve it.
+
+    A thread whose heartbeat doesn't move for the given number of its
+    periods (at least 100 ms) is reported once on the standard error,
+    with its statistics and its last 16 events. If it is stuck inside
+    its callback, it is sent SIGRTMIN: the handler, running on the stuck
+    thread, writes its stack and returns. The monitor doesn't try to
+    recover the thread: jumping out of the callback would abandon the
+    locks it holds (e.g. the one of the X display, or an rtlock), and the
+    next thread taking them would deadlock.
+
+    Each watched thread calls backtrace() once when it starts, so that
+    the handler doesn't load libgcc. The monitor copies the state of a
+    stalled thread while holding the lock on the task set, and writes the
+    report after releasing it: adding or removing a task never waits for
+    the standard error.
+
+    Only the threads which entered their callback at least once are
+    watched. Under THRD_POLICY_CYCLIC a stalled task stops the whole
+    dispatcher, so the other tasks are reported as well, stalled out of
+    their callback.
+
+@section Thrd_Dynamic Changing the task set at run time
+
+    Threads can be added and removed while the pool is running. A thread
+    added by thrd_add() to an active pool gets started immediately: the
+    priorities of all the threads are reassigned according to the new
+    task set and, if enabled, the admission test is repeated on the whole
+    set. The new thread is calibrated first, running "Start" and then
+    "Business" a few tens of times in a row, on the live state it shares
+    with the others. When the test refuses the thread, it executes its
+    "Finish" callback and thrd_add() fails: the context is released by
+    the thread, not by the caller.
+
+    The thrd_remove() function asks a thread to terminate and waits for
+    it. The request is checked by the thread once per period, before
+    running "Business", thus a removed thread will execute "Finish" and
+    quit at its next activation. Priorities of the remaining threads are
+    then reassigned.
+
 @section Thrd_Callbacks Callbacks semantics
 
     As mentioned, each thread is associated with at least one callback
@@ -217,8 +625,30 @@ Usage: ./soto [options]
     the clock_nanosleep() system call, a defiant behavior with respect to
     these constraints shall result in a null waiting time.
 
+    What happens next depends on the overrun policy of the thread
+    (thrd_info_t::overrun):
+
+    @arg THRD_OVERRUN_CATCHUP (default) runs the late activations back
+         to back. Since a burst like this can produce further misses, the
+         number of late activations can be bounded by
+         thrd_info_t::catchup: the exceeding ones are skipped;
+    @arg THRD_OVERRUN_SKIP drops all the late activations, and the
+         thread waits for the next period boundary;
+    @arg THRD_OVERRUN_DEGRADE behaves like THRD_OVERRUN_SKIP, then calls
+         thrd_info_t::on_overrun with the number of skipped activations,
+         so that the thread can reduce its work (e.g. the plotting thread
+         moves to its longest period).
+
+    Skipped activations are counted apart from deadline misses
+    (thrd_rtstats_t::skip_count).
+
     "Start" and "Business" can, at any time, require the thread to be
     terminated by simply returning a non-zero value.
+
+    "Business" can also change the period of its own thread by calling
+    thrd_set_period(): the new period applies from the next activation.
+    Priorities are not reassigned, so a thread changing its period should
+    stay within the range which keeps the Rate Monotonic order.
     
     @warning A bad designed task set may jeopardize, by domino effect, the
              whole operating system stability: if the medium case
@@ -227,14 +657,10 @@ Usage: ./soto [options]
 
 @section Thrd_Limitations Shutting down
 
-    A Thread Pool object is not provided with a shutdown procedure: the
-    cleanup procedure provided, namely thrd_destroy(), simply waits for
-    all the running threads to be terminated. Calling this function
-    withouth signaling termination requests to threads won't stop the
-    application.
-
-    An elegant shutting down mechanism is provided by the @ref GenThrd
-    module.
+    The thrd_destroy() function sends a termination request to all the
+    threads still in the pool, then waits for them to be terminated.
+    Threads can also be stopped one by one through thrd_remove(), which is
+    what the @ref GenThrd module does.
 
 @defgroup GenThrd Generic Threads Interface
 
@@ -249,12 +675,11 @@ Usage: ./soto [options]
     which would have provided a way to gently ask the thread to die.
     Unfortunately the manpages tells us that &ldquo;signal masks are set
     on a per-thread basis, but signal actions and signal handlers [...]
-    are shared between all threads&rdquo;. Nevermind: who need signal when
-    there's the pthread_cancel() call does exactly what we need? We just
-    need to deal with cancellation points. Unfortunately the developer is
-    forced to do this in all modules! Once realized this can be
-    generalized, I had enough cases to make allowance for this code to be
-    written. A Generic Threads object wraps the described mechanism.
+    are shared between all threads&rdquo;. The pthread_cancel() call was
+    used for a while, but cancellation points are a pain to deal with, so
+    the termination is now cooperative: the @ref Thrd module checks a
+    termination request once per period (see thrd_remove()). A Generic
+    Threads object wraps the described mechanism.
     
     The thread subscription requires two main parameters:
    
@@ -263,10 +688,8 @@ Usage: ./soto [options]
     @arg An instance of the specification structure used by the @ref Thrd
          module (namely thrd_info_t).
     
-    Internally it subscribes a private initialization function which
-    retrieve the thread identifier before calling the actual "Start"
-    function provided by the user. The identifier's purpose is to
-    implement a termination procedure for the thread.
+    Internally it subscribes private "Start", "Business" and "Finish"
+    functions which wrap the ones provided by the user.
     
     Everything gets stored into a context structure which also will
     contain other meta-data and the actual context provided by the user.
@@ -276,15 +699,11 @@ Usage: ./soto [options]
 @section GenThrd_Termination Generic Thread Termination
 
     Through the handle of a Generic Thread, the developer can terminate
-    the execution of a real-time task. Internally this is achieved by
-    calling the pthread_destroy() system call.
-
-    The module ensures a correct process termination by disabling the
-    cancellation of the thread inside its private extension of the
-    "Start" function. Cancellation requests are explicitly checked
-    once per period and the module takes care of executing the user's
-    "Finish" procedure trough the Posix pthread_cleanup_push() and
-    pthread_cleanup_pop() functions.
+    the execution of a real-time task by calling genth_sendkill(). The
+    thread is removed from its pool: it terminates at its next
+    activation, after executing the user's "Finish" procedure, and the
+    call returns when it has been joined. Since the pool keeps running,
+    this can be used to turn a thread off at run time.
 
 @section GenThrd_Context Developing a Specialized Thread
 
@@ -303,7 +722,7 @@ Usage: ./soto [options]
 
     @see The following modules use a generic thread mechanism:
          @ref BizSampling, @ref BizPlotting, @ref BizSignal,
-         @ref BizSpectrum.
+         @ref BizSpectrum, @ref BizXY.
 
 @section GenThrd_Drawback Type Safety Drawback
 
@@ -317,6 +736,128 @@ Usage: ./soto [options]
     by a module on the handler obtained by another module.  This shall
     certainly bring to memory corruption.
 
+@defgroup RtLock Real Time Locks
+
+    Data shared among threads having different priorities (like the
+    sampling buffer, read by every analyzer, or the graphics, written by
+    the analyzers and read by the plotting thread) is a textbook setup for
+    priority inversion: a low priority thread holding the lock can be
+    preempted by a medium priority one, while the high priority thread
+    waits. The locks provided by this module (rtlock_t) use the priority
+    inheritance protocol, so the owner of a lock runs with the priority of
+    the highest thread waiting for it.
+
+@section RtLock_Instrumentation Instrumentation
+
+    After calling rtlock_instrument(), the new locks also keep count of
+    acquisitions, contentions (acquisitions which found the lock already
+    taken), time spent waiting and time spent holding the lock. Locks
+    protecting the same kind of data share a name, and rtlock_report()
+    shows their merged statistics. The program enables this with the
+    <tt>--lock-stats</tt> option, reporting the locks along with the
+    statistics of the threads: a long hold time on a lock shared with a
+    thread missing its deadlines is a good suspect.
+
+    Without instrumentation an uncontended acquisition is a plain
+    pthread_mutex_trylock(), while a contended one reads the clock to
+    record the wait in the trace of the thread (see @ref Thrd_Trace).
+    With instrumentation an uncontended acquisition costs two clock
+    readings (acquire and release), a contended one costs four.
+
+@defgroup Metrics Metrics Server
+
+    The statistics printed at exit are of little use on a machine running
+    for days. When the program gets the <tt>--metrics</tt> option, a
+    thread listens on a Unix domain socket and answers each connection
+    with the current statistics in the Prometheus text format:
+
+    @arg For each thread of the pool, the response time histogram, the
+         worst case response time, the deadline misses, the skipped
+         activations and the time spent busy waiting, plus the hardware
+         counters if enabled (see @ref PerfCtr);
+    @arg For the capture, the frames read, the overruns, the frames left
+         in the Alsa buffer after each read, and the drift of the sound
+         card clock from the monotonic one (see alsagw_drift());
+    @arg For the rendering, the windows redrawn, the period chosen by
+         the frame pacing and the histogram of the data age (see
+         @ref BizPlotting_Age). The period is only a target: the rate of
+         the windows actually redrawn comes from their counter.
+
+    A client may send nothing (e.g. <tt>socat - UNIX-CONNECT:path</tt>)
+    or an HTTP request, which gets an HTTP response: a local proxy can
+    then expose the socket to the usual scrapers. Clients are served one
+    at a time, and one which doesn't read its answer within half a second
+    is dropped, so that it can't stall the others.
+
+    Only a stale socket is removed from the path: when another kind of
+    file is there the server refuses to start, rather than deleting it
+    with the privileges of a real time program.
+
+    The server runs with the default scheduling policy and never takes a
+    lock shared with the real time threads: the statistics are copied
+    under their sequence locks (see thrd_rtstats_snapshot() and
+    alsagw_get_stats()), and the other values are plain atomic reads.
+    Threads added or removed at run time are added to or removed from
+    the exposition accordingly.
+
+@defgroup PerfCtr Hardware Performance Counters
+
+    A long execution time may come from a heavier callback or from a
+    colder cache. The hardware counters tell them apart: for each thread
+    a group of four perf_event_open(2) events counts cycles,
+    instructions, last level cache misses and branch misses, in user
+    space only.
+
+    The counters are read before and after each callback. Each event
+    page is mapped in memory, so that on x86, where the kernel allows
+    it, the reading is a rdpmc instruction and no system call; elsewhere
+    the counters are read() from the kernel.
+
+    The counters of a thread must be opened by the thread itself, and
+    they may be refused (e.g. by <tt>/proc/sys/kernel/perf_event_paranoid</tt>
+    or inside a virtual machine): in that case the thread runs anyway,
+    without counters.
+
+@defgroup Logging Asynchronous Logging
+
+    Writing on a terminal or a pipe may block, and a real time thread
+    must not wait for it. The logging macros of logging.h call
+    logging_print(), which doesn't write when the calling thread has a
+    log ring: the message is formatted in the ring, and a writer thread
+    with the default scheduling policy writes it later.
+
+    Each thread of the pool gets its ring (see logging_attach()) before
+    running any callback. Having a single producer and a single consumer,
+    the ring needs no lock: the thread moves the head, the writer the
+    tail. When a ring is full the messages are dropped rather than
+    waiting: the writer reports how many, and the metrics server
+    exposes the total. The other threads, and all of them before
+    logging_start() and after logging_stop(), write directly.
+
+    The only lock shared with the real time threads protects the list of
+    the rings just attached: the writer takes it just to move them on
+    its own list, and never holds it while writing.
+
+@defgroup AllocGuard Allocation Guard
+
+    The callbacks of the real time threads must not allocate memory: the
+    allocator may take locks, or ask the kernel for new pages. The
+    allocation guard is a debugging mode checking this, enabled by the
+    <tt>--enable-alloc-guard</tt> configure option.
+
+    The program then replaces malloc(), calloc(), realloc() and free(),
+    along with the aligned allocators (posix_memalign(), which is used by
+    fftw_malloc(), aligned_alloc(), memalign(), valloc() and pvalloc()),
+    which still allocate through the C library. The thread pool marks
+    each thread while it runs a periodic callback, including the
+    calibration runs (see @ref Thrd_Admission): a call made by a marked
+    thread is counted, and the first ones are recorded with their
+    backtrace. At exit the program reports the outcome, PASS or FAIL,
+    followed by the recorded backtraces.
+
+    Without the configure option the marking functions are empty inline
+    functions, and nothing is replaced.
+
 @defgroup BizAlsaGw Alsa Gateway 
 
     This module tries to hide Alsa's weird calls under a hood, providing a
@@ -348,30 +889,73 @@ Usage: ./soto [options]
     the application's purpose. In order to obtain a good and thread-safe
     code, the reentrant version of the library is used.
 
+    All the plotting windows are owned by a rendering server (plotsrv_t),
+    which keeps a single connection to the X server. Each window is drawn
+    by a libplot X Drawable plotter on a back buffer, which gets copied on
+    the window once the drawing is complete.
+
     The constructor provided by this module allows to allocate many grapical
-    windows for plotting. The number of functions displayed for each plotting
-    window can be configured trough the constructor. A plot_t object
-    configured with N graphics will spawn up to N plotgr_t objects, each
-    of which corresponds to a graphic.
+    windows for plotting on the same server. The number of functions
+    displayed for each plotting window can be configured trough the
+    constructor. A plot_t object configured with N graphics will spawn up
+    to N plotgr_t objects, each of which corresponds to a graphic.
     
     Since internally they implement a mutex-based semantics, it's
     perfectly safe to manage them from different threads. Two possible
     kind of actions can be performed:
 
     @arg Updating the graph through the plot_graphic_set() function;
-    @arg Refreshing the plotting window trough the plot_redraw() function.
+    @arg Refreshing the plotting windows trough the plotsrv_redraw()
+         function.
 
     The former can be used by a thread to update the graphic, while the
     latter can be easily assigned to a specialized thread by using a
-    @ref BizPlotThread.
+    @ref BizPlotThread. Updating a graphic marks its window as dirty:
+    plotsrv_redraw() only redraws dirty windows.
+
+    Closing a window simply hides it, while the program keeps running.
+
+    Two drawing backends are available, selected when the server is
+    created:
+
+    @arg libplot, trough its X Drawable driver, which issues one protocol
+         request per line segment;
+    @arg MIT-SHM: the graphics are rasterized client side into an image
+         shared with the X server, then pushed with a single
+         XShmPutImage() call. The polylines are drawn as one vertical span
+         per pixel column, so the cost depends on the window width rather
+         than on the number of points. If the X server cannot share
+         memory with the application (e.g. on a remote display) the
+         server falls back to libplot. The fallback is decided window by
+         window, so a window failing to attach its segment doesn't affect
+         the other ones. The server waits for the X server to consume
+         the images (XSync()) only when some image got sent.
+
+@section BizPlotting_Age Data age
+
+    The statistics of the single threads don't tell how late the user
+    sees the signal, which is what matters for an oscilloscope: the data
+    waits in the Alsa buffer, in the slots of the @ref BizSampling, in the
+    graphics, and finally for the next redraw.
+
+    The capture time of the data travels along with it: the Sampling
+    Thread stamps each slot, sampth_get_samples() returns the stamp of the
+    newest slot, and the analyzers forward it to their graphics with
+    plot_graphic_stamp(). Each redraw ends once the X server got the
+    images, then the server records, for each graphic showing data never
+    shown before, the time elapsed since the capture. The waiting happens
+    without the lock of the server, and the ages are recorded at the
+    beginning of the next redraw. The histogram is printed with the statistics, and exposed by
+    the @ref Metrics.
 
 @defgroup BizPlotThread Plotting Thread
 
     This module implements a @ref GenThrd "Generic Thread" which updates
-    a plot. It's tought to extend the functionalities provided by the
-    @ref BizPlotting module without mixing conceptually different
-    execution logics. The thread is in charge of refreshing a plotting
-    window.
+    all the plots of a rendering server. It's tought to extend the
+    functionalities provided by the @ref BizPlotting module without mixing
+    conceptually different execution logics. Since a single thread is in
+    charge of refreshing every plotting window, opening more windows
+    doesn't increase the number of threads.
    
     The refresh operation is performed 28 times per second, which is
     approximatively the frequency detectable by human eyes. The period
@@ -389,6 +973,26 @@ Usage: ./soto [options]
           further details see the @ref CLI and the @ref BizSampling
           section.
 
+@section BizPlotThread_Pacing Frame pacing
+
+    A fixed refresh rate wastes the CPU when rendering is cheap and
+    starves the other threads when it gets expensive (e.g. many points,
+    persistence mode). When a plotth_pacing_t specification is provided,
+    the thread measures its average CPU time over a window of activations
+    (PLOT_PACING_WINDOW) and moves its period towards the one which would
+    give the target utilization, within the given bounds. The response
+    time is not used: it grows when the other threads are busy, or when
+    the X server is slow, which says nothing about the share of CPU taken
+    by rendering.
+
+    The period is changed with thrd_set_period(): under Rate Monotonic
+    the priorities of the pool are reassigned on the new periods, so the
+    plotting thread may move below or above the analyzers.
+
+    By default the refresh rate moves between 60 and 10 frames per second
+    and the target utilization is 20%. See the @c --plot-period and
+    @c --plot-util options in the @ref CLI section.
+
 @defgroup BizSampling Sampling Thread
 
     This module implements a @ref GenThrd "Generic Thread" which achieves
@@ -408,6 +1012,11 @@ Usage: ./soto [options]
     function, which performs a thread-safe reading from the oldest to the
     newest slot of the circular buffer.
 
+    Each slot is stamped with the capture time of its last frame, namely
+    the time of the read minus the frames still waiting in the Alsa
+    buffer. sampth_get_samples() returns the stamp of the newest slot
+    (see @ref BizPlotting_Age).
+
     @note The period returned by the alsagw_get_period() is not exactly
           the one expected: a bitrate of 44.1 kHz should require a period
           of 22675 nanoseconds, while Alsa returns 725000 nanoseconds as
@@ -424,6 +1033,15 @@ Usage: ./soto [options]
     plot_new_graphic() function, provided by the @ref BizPlotting module.
     They are not required to come from the same plot_t object.
 
+    Each time the thread has written a whole buffer on the graphics, it
+    commits them as a trace (see plot_graphic_commit()). This allows the
+    persistence mode of the @ref BizPlotting module, which is enabled by
+    the @c --phosphor option: like on a digital phosphor oscilloscope,
+    every trace is accumulated into a 2-D intensity histogram which
+    decays at each commit, and the window shows the histogram as a
+    heatmap. Transients which would be overwritten by the next trace stay
+    visible for a while, and no per-trace history is kept.
+
 @defgroup BizSpectrum Spectrum Thread
 
     This module allows to spawn one (or more) graphical windows showing
@@ -439,6 +1057,28 @@ Usage: ./soto [options]
     @ref BizPlotting module. They are not required to come from the same
     plot_t object.
 
+@defgroup BizXY XY Thread
+
+    This module allows to spawn a graphical window showing channel 0
+    against channel 1 of the signal collected by the @ref BizSampling,
+    namely a goniometer (or Lissajous figure), useful to check the stereo
+    phase.
+
+    Each frame of the buffer is a point: instead of being drawn trough
+    libplot, the points are accumulated in the density histogram of a
+    graphic in persistence mode (see plot_graphic_scatter()), so that the
+    cost of drawing doesn't depend on the sample rate. The histogram
+    decays at each buffer, so the trail of old points fades out
+    completely within a few tens of activations.
+
+    A second graphic shows the history of the correlation between the
+    channels, from -1 (opposite phase) to 1 (mono). The correlation is
+    computed incrementally: the sums of products are kept between
+    activations, decayed by a forgetting factor and updated with the new
+    frames only. The thread takes from the @ref BizSampling only the
+    slots filled since its previous activation (see sampth_get_fresh()),
+    so each frame is scattered and summed once.
+
 @defgroup BizOptions Command line options
 
     This module provides a wrapper for Getopt which extracts the options
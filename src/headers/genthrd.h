@@ -52,12 +52,14 @@ const thrd_rtstats_t * genth_subscribe (genth_t **handle,
 
 /** @brief Request thread termination.
  *
- * This call terminates the running thread.
+ * This call terminates the thread and removes it from its pool, waiting
+ * until the user's "Finish" procedure has been executed. The handle is
+ * released, and must not be used anymore.
  *
  * @param handle The handle of the thread.
  *
  * @retval 0 on success;
- * @retval -1 on failure (thread not started).
+ * @retval -1 on failure (NULL handle).
  */
 int genth_sendkill (genth_t *handle);
 
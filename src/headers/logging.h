@@ -25,6 +25,8 @@
  * In order to enable debugging verbosity please run the configure script
  * with the '--enable-debug' flag.
  *
+ * The macros never write from a real time thread: see @ref Logging.
+ *
  */
 
 #ifndef __defined_headers_logging_h
@@ -34,24 +36,78 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "headers/config.h"
 
+/** @addtogroup Logging */
+/*@{*/
+
+/** @brief Number of records of each log ring (power of two). */
+#define LOGGING_RING_RECORDS    64
+
+/** @brief Size of a record, longer messages are truncated. */
+#define LOGGING_RECORD_SIZE     128
+
+/** @brief Period of the writer thread, milliseconds. */
+#define LOGGING_PERIOD_mSEC     20
+
+/** @brief Start the writer thread.
+ *
+ * Until this is called, and after logging_stop(), the messages are
+ * written directly.
+ *
+ * @retval 0 on success;
+ * @retval -1 on failure (errno is set).
+ */
+int logging_start (void);
+
+/** @brief Write the pending messages and stop the writer thread.
+ *
+ * The threads having a ring must be terminated before.
+ */
+void logging_stop (void);
+
+/** @brief Give a log ring to the calling thread.
+ *
+ * From now on the messages of the thread are formatted into the ring,
+ * and the writer thread writes them. When the ring is full the messages
+ * are dropped and counted. The ring is released when the thread
+ * terminates. Nothing happens if the writer is not running.
+ */
+void logging_attach (void);
+
+/** @brief Write a message.
+ *
+ * This is used by the logging macros: a thread having a ring (see
+ * logging_attach()) enqueues the message, the others write it.
+ *
+ * @param stream The destination;
+ * @param fmt The printf-like format.
+ */
+void logging_print (FILE *stream, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/** @brief Number of messages dropped because of a full ring. */
+uint64_t logging_dropped (void);
+
+/*@}*/
+
 #ifdef DEBUG_ENABLED
 
 /** @brief Debugging macro for a simple string. */
 #define DEBUG_MSG(str) \
-        fprintf(stderr, "[%08X] " str "\n", (unsigned) pthread_self())
+        logging_print(stderr, "[%08X] " str "\n", (unsigned) pthread_self())
 
 /** @brief Debugging macro for a printf-like formt. */
 #define DEBUG_FMT(fmt, ...) \
-        fprintf(stderr, "[%08X] " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
+        logging_print(stderr, "[%08X] " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
 
 /** @brief Debugging macro for struct timespec. */
 #define DEBUG_TIMESPEC(str, remain)                                 \
     do if ((remain).tv_sec != 0 || (remain).tv_nsec != 0) {         \
-        fprintf(stderr, "[%08X] " str " [sec=%u, nsec=%lu]\n",      \
+        logging_print(stderr, "[%08X] " str " [sec=%u, nsec=%lu]\n", \
                 (unsigned) pthread_self(),                          \
                 (unsigned) ((remain).tv_sec),                       \
                 (remain).tv_nsec);                                  \
@@ -72,19 +128,19 @@ extern "C" {
 
 /** @brief Error logging macro for a simple string. */
 #define ERR_MSG(str) \
-        fprintf(stderr, "[%08X] ERROR: " str "\n", (unsigned) pthread_self())
+        logging_print(stderr, "[%08X] ERROR: " str "\n", (unsigned) pthread_self())
 
 /** @brief Error logging macro for a printf-like formt. */
 #define ERR_FMT(fmt, ...) \
-        fprintf(stderr, "[%08X] ERROR: " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
+        logging_print(stderr, "[%08X] ERROR: " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
 
 /** @brief Logging macro for a simple string. */
 #define LOG_MSG(str) \
-        fprintf(stdout, "[%08X] " str "\n", (unsigned) pthread_self())
+        logging_print(stdout, "[%08X] " str "\n", (unsigned) pthread_self())
 
 /** @brief Logging macro for a printf-like formt. */
 #define LOG_FMT(fmt, ...) \
-        fprintf(stdout, "[%08X] " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
+        logging_print(stdout, "[%08X] " fmt "\n", (unsigned) pthread_self(), __VA_ARGS__)
 
 #ifdef __cplusplus
 }
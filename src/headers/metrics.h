@@ -0,0 +1,136 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** @file metrics.h */
+/** @addtogroup Metrics */
+/*@{*/
+
+#ifndef __defined_headers_metrics_h
+#define __defined_headers_metrics_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "headers/thrd.h"
+
+/** @brief Opaque type for the metrics server. */
+typedef struct metrics metrics_t;
+
+/** @brief Kind of a value exposed by metrics_add_value(). */
+typedef enum {
+    METRICS_COUNTER,    /**< Monotonically increasing value */
+    METRICS_GAUGE       /**< Value which can go up and down */
+} metrics_type_t;
+
+/** @brief Reader of a value.
+ *
+ * The callback runs on the metrics thread, concurrently with the real
+ * time threads: it must not block them.
+ *
+ * @param context The specified user data.
+ * @return The current value.
+ */
+typedef double (* metrics_read_cb_t) (void *context);
+
+/** @brief Reader of a histogram.
+ *
+ * The same constraints of metrics_read_cb_t apply.
+ *
+ * @param context The specified user data;
+ * @param hist Filled with the current histogram (ns).
+ * @return The sum of the values recorded in the histogram (ns).
+ */
+typedef uint64_t (* metrics_hist_cb_t) (void *context, thrd_hist_t *hist);
+
+/** @brief Start the metrics server.
+ *
+ * A thread with the default (non real time) scheduling listens on a Unix
+ * domain socket. Each connection gets the current metrics in the
+ * Prometheus text format, then it is closed. A stale socket on the same
+ * path is replaced, while any other kind of file makes the call fail
+ * with EEXIST.
+ *
+ * @param path The path of the socket.
+ * @return The newly allocated server.
+ * @retval NULL on failure (errno is set).
+ */
+metrics_t * metrics_new (const char *path);
+
+/** @brief Stop the metrics server.
+ *
+ * Waits for the thread, then removes the socket.
+ *
+ * @param m The server.
+ */
+void metrics_destroy (metrics_t *m);
+
+/** @brief Expose the statistics of a thread of the pool.
+ *
+ * @param m The server;
+ * @param name The name of the thread, used as label;
+ * @param stats The statistics, as returned by thrd_add().
+ */
+void metrics_add_task (metrics_t *m, const char *name,
+                       const thrd_rtstats_t *stats);
+
+/** @brief Stop exposing the statistics of a thread.
+ *
+ * This must be called before removing the thread from its pool, since
+ * the statistics are freed along with the thread.
+ *
+ * @param m The server;
+ * @param stats The statistics given to metrics_add_task().
+ */
+void metrics_remove_task (metrics_t *m, const thrd_rtstats_t *stats);
+
+/** @brief Expose a value.
+ *
+ * @param m The server;
+ * @param name The name of the metric;
+ * @param help The description of the metric;
+ * @param type The kind of the metric;
+ * @param read The reader of the value;
+ * @param context The context of the reader.
+ */
+void metrics_add_value (metrics_t *m, const char *name, const char *help,
+                        metrics_type_t type, metrics_read_cb_t read,
+                        void *context);
+
+/** @brief Expose a histogram of durations.
+ *
+ * The histogram is exposed in seconds, with the same buckets used for
+ * the response times of the tasks.
+ *
+ * @param m The server;
+ * @param name The name of the metric (should end with "_seconds");
+ * @param help The description of the metric;
+ * @param read The reader of the histogram;
+ * @param context The context of the reader.
+ */
+void metrics_add_histogram (metrics_t *m, const char *name,
+                            const char *help, metrics_hist_cb_t read,
+                            void *context);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __defined_headers_metrics_h
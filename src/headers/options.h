@@ -35,6 +35,20 @@ extern "C" {
 /** @brief Option opaque type. */
 typedef struct opts opts_t;
 
+/** Scheduling policies selectable from command line */
+typedef enum {
+    OPTS_SCHED_RM,      /**< Rate Monotonic (SCHED_FIFO) */
+    OPTS_SCHED_EDF,     /**< Earliest Deadline First (SCHED_DEADLINE) */
+    OPTS_SCHED_CYCLIC   /**< Cyclic executive (single thread) */
+} opts_sched_t;
+
+/** Admission control modes selectable from command line */
+typedef enum {
+    OPTS_ADMIT_OFF,     /**< No schedulability test */
+    OPTS_ADMIT_WARN,    /**< Warn about unschedulable task sets */
+    OPTS_ADMIT_REJECT   /**< Refuse to run unschedulable task sets */
+} opts_admission_t;
+
 /** @brief Parse the command line options
  *
  * @note This function is supposed to work as interface with the shell,
@@ -105,6 +119,30 @@ bool opts_spectrum_shown (opts_t *o);
  */
 bool opts_signal_shown (opts_t *o);
 
+/** @brief Show the XY plot predicate. 
+ *
+ * @param o The options set.
+ * @retval true If the program must show the XY plot.
+ * @retval false If the program must not show the XY plot.
+ */
+bool opts_xy_shown (opts_t *o);
+
+/** @brief Persistence mode predicate.
+ *
+ * @param o The options set.
+ * @retval true If the signal must be shown as a phosphor heatmap.
+ * @retval false If the signal must be shown as a plain trace.
+ */
+bool opts_phosphor_enabled (opts_t *o);
+
+/** @brief Shared memory rendering predicate.
+ *
+ * @param o The options set.
+ * @retval true If the plots must be rendered trough MIT-SHM.
+ * @retval false If the plots must be rendered trough libplot.
+ */
+bool opts_xshm_enabled (opts_t *o);
+
 /** @brief Getter for the buffer scale.
  *
  * Buffer scale is a multiplicative factor that defines the proportion
@@ -116,6 +154,101 @@ bool opts_signal_shown (opts_t *o);
  */
 unsigned opts_get_buffer_scale (opts_t *o);
 
+/** @brief Getter for the scheduling policy.
+ *
+ * @param o The options set.
+ * @return The scheduling policy of the real-time threads.
+ */
+opts_sched_t opts_get_sched (opts_t *o);
+
+/** @brief Getter for the admission control mode.
+ *
+ * @param o The options set.
+ * @return The admission control mode.
+ */
+opts_admission_t opts_get_admission (opts_t *o);
+
+/** @brief Partitioned scheduling predicate.
+ *
+ * @param o The options set.
+ * @retval true If each thread must be pinned on a single CPU.
+ * @retval false If threads can migrate among CPUs.
+ */
+bool opts_partition_enabled (opts_t *o);
+
+/** @brief Getter for the statistics report interval.
+ *
+ * @param o The options set.
+ * @return The interval in seconds between two statistics reports, 0 if
+ *         the statistics must be reported only at exit.
+ */
+unsigned opts_get_stats_interval (opts_t *o);
+
+/** @brief Lock instrumentation predicate.
+ *
+ * @param o The options set.
+ * @retval true If the contention statistics of the locks are required.
+ * @retval false Otherwise.
+ */
+bool opts_lock_stats_enabled (opts_t *o);
+
+/** @brief Busy waiting wake up predicate.
+ *
+ * @param o The options set.
+ * @retval true If the sampling thread must busy wait its activations.
+ * @retval false If it must sleep.
+ */
+bool opts_spin_wake_enabled (opts_t *o);
+
+/** @brief Getter for the trace output.
+ *
+ * @param o The options set.
+ * @return The file where the traces must be written, NULL if not
+ *         required. The string is part of the command line, hence it
+ *         outlives the options set.
+ */
+const char * opts_get_trace (opts_t *o);
+
+/** @brief Getter for the socket of the metrics server.
+ *
+ * @param o The options set.
+ * @return The path of the socket, NULL if the server is not required.
+ */
+const char * opts_get_metrics (opts_t *o);
+
+/** @brief Hardware performance counters predicate.
+ *
+ * @param o The options set.
+ * @retval true If the threads must be measured with the hardware
+ *         performance counters.
+ * @retval false Otherwise.
+ */
+bool opts_perf_counters_enabled (opts_t *o);
+
+/** @brief Getter for the watchdog limit.
+ *
+ * @param o The options set.
+ * @return The number of periods a thread may stall before being
+ *         reported, 0 if the watchdog is disabled.
+ */
+unsigned opts_get_watchdog (opts_t *o);
+
+/** @brief Getter for the plotting period bounds.
+ *
+ * @param o The options set;
+ * @param min Filled with the shortest plotting period, milliseconds;
+ * @param max Filled with the longest plotting period, milliseconds.
+ */
+void opts_get_plot_period (opts_t *o, unsigned *min, unsigned *max);
+
+/** @brief Getter for the plotting target utilization.
+ *
+ * @param o The options set.
+ * @return The target utilization of the plotting thread in percent, 0 if
+ *         the plotting period is fixed.
+ */
+unsigned opts_get_plot_util (opts_t *o);
+
 /*@}*/
 
 #ifdef __cplusplus
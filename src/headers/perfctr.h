@@ -0,0 +1,89 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** @file perfctr.h */
+/** @addtogroup PerfCtr */
+/*@{*/
+
+#ifndef __defined_headers_perfctr_h
+#define __defined_headers_perfctr_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** Number of events counted by a perfctr_t. */
+#define PERFCTR_EVENTS  4
+
+/** Counted events */
+typedef enum {
+    PERFCTR_CYCLES,         /**< CPU cycles */
+    PERFCTR_INSTRUCTIONS,   /**< Retired instructions */
+    PERFCTR_CACHE_MISSES,   /**< Last level cache misses */
+    PERFCTR_BRANCH_MISSES   /**< Mispredicted branches */
+} perfctr_event_t;
+
+/** Opaque type for a set of hardware counters */
+typedef struct perfctr perfctr_t;
+
+/** Open the hardware counters of the calling thread.
+ *
+ * The counters measure only the user space execution of the thread, and
+ * they keep counting until perfctr_close().
+ *
+ * @return The newly allocated counters.
+ * @retval NULL if the counters are not available (errno is set), e.g.
+ *         because of the perf_event_paranoid setting.
+ */
+perfctr_t * perfctr_open (void);
+
+/** Read the counters.
+ *
+ * This must be called by the thread which opened the counters. Where the
+ * kernel allows it the counters are read with the rdpmc instruction,
+ * without entering the kernel.
+ *
+ * @param pc The counters;
+ * @param values Filled with the current value of each perfctr_event_t.
+ */
+void perfctr_read (perfctr_t *pc, uint64_t values[PERFCTR_EVENTS]);
+
+/** Close the counters.
+ *
+ * This can be called by any thread.
+ *
+ * @param pc The counters.
+ */
+void perfctr_close (perfctr_t *pc);
+
+/** Get the name of an event.
+ *
+ * @param event The event.
+ * @return A lower case name, suitable as an identifier.
+ */
+const char * perfctr_name (perfctr_event_t event);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __defined_headers_perfctr_h
@@ -33,19 +33,46 @@ extern "C" {
 #include "headers/plotting.h"
 #include "alsagw.h"
 
+/** @brief Frame pacing specification for plotth_subscribe(). */
+typedef struct {
+    struct timespec min;    /**< Shortest period (fastest refresh); */
+    struct timespec max;    /**< Longest period (slowest refresh); */
+    unsigned utilization;   /**< Target share of CPU, in percent. */
+} plotth_pacing_t;
+
 /** @brief Subscribe a plotting thread to the given pool.
+ *
+ * A single thread renders all the plots of the server, no matter how
+ * many windows are open.
+ *
+ * If a pacing specification is provided the thread measures its own
+ * rendering cost and adjusts its period, within the given bounds, in
+ * order to keep its utilization around the target.
  *
  * @param handle Thea address of a pointer where the plotting thread
  *               handle address will be stored;
  * @param pool The pool to which the sampler will be subscribed;
- * @param plot The plotter instance.
+ * @param srv The rendering server;
+ * @param pacing The frame pacing specification, or NULL for a fixed
+ *               period (PLOT_PERIOD_SEC + PLOT_PERIOD_nSEC).
  *
  * @return This function just adds something to pool, therefore you may
  *         interpret its return value as if it were thrd_add().
  */
 const thrd_rtstats_t * plotth_subscribe (genth_t **handle,
                                          thrd_pool_t *pool,
-                                         plot_t *plot);
+                                         plotsrv_t *srv,
+                                         const plotth_pacing_t *pacing);
+
+/** @brief Getter for the current period of the plotting thread.
+ *
+ * With frame pacing the period changes over time. The call can be done
+ * from any thread.
+ *
+ * @param handle The handle of the plotting thread.
+ * @return The period in nanoseconds.
+ */
+uint64_t plotth_get_period (const genth_t *handle);
 
 /*@}*/
 
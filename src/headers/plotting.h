@@ -32,25 +32,109 @@ extern "C" {
 #include <plot.h>
 #include <stdint.h>
 
+#include "headers/thrd.h"
+
+/** @brief Rendering server opaque type. */
+typedef struct plot_server plotsrv_t;
+
 /** @brief Plotter opaque type. */
 typedef struct plot plot_t;
 
 /** @brief Plotter graphic opaque type */
 typedef struct graphic plotgr_t;
 
+/** @brief Drawing backends. */
+typedef enum {
+    PLOT_BACKEND_LIBPLOT,   /**< Draw trough libplot's X Drawable driver; */
+    PLOT_BACKEND_XSHM       /**< Rasterize client side, push the pixels
+                             *   trough the MIT-SHM extension. */
+} plot_backend_t;
+
+/** @brief Rendering server constructor.
+ *
+ * The server owns the connection to the X server and every plot created
+ * on it.
+ *
+ * @note If PLOT_BACKEND_XSHM is required but the X server cannot share
+ *       memory with us (e.g. a remote display), PLOT_BACKEND_LIBPLOT is
+ *       used instead. This is decided for each plot, when it is created.
+ *
+ * @param backend The drawing backend for the plots.
+ *
+ * @return The newly allocated server, or NULL if the X display cannot be
+ *         opened.
+ */
+plotsrv_t * plotsrv_new (plot_backend_t backend);
+
+/** @brief Redraw all the plots which have been modified.
+ *
+ * Plots are redrawn only if at least one of their graphics has been
+ * updated since the last call. This function is supposed to be called
+ * periodically by a single thread.
+ *
+ * @param srv The rendering server.
+ */
+void plotsrv_redraw (plotsrv_t *srv);
+
+/** @brief Count the redrawn windows.
+ *
+ * The call can be done from any thread.
+ *
+ * @param srv The rendering server.
+ * @return The number of windows redrawn by plotsrv_redraw() so far.
+ */
+uint64_t plotsrv_get_frames (const plotsrv_t *srv);
+
+/** @brief Get the age of the data at render time.
+ *
+ * Each time a graphic is redrawn with data stamped by
+ * plot_graphic_stamp() which was not shown before, the time elapsed from
+ * the capture to the end of the redraw is recorded. The call can be done
+ * from any thread.
+ *
+ * @param srv The rendering server;
+ * @param age Filled with the histogram of the ages (ns).
+ * @return The sum of the recorded ages (ns).
+ */
+uint64_t plotsrv_get_age (const plotsrv_t *srv, thrd_hist_t *age);
+
+/** @brief Rendering server destructor.
+ *
+ * All the plots owned by the server are destroyed as well.
+ *
+ * @param srv The server to be destroyed.
+ */
+void plotsrv_destroy (plotsrv_t *srv);
+
 /** @brief Plotter constructor.
  *
  * @note This function spawns a X11 window on which the plot will be
- *       displayed.
+ *       displayed. The window is rendered by the server. Plots can be
+ *       added while the server is being redrawn by another thread.
  *
+ * @param srv The rendering server which will own the plot;
  * @param n The number of graphics that shall be drawn on the canvas;
  * @param max_x The maximum accepted value for the x axis.
  *
  * @return The newly allocated plot instance.
  */
-plot_t * plot_new (size_t n, unsigned max_x);
+plot_t * plot_new (plotsrv_t *srv, size_t n, unsigned max_x);
+
+/** @brief Show or hide the window of a plot.
+ *
+ * The request is applied by the next plotsrv_redraw(), so this can be
+ * called from any thread. A hidden plot is not redrawn.
+ *
+ * @param p The plot;
+ * @param shown Non-zero to show the window, zero to hide it.
+ */
+void plot_show (plot_t *p, int shown);
 
 /** @brief Add a new graphic.
+ *
+ * The graphic is shown only once it is completely set up, so this can be
+ * called while plotsrv_redraw() is running. Graphics of the same plot
+ * must be added by a single thread.
  *
  * @param p The plotter.
  *
@@ -61,7 +145,8 @@ plotgr_t * plot_new_graphic (plot_t *p);
 
 /** @brief Write a value on a graphic.
  *
- * In order to visualize modification plot_redraw() must be called.
+ * In order to visualize modification plot_redraw() must be called
+ * (plotsrv_redraw() does it for modified plots).
  *
  * @param g The graphic to write on;
  * @param pos The position to modify;
@@ -72,17 +157,65 @@ plotgr_t * plot_new_graphic (plot_t *p);
  */
 void plot_graphic_set (plotgr_t *g, unsigned pos, int16_t val);
 
-/** @brief Update the window by redrawing.
+/** @brief Set the capture time of the data written on a graphic.
  *
- * @param p The plot to be redrawn.
+ * The stamp travels along the data up to the screen: the rendering
+ * server records how old the data is when it gets shown (see
+ * plotsrv_get_age()). It should be set along with the values of a trace
+ * (before plot_graphic_commit() in persistence mode).
+ *
+ * @param g The graphic;
+ * @param capture The capture time, as returned by sampth_get_samples();
+ *                0 means unknown, and nothing is recorded.
  */
-void plot_redraw(plot_t *p);
+void plot_graphic_stamp (plotgr_t *g, uint64_t capture);
 
-/** @brief Plotter Destructor
+/** @brief Enable the persistence mode on a graphic.
+ *
+ * In persistence mode the graphic behaves like the screen of a digital
+ * phosphor oscilloscope: each trace committed with plot_graphic_commit()
+ * is accumulated in a 2-D intensity histogram which decays over time, and
+ * the histogram is shown as a heatmap instead of the trace itself.
+ *
+ * @param g The graphic;
+ * @param decay At each commit the intensity loses 1/2^decay of its
+ *              value, rounded up, so that cells not hit anymore fade
+ *              out completely (must be between 1 and 15).
  *
- * @param p The plotter to be destroyed.
+ * @return 0 on success, -1 if the histogram cannot be allocated.
  */
-void plot_destroy (plot_t *p);
+int plot_graphic_persist (plotgr_t *g, unsigned decay);
+
+/** @brief Commit the values of a graphic as a complete trace.
+ *
+ * This should be called after the last plot_graphic_set() of a trace.
+ * In persistence mode the trace gets accumulated into the histogram,
+ * otherwise the call just notifies the update.
+ *
+ * @param g The graphic.
+ */
+void plot_graphic_commit (plotgr_t *g);
+
+/** @brief Accumulate a set of points on a graphic in persistence mode.
+ *
+ * The histogram of the graphic gets decayed once, then each point is
+ * added to the cell it falls in. This draws a XY density plot which costs
+ * the same no matter how many points fall in a cell. The x axis spans a
+ * square area in the middle of the graphic slot.
+ *
+ * @see plot_graphic_persist().
+ *
+ * @param g The graphic, which must be in persistence mode;
+ * @param xy The points, as an array of interleaved x and y coordinates;
+ * @param npoints The number of points (half the length of xy).
+ */
+void plot_graphic_scatter (plotgr_t *g, const int16_t xy[], size_t npoints);
+
+/** @brief Update the window by redrawing.
+ *
+ * @param p The plot to be redrawn.
+ */
+void plot_redraw(plot_t *p);
 
 /*@}*/
 
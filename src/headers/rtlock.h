@@ -0,0 +1,111 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** @file rtlock.h */
+/** @addtogroup RtLock */
+/*@{*/
+
+#ifndef __defined_headers_rtlock_h
+#define __defined_headers_rtlock_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+/** Contention statistics of a lock (times in nanoseconds) */
+typedef struct {
+    uint64_t acquisitions;      /**< Number of acquisitions; */
+    uint64_t contentions;       /**< Acquisitions which found the lock
+                                 *   taken; */
+    uint64_t wait_total;        /**< Time spent waiting for the lock; */
+    uint64_t wait_max;          /**< Longest wait; */
+    uint64_t hold_total;        /**< Time spent holding the lock; */
+    uint64_t hold_max;          /**< Longest hold. */
+} rtlock_stats_t;
+
+/** Lock shared between real-time threads.
+ *
+ * The fields are private: the structure is exposed only to allow its
+ * embedding into other structures.
+ */
+typedef struct rtlock {
+    pthread_mutex_t mux;        /**< Priority inheritance mutex; */
+    const char *name;           /**< Name used in reports; */
+    int instrumented;           /**< Statistics enabled; */
+    uint64_t taken;             /**< Acquisition time of the owner; */
+    rtlock_stats_t stats;       /**< Statistics, protected by mux. */
+} rtlock_t;
+
+/** Enable the instrumentation of the locks.
+ *
+ * Only the locks initialized afterwards are affected. The
+ * instrumentation is disabled by default.
+ *
+ * @param enable Non-zero to enable instrumentation.
+ */
+void rtlock_instrument (int enable);
+
+/** Initialize a lock.
+ *
+ * The lock uses the priority inheritance protocol. If instrumentation is
+ * enabled the lock is also registered for rtlock_report().
+ *
+ * @param lock The lock to be initialized;
+ * @param name A name for the reports. Locks protecting the same kind of
+ *             data should share it, and their statistics get merged.
+ */
+void rtlock_init (rtlock_t *lock, const char *name);
+
+/** Destroy a lock.
+ *
+ * @param lock The lock to be destroyed.
+ */
+void rtlock_destroy (rtlock_t *lock);
+
+/** Acquire a lock.
+ *
+ * If the lock is contended, the wait is recorded in the trace of the
+ * calling thread (see thrd_trace()).
+ *
+ * @param lock The lock.
+ */
+void rtlock_acquire (rtlock_t *lock);
+
+/** Release a lock.
+ *
+ * @param lock The lock.
+ */
+void rtlock_release (rtlock_t *lock);
+
+/** Print the statistics of the instrumented locks.
+ *
+ * Locks having the same name are reported together.
+ */
+void rtlock_report (void);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __defined_headers_rtlock_h
+
@@ -36,6 +36,7 @@ extern "C" {
 #include <stdint.h>
 #include <signal.h>
 #include <string.h>
+#include <errno.h>
 
 #include "headers/constants.h"
 
@@ -72,14 +73,35 @@ void rtutils_get_now (struct timespec *n)
 }
 
 /** Sleep until a certain absolute delay expires
+ *
+ * Interruptions by signal handlers are not considered.
  *
  * @param delay The execution delay.
  */
 static inline
 void rtutils_wait (const struct timespec *delay)
 {
-    assert(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
-                           delay, NULL) == 0);
+    int err;
+
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, delay, NULL);
+    } while (err == EINTR);
+    assert(err == 0);
+}
+
+/** Hint the CPU that the caller is busy waiting.
+ *
+ * On x86 this is the 'pause' instruction, which saves power and lets
+ * the sibling hyper-thread run.
+ */
+static inline
+void rtutils_cpu_relax (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__ ("yield");
+#endif
 }
 
 /** Sum a time specification to another.
@@ -38,7 +38,8 @@ extern "C" {
  * @param pool The pool used for subscribing;
  * @param samp The sampler;
  * @param scaling_factor A multiplicative factor determining how many
- *        single samples the thread will be able to store.
+ *        single samples the thread will be able to store;
+ * @param wake How the thread waits for its activations.
  *
  * @see headers/alsagw.h.
  * @see genth_subscribe()  XXX
@@ -49,7 +50,8 @@ extern "C" {
 const thrd_rtstats_t * sampth_subscribe (genth_t **handler,
                                          thrd_pool_t *pool,
                                          alsagw_t *samp,
-                                         size_t scaling_factor);
+                                         size_t scaling_factor,
+                                         thrd_wake_t wake);
 
 /** Getter for the size of the reading buffer.
  *
@@ -66,8 +68,34 @@ snd_pcm_uframes_t sampth_get_size (const genth_t *handler);
  *
  * @param handler The sampling thread which buffer shall be read;
  * @param buffer The buffer where the data shall be stored.
+ *
+ * @return The capture time of the most recent frame in the buffer (ns,
+ *         on the monotonic clock of rtutils_get_now()), or 0 if nothing
+ *         has been read yet. This is meant to be forwarded to the plots
+ *         with plot_graphic_stamp().
+ */
+uint64_t sampth_get_samples (genth_t *handler, alsagw_frame_t buffer[]);
+
+/** Thread-safe getter for the frames read since the previous call.
+ *
+ * Like sampth_get_samples(), but only the slots filled since the previous
+ * call are copied, oldest first, so that each frame is processed once no
+ * matter the period of the caller. If the caller lags behind by more than
+ * the whole buffer, the overwritten slots are lost.
+ *
+ * @param handler The sampling thread which buffer shall be read;
+ * @param buffer The buffer where the data shall be stored, at least
+ *               sampth_get_size() frames long;
+ * @param seen Slots seen by the caller, updated by the call. It must be
+ *             initialized to 0 before the first call;
+ * @param nframes Filled with the number of frames stored in buffer,
+ *                possibly 0.
+ *
+ * @return The capture time of the most recent frame, as for
+ *         sampth_get_samples().
  */
-void sampth_get_samples (genth_t *handler, alsagw_frame_t buffer[]);
+uint64_t sampth_get_fresh (genth_t *handler, alsagw_frame_t buffer[],
+                           uint64_t *seen, snd_pcm_uframes_t *nframes);
 
 /** Getter for the correct reading period for the buffer.
  *
@@ -29,11 +29,13 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <sched.h>
 #include <pthread.h>
 #include <dacav/dacav.h>
 #include <time.h>
 
 #include "headers/logging.h"
+#include "headers/perfctr.h"
 
 /** Callback of the thread
  *
@@ -43,6 +45,63 @@ extern "C" {
  */
 typedef int (* thrd_cb_t) (void *context);
 
+/** Overrun notification
+ *
+ * @param context The specified user data;
+ * @param missed The number of activations which have been skipped.
+ */
+typedef void (* thrd_overrun_cb_t) (void *context, unsigned missed);
+
+/** Behaviour of a thread whose activation ends after the next one was
+ * due (see thrd_info_t::overrun).
+ */
+typedef enum {
+    THRD_OVERRUN_CATCHUP,   /**< Run the late activations back to back,
+                             *   at most thrd_info_t::catchup of them */
+    THRD_OVERRUN_SKIP,      /**< Skip the late activations and realign to
+                             *   the next period boundary */
+    THRD_OVERRUN_DEGRADE    /**< As THRD_OVERRUN_SKIP, then call
+                             *   thrd_info_t::on_overrun */
+} thrd_overrun_t;
+
+/** How a thread waits for its activations (see thrd_info_t::wake) */
+typedef enum {
+    THRD_WAKE_SLEEP,    /**< Sleep until the activation */
+    THRD_WAKE_SPIN      /**< Sleep until a short margin before the
+                         *   activation, then busy wait */
+} thrd_wake_t;
+
+/** Events recorded in the trace of a thread (see thrd_trace()) */
+typedef enum {
+    THRD_EVENT_RELEASE,     /**< Activation due */
+    THRD_EVENT_START,       /**< Callback started */
+    THRD_EVENT_FINISH,      /**< Callback finished, the argument is the
+                             *   CPU time it consumed (ns) */
+    THRD_EVENT_MISS,        /**< Deadline missed, the argument is the
+                             *   lateness (ns) */
+    THRD_EVENT_SKIP,        /**< Activations skipped, the argument is
+                             *   their number */
+    THRD_EVENT_LOCK,        /**< Lock acquired after waiting, the argument
+                             *   is the waiting time (ns) */
+    THRD_EVENT_XRUN,        /**< Sound card overrun */
+    THRD_EVENT_FAULT        /**< Page faults within the callback, the
+                             *   argument is their number */
+} thrd_event_type_t;
+
+/** Number of events kept by the trace of each thread (power of two). */
+#define THRD_TRACE_EVENTS   4096
+
+/** Stack touched before the first activation by the threads having the
+ * default stack size (bytes, see thrd_info_t::stack_size). */
+#define THRD_STACK_PREFAULT (64 * 1024)
+
+/** Fixed size record of the trace. */
+typedef struct {
+    uint64_t time;      /**< Monotonic time of the event (ns); */
+    uint32_t type;      /**< One of thrd_event_type_t; */
+    uint32_t arg;       /**< Argument, depending on the type. */
+} thrd_event_t;
+
 /** User definition for the thread.
  *
  * This is used as argument for the thrd_init function.
@@ -82,31 +141,145 @@ typedef struct {
     struct timespec period;  /**< Thread's period */
     struct timespec delay;   /**< Thread's startup delay */
 
+    /** Relative deadline. If zero the deadline equals the period. */
+    struct timespec deadline;
+
+    /** Execution budget for each period, used only by the
+     * THRD_POLICY_EDF policy. If zero the budget is measured during the
+     * first activations of the thread.
+     */
+    struct timespec runtime;
+
+    /** CPUs the thread is allowed to run on. If empty the thread can run
+     * on any CPU, unless the pool is partitioned (see
+     * thrd_set_partitioned()).
+     */
+    cpu_set_t cpus;
+
+    /** Overrun policy (THRD_OVERRUN_CATCHUP by default). */
+    thrd_overrun_t overrun;
+
+    /** Maximum number of late activations kept by THRD_OVERRUN_CATCHUP,
+     * the exceeding ones are skipped. If zero all of them are kept.
+     */
+    unsigned catchup;
+
+    /** Called by THRD_OVERRUN_DEGRADE after skipping activations, so that
+     * the thread can reduce its work. You may specify it as NULL.
+     */
+    thrd_overrun_cb_t on_overrun;
+
+    /** Wake up mode (THRD_WAKE_SLEEP by default). Busy waiting reduces
+     * the activation jitter, at the price of some CPU time.
+     */
+    thrd_wake_t wake;
+
+    /** Name of the thread in the trace (see thrd_trace_dump()). You may
+     * specify it as NULL.
+     */
+    const char *name;
+
+    /** Stack size of the thread (bytes). The whole stack is touched
+     * before the first activation, so that the callbacks never page
+     * fault on it. If zero the thread gets the default size of the
+     * system, and only THRD_STACK_PREFAULT bytes of it are touched.
+     */
+    size_t stack_size;
+
 } thrd_info_t;
 
+/** Sub-buckets for each power of two in thrd_hist_t, as bits. */
+#define THRD_HIST_SUB_BITS  4
+
+/** Number of buckets in thrd_hist_t. */
+#define THRD_HIST_BUCKETS   ((64 - THRD_HIST_SUB_BITS + 1) \
+                             << THRD_HIST_SUB_BITS)
+
+/** Log-bucketed histogram of durations.
+ *
+ * Values below 2^THRD_HIST_SUB_BITS are counted exactly. Above that, each
+ * power of two is split into 2^THRD_HIST_SUB_BITS linear buckets, so the
+ * relative error is bounded (about 6%) on the whole 64 bits range.
+ */
+typedef struct {
+    uint64_t count;                         /**< Number of samples; */
+    uint32_t buckets[THRD_HIST_BUCKETS];    /**< Samples per bucket. */
+} thrd_hist_t;
+
 /** Statistics about the realtime thread.
  *
  * Each thread is internally characterized by an instance of this
  * structures. A pointer for each thread is returned by the thrd_add()
  * function.
+ *
+ * The response time of each activation is the sum of its lateness, its
+ * execution time and its preemption time.
+ *
+ * While the pool is running the structure is updated by its thread:
+ * thrd_rtstats_snapshot() provides a consistent copy.
  */
 typedef struct {
+    uint32_t seq;               /**< Sequence counter, odd while the
+                                 *   statistics are being updated; */
     uint64_t response_times;    /**< Sum of response times (used to build
                                  *   average); */
+    uint64_t lateness_times;    /**< Sum of activation latenesses; */
+    uint64_t exec_times;        /**< Sum of execution times; */
+    uint64_t preempt_times;     /**< Sum of preemption times; */
     uint64_t n_executions;      /**< Number of executions; */
     uint64_t wcrt;              /**< Worst case response time; */
-    uint64_t dmiss_count;       /**< Number of deadline misses. */
+    uint64_t dmiss_count;       /**< Number of deadline misses; */
+    uint64_t skip_count;        /**< Number of skipped activations (see
+                                 *   thrd_info_t::overrun); */
+    uint64_t spin_time;         /**< Time spent busy waiting for the
+                                 *   activations (see thrd_info_t::wake,
+                                 *   ns); */
+    uint64_t counted;           /**< Activations measured by the hardware
+                                 *   counters (see thrd_set_counters()); */
+    uint64_t events[PERFCTR_EVENTS]; /**< Sum of the hardware counters
+                                 *   over the measured activations, indexed
+                                 *   by perfctr_event_t; */
+    uint64_t minor_faults;      /**< Minor page faults within the
+                                 *   callbacks; */
+    uint64_t major_faults;      /**< Major page faults within the
+                                 *   callbacks; */
+    uint64_t fault_count;       /**< Number of activations hit by page
+                                 *   faults; */
+    thrd_hist_t response;       /**< Response times (ns); */
+    thrd_hist_t lateness;       /**< Delay between the scheduled and the
+                                 *   actual activation (ns); */
+    thrd_hist_t execution;      /**< CPU time consumed by the activations
+                                 *   (ns); */
+    thrd_hist_t preemption;     /**< Time spent by the activations off the
+                                 *   CPU, preempted or blocked (ns). */
 } thrd_rtstats_t;
 
+/** Scheduling policies for the pool */
+typedef enum {
+    THRD_POLICY_RM,     /**< Rate Monotonic priorities on SCHED_FIFO */
+    THRD_POLICY_EDF,    /**< Earliest Deadline First on SCHED_DEADLINE */
+    THRD_POLICY_CYCLIC  /**< Cyclic executive, a single thread dispatches
+                         *   all the callbacks */
+} thrd_policy_t;
+
+/** Admission control modes */
+typedef enum {
+    THRD_ADMIT_OFF,     /**< No calibration, no test */
+    THRD_ADMIT_WARN,    /**< Warn about unschedulable task sets */
+    THRD_ADMIT_REJECT   /**< Refuse to start unschedulable task sets */
+} thrd_admission_t;
+
 /** Pool of real-time threads */
 typedef struct thrd_pool thrd_pool_t;
 
 /** Possible errors */
 typedef enum {
     THRD_ERR_LIBRARY  = 1 << 0,     /**< Library error */
-    THRD_ERR_CLOSED   = 1 << 1,     /**< Added thread on a running pool */
     THRD_ERR_NULLPER  = 1 << 2,     /**< Declared null period */
-    THRD_ERR_EMPTY    = 1 << 3      /**< No thread subscribed */
+    THRD_ERR_EMPTY    = 1 << 3,     /**< No thread subscribed */
+    THRD_ERR_AFFINITY = 1 << 4,     /**< Affinity not allowed by the
+                                     *   policy */
+    THRD_ERR_UNSCHED  = 1 << 5      /**< Task set not schedulable */
 } thrd_err_t;
 
 /** Initialize the pool.
@@ -120,29 +293,127 @@ thrd_pool_t * thrd_new (unsigned minprio);
 
 /** Destroy the pool
  *
- * This function is blocking: the pool will join all its threads before
- * freeing memory.
+ * This function is blocking: the remaining threads are required to
+ * terminate at their next activation, and the pool will join them
+ * before freeing memory.
  *
  * @param pool The pool to be freed.
  */
 void thrd_destroy (thrd_pool_t *pool);
 
 /** Add a new thread to the pool
+ *
+ * If the pool is already running the thread is started immediately: the
+ * Rate Monotonic priorities of the other threads get reassigned and,
+ * with admission control, the new task set is tested. When the call
+ * fails on a running pool, thrd_info_t::destroy has been called already:
+ * the caller must not release the context.
+ *
+ * With admission control the new thread runs thrd_info_t::init and then
+ * its callback 64 times back to back before the test, even if it gets
+ * refused afterwards. On a running pool, a callback acting on shared
+ * state (e.g. a graphic being shown) must tolerate this.
  *
  * @see thrd_info_t.
  *
  * @param pool The pool to be extended with a new thread;
  * @param new_thrd The specification for the new thread.
- * @return NULL if the pool has been already started, a statistical
- *              descriptor otherwise.
+ * @return NULL on error (see thrd_interr()), a statistical descriptor
+ *         otherwise.
  *
  * @warning The statistical descriptor is part of the pool internals: as
  *          such it must not be deallocated nor accesses after calling
- *          the thrd_destroy() function.
+ *          the thrd_destroy() or the thrd_remove() function.
  */
 const thrd_rtstats_t * thrd_add (thrd_pool_t *pool,
                                  const thrd_info_t * new_thrd);
 
+/** Remove a thread from the pool
+ *
+ * The thread terminates at its next activation, calling the
+ * thrd_info_t::destroy callback. This function waits for the termination,
+ * then reassigns the Rate Monotonic priorities of the remaining threads.
+ *
+ * @param pool The pool;
+ * @param stats The statistical descriptor returned by thrd_add().
+ * @retval 0 on success;
+ * @retval -1 if the thread doesn't belong to the pool.
+ */
+int thrd_remove (thrd_pool_t *pool, const thrd_rtstats_t *stats);
+
+/** Select the scheduling policy of the pool.
+ *
+ * The default policy is THRD_POLICY_RM. This function must be called
+ * before thrd_start().
+ *
+ * @param pool The pool;
+ * @param policy The scheduling policy.
+ */
+void thrd_set_policy (thrd_pool_t *pool, thrd_policy_t policy);
+
+/** Enable the partitioned scheduling of the pool.
+ *
+ * When enabled, thrd_start() pins each thread having an empty
+ * thrd_info_t::cpus on a single CPU. The placement is first-fit
+ * decreasing by utilization. With admission control (see
+ * thrd_set_admission()) the utilization is the calibrated one, and the
+ * threads are pinned after the calibration; otherwise it comes from
+ * thrd_info_t::runtime. This function must be called before
+ * thrd_start().
+ *
+ * @note Partitioning is not allowed by the THRD_POLICY_EDF policy, since
+ *       SCHED_DEADLINE requires threads to be allowed on every CPU, nor
+ *       by THRD_POLICY_CYCLIC, which runs on a single thread.
+ *
+ * @param pool The pool;
+ * @param enable Non-zero to enable partitioning, zero to disable it.
+ */
+void thrd_set_partitioned (thrd_pool_t *pool, int enable);
+
+/** Select the admission control mode of the pool.
+ *
+ * Unless the mode is THRD_ADMIT_OFF (default), thrd_start() runs each
+ * callback several times to estimate its worst case execution time, then
+ * applies a schedulability test to the task set before the startup
+ * delays begin. This function must be called before thrd_start().
+ *
+ * @param pool The pool;
+ * @param mode The admission control mode.
+ */
+void thrd_set_admission (thrd_pool_t *pool, thrd_admission_t mode);
+
+/** Enable the hardware counters.
+ *
+ * When enabled, each thread reads the hardware counters (see @ref
+ * PerfCtr) before and after each call of thrd_info_t::callback, and
+ * accumulates the difference in thrd_rtstats_t::events. Threads unable
+ * to open the counters run without them. This function must be called
+ * before thrd_start().
+ *
+ * @param pool The pool;
+ * @param enable Non-zero to enable the counters, zero to disable them.
+ */
+void thrd_set_counters (thrd_pool_t *pool, int enable);
+
+/** Enable the watchdog.
+ *
+ * A monitor thread checks that each thread keeps entering and leaving
+ * thrd_info_t::callback. When a thread doesn't for the given number of
+ * periods (and at least 100 ms), the monitor writes on the standard
+ * error the state of the thread, its recent events (see thrd_trace())
+ * and, if it is stuck in the callback, its stack. The thread is left
+ * alone: a stuck callback may hold locks shared with the other threads.
+ *
+ * The stack is written by the stalled thread itself, on SIGRTMIN: the
+ * threads of the pool must not block it. This function must be called
+ * before thrd_start().
+ *
+ * @param pool The pool;
+ * @param periods The allowed delay, in periods of each thread. Zero
+ *                disables the watchdog.
+ */
+void thrd_set_watchdog (thrd_pool_t *pool, unsigned periods);
+
 /** Start the threads
  *
  * This call enables the thread. Before calling it you must add at least
@@ -152,11 +423,135 @@ const thrd_rtstats_t * thrd_add (thrd_pool_t *pool,
  * @see thrd_interr
  * @see thrd_strerr
  *
+ * With THRD_ADMIT_REJECT admission control, an unschedulable task set
+ * results in a THRD_ERR_UNSCHED error, and the threads terminate without
+ * being activated.
+ *
  * @param pool The pool to be started;
  * @return 0 on success, not 0 on error.
  */
 int thrd_start (thrd_pool_t *pool);
 
+/** Execution time of the next activation of a simulated thread.
+ *
+ * @param context The thrd_info_t::context of the thread.
+ * @return The CPU time required by the activation (ns).
+ */
+typedef uint64_t (* thrd_exec_cb_t) (void *context);
+
+/** Parameters of a simulation (see thrd_simulate()). */
+typedef struct {
+    unsigned cpus;          /**< CPUs of the simulated machine; */
+    struct timespec length; /**< Simulated time; */
+    thrd_exec_cb_t exec;    /**< Execution times of the activations. */
+} thrd_sim_t;
+
+/** Simulate the pool instead of starting it.
+ *
+ * The threads are placed and prioritized as thrd_start() would do, under
+ * the policy and the partitioning of the pool, then their activations are
+ * simulated on a machine having the given number of CPUs, with the
+ * execution times given by the thrd_sim_t::exec callback. No thread is
+ * created and no callback of thrd_info_t is called. The outcome is in
+ * the statistics returned by thrd_add(), which are filled as if the
+ * threads had been running (the time spent busy waiting, the page faults
+ * and the hardware counters stay at zero).
+ *
+ * The thrd_info_t::runtime of each thread is taken as its worst case
+ * execution time: the partitioning uses it, and the schedulability test
+ * of the admission control is applied on it. Its outcome is logged, but
+ * the simulation runs anyway.
+ *
+ * @see @ref Thrd_Simulation
+ *
+ * @param pool The pool, which must not have been started;
+ * @param sim The parameters of the simulation.
+ * @return 0 on success, 1 if the simulation ran but the schedulability
+ *         test refused the task set, -1 on error (see thrd_interr()).
+ */
+int thrd_simulate (thrd_pool_t *pool, const thrd_sim_t *sim);
+
+/** Change the period of the calling thread.
+ *
+ * This function must be called from within the callbacks of a thread of
+ * the pool. The new period applies from the next activation.
+ *
+ * @note Under the THRD_POLICY_RM policy the priorities of all the threads
+ *       are reassigned on the new periods. Under the THRD_POLICY_EDF
+ *       policy the reservation is updated accordingly, while
+ *       THRD_POLICY_CYCLIC rebuilds its schedule table.
+ *
+ * @param period The new period (must not be zero).
+ */
+void thrd_set_period (const struct timespec *period);
+
+/** Record an event in the trace of the calling thread.
+ *
+ * Each thread of the pool keeps its last THRD_TRACE_EVENTS events in a
+ * ring. Activations, deadline misses and skipped activations are
+ * recorded by the pool itself. The call is lock free and constant time,
+ * and it does nothing when called from a thread not belonging to a pool.
+ *
+ * @param type The event;
+ * @param arg The argument of the event, saturated to 32 bits.
+ */
+void thrd_trace (thrd_event_type_t type, uint64_t arg);
+
+/** Write the traces of the pool.
+ *
+ * The output is in the Trace Event Format (JSON) of chrome://tracing,
+ * which can be opened also by Perfetto. Each thread of the pool is a
+ * track. The threads keep running meanwhile: the events being
+ * overwritten during the copy are discarded.
+ *
+ * @param pool The pool;
+ * @param path The output file.
+ * @retval 0 on success;
+ * @retval -1 on failure (errno is set).
+ */
+int thrd_trace_dump (thrd_pool_t *pool, const char *path);
+
+/** Get a consistent copy of the statistics of a thread.
+ *
+ * The statistics are protected by a sequence lock: the thread never
+ * waits for the readers, while this function retries the copy until it
+ * has not been overlapped by an update. It can be called at any time,
+ * from any thread.
+ *
+ * @param stats The statistics, as returned by thrd_add();
+ * @param copy The structure to be filled.
+ */
+void thrd_rtstats_snapshot (const thrd_rtstats_t *stats,
+                            thrd_rtstats_t *copy);
+
+/** Add a sample to an histogram.
+ *
+ * This runs in constant time and doesn't allocate memory.
+ *
+ * @param hist The histogram;
+ * @param value The sample.
+ */
+void thrd_hist_add (thrd_hist_t *hist, uint64_t value);
+
+/** Get a percentile from an histogram.
+ *
+ * @param hist The histogram;
+ * @param perc The required percentile, between 0 and 100.
+ * @return The upper bound of the bucket containing the percentile, 0 if
+ *         the histogram is empty.
+ */
+uint64_t thrd_hist_percentile (const thrd_hist_t *hist, double perc);
+
+/** Count the samples of an histogram up to a value.
+ *
+ * @param hist The histogram;
+ * @param value The upper bound.
+ * @return The number of samples in the buckets up to the one containing
+ *         the value. Samples sharing that bucket are counted even if
+ *         larger than the value, within the resolution of the histogram.
+ */
+uint64_t thrd_hist_cumulative (const thrd_hist_t *hist, uint64_t value);
+
 /** Get information on the pending error, if any.
  *
  * After this call the internal error-keeping structure of the pool gets
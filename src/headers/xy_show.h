@@ -0,0 +1,65 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/** @file xy_show.h */
+/** @addtogroup BizXY */
+/*@{*/
+
+#ifndef __defined_headers_xythread_h
+#define __defined_headers_xythread_h
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "headers/thrd.h"
+#include "headers/sampthread.h"
+#include "headers/plotting.h"
+#include "alsagw.h"
+
+/** @brief Subscribe a XY (goniometer) thread to the given pool.
+ *
+ * The thread plots channel 0 against channel 1 as a density plot, and
+ * keeps a strip chart of the correlation between the two channels.
+ *
+ * @param handle Thea address of a pointer where the plotting thread
+ *               handle address will be stored;
+ * @param pool The pool to which the sampler will be subscribed;
+ * @param sampth The handle of the sampler thread;
+ * @param xy The graphic where the XY plot will be shown. It must be in
+ *           persistence mode (see plot_graphic_persist());
+ * @param corr The graphic where the correlation will be shown. Its plot
+ *             must accept XY_CORR_HISTORY values on the x axis.
+ *
+ * @return This function just adds something to pool, therefore you may
+ *         interpret its return value as if it were thrd_add().
+ */
+const thrd_rtstats_t * xyth_subscribe (genth_t **handle,
+                                       thrd_pool_t *pool,
+                                       genth_t *sampth,
+                                       plotgr_t *xy,
+                                       plotgr_t *corr);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif // __defined_headers_xythread_h
+
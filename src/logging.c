@@ -0,0 +1,277 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dacav/dacav.h>
+
+#include "headers/logging.h"
+
+/* A preformatted message */
+struct record {
+    FILE *stream;
+    char text[LOGGING_RECORD_SIZE];
+};
+
+/* Single producer, single consumer ring: the owner thread moves the head,
+ * the writer thread moves the tail. */
+struct ring {
+    uint32_t head;          /* Next record to be written; */
+    uint32_t tail;          /* Next record to be read; */
+    uint64_t dropped;       /* Messages not fitting the ring; */
+    uint64_t reported;      /* Dropped messages already reported; */
+    int closed;             /* The owner terminated; */
+    pthread_t owner;        /* Owner thread; */
+    struct record records[LOGGING_RING_RECORDS];
+};
+
+static struct {
+    int running;            /* The writer is running; */
+    int stop;               /* Termination required; */
+    pthread_t handler;      /* The writer thread; */
+    pthread_key_t key;      /* Releases the rings of terminated threads; */
+    pthread_mutex_t lock;   /* Protects the list of new rings; */
+    dlist_t *pending;       /* New rings, not yet seen by the writer; */
+    dlist_t *rings;         /* Rings to be drained (writer only); */
+    uint64_t dropped;       /* Total of dropped messages. */
+} logger = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/* Ring of the calling thread, NULL if it writes directly. */
+static __thread struct ring *ring;
+
+/* Destructor of the key, called when the owner terminates. The writer
+ * frees the ring once it is drained. */
+static
+void close_ring (void *arg)
+{
+    struct ring *r = (struct ring *) arg;
+
+    __atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+}
+
+/* Formats a message in the ring of the caller, or drops it */
+static
+void enqueue (struct ring *r, FILE *stream, const char *fmt, va_list ap)
+{
+    uint32_t head = r->head;
+    struct record *rec;
+    int len;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)
+            == LOGGING_RING_RECORDS) {
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&logger.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &r->records[head & (LOGGING_RING_RECORDS - 1)];
+    rec->stream = stream;
+    len = vsnprintf(rec->text, LOGGING_RECORD_SIZE, fmt, ap);
+    if (len >= LOGGING_RECORD_SIZE) {
+        /* Truncated, but still a line */
+        rec->text[LOGGING_RECORD_SIZE - 2] = '\n';
+    }
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Writes the messages of a ring */
+static
+void drain_ring (struct ring *r)
+{
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = r->tail;
+    uint64_t dropped;
+
+    while (tail != head) {
+        const struct record *rec;
+
+        rec = &r->records[tail & (LOGGING_RING_RECORDS - 1)];
+        fputs(rec->text, rec->stream);
+        tail ++;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    if (dropped != r->reported) {
+        ERR_FMT("%llu log messages of thread %08X dropped",
+                (unsigned long long) (dropped - r->reported),
+                (unsigned) r->owner);
+        r->reported = dropped;
+    }
+}
+
+/* Writes the messages of all the rings, then frees the ones of the
+ * terminated threads. The lock, shared with the real time threads by
+ * logging_attach(), is held only to take the new rings: the writing
+ * happens without it. */
+static
+void drain (void)
+{
+    dlist_t *fresh;
+    struct ring *r;
+    diter_t *i;
+
+    pthread_mutex_lock(&logger.lock);
+    fresh = logger.pending;
+    logger.pending = dlist_new();
+    pthread_mutex_unlock(&logger.lock);
+
+    while (!dlist_empty(fresh)) {
+        fresh = dlist_pop(fresh, (void **) &r);
+        logger.rings = dlist_append(logger.rings, (void *) r);
+    }
+    dlist_free(fresh, NULL);
+
+    i = dlist_iter_new(&logger.rings);
+    while (diter_hasnext(i)) {
+        int closed;
+
+        r = (struct ring *) diter_next(i);
+        closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+
+        drain_ring(r);
+        if (closed) {
+            diter_remove(i, free);
+        }
+    }
+    dlist_iter_free(i);
+
+    fflush(stdout);
+    fflush(stderr);
+}
+
+/* The writer: the stop flag is read before draining, so that the last
+ * messages are written anyway. */
+static
+void * writer_routine (void *arg)
+{
+    struct timespec period = {
+        .tv_sec = LOGGING_PERIOD_mSEC / 1000,
+        .tv_nsec = (LOGGING_PERIOD_mSEC % 1000) * 1000000
+    };
+    int stop;
+
+    do {
+        stop = __atomic_load_n(&logger.stop, __ATOMIC_ACQUIRE);
+        drain();
+        if (!stop) {
+            nanosleep(&period, NULL);
+        }
+    } while (!stop);
+
+    return NULL;
+}
+
+int logging_start (void)
+{
+    sigset_t all, old;
+    int err;
+
+    assert(!logger.running);
+    if ((err = pthread_key_create(&logger.key, close_ring)) != 0) {
+        errno = err;
+        return -1;
+    }
+    logger.rings = dlist_new();
+    logger.pending = dlist_new();
+    logger.stop = 0;
+
+    /* Default attributes: the writer doesn't run in real time. Signals
+     * are left to the other threads. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&logger.handler, NULL, writer_routine, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        pthread_key_delete(logger.key);
+        dlist_free(logger.rings, NULL);
+        dlist_free(logger.pending, NULL);
+        errno = err;
+        return -1;
+    }
+
+    __atomic_store_n(&logger.running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void logging_stop (void)
+{
+    if (!logger.running) {
+        return;
+    }
+
+    __atomic_store_n(&logger.running, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&logger.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(logger.handler, NULL);
+
+    /* The rings of threads still alive, if any, are left to them */
+    dlist_free(logger.rings, NULL);
+    logger.rings = dlist_new();
+    pthread_mutex_lock(&logger.lock);
+    dlist_free(logger.pending, NULL);
+    logger.pending = dlist_new();
+    pthread_mutex_unlock(&logger.lock);
+}
+
+void logging_attach (void)
+{
+    struct ring *r;
+
+    if (ring || !__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    r = (struct ring *) calloc(1, sizeof(struct ring));
+    assert(r);
+    r->owner = pthread_self();
+
+    pthread_mutex_lock(&logger.lock);
+    logger.pending = dlist_append(logger.pending, (void *) r);
+    pthread_mutex_unlock(&logger.lock);
+
+    pthread_setspecific(logger.key, (void *) r);
+    ring = r;
+}
+
+void logging_print (FILE *stream, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    if (ring && __atomic_load_n(&logger.running, __ATOMIC_ACQUIRE)) {
+        enqueue(ring, stream, fmt, ap);
+    } else {
+        vfprintf(stream, fmt, ap);
+    }
+    va_end(ap);
+}
+
+uint64_t logging_dropped (void)
+{
+    return __atomic_load_n(&logger.dropped, __ATOMIC_RELAXED);
+}
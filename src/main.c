@@ -26,6 +26,7 @@
 #include <sched.h>
 #include <assert.h>
 #include <signal.h>
+#include <pthread.h>
 #include <errno.h>
 #include <string.h>
 
@@ -43,7 +44,13 @@
 #include "headers/plotthread.h"
 #include "headers/signal_show.h"
 #include "headers/spectrum_show.h"
+#include "headers/xy_show.h"
 #include "headers/options.h"
+#include "headers/constants.h"
+#include "headers/rtutils.h"
+#include "headers/rtlock.h"
+#include "headers/metrics.h"
+#include "headers/allocguard.h"
 
 /* Information allocated for each thread, contains statistical information
  * about the real-time thread. */
@@ -52,13 +59,25 @@ struct rtstat_show {
     const char * name;
 };
 
+/* Analyzers which can be turned on and off at run time. */
+struct analyzer {
+    const char *name;
+    genth_t *handle;            /* NULL while the analyzer is off; */
+    struct rtstat_show *stats;  /* Entry of main_data::stats; */
+    plot_t *plot;               /* Created at the first start; */
+    plotgr_t *graphics[4];
+};
+
 struct main_data {
     opts_t *opts;
     thrd_pool_t *pool;
     alsagw_t *sampler;
+    genth_t *sampth;
+    genth_t *plotth;
 
-    plot_t *spectrum;
-    plot_t *signal;
+    plotsrv_t *plots;
+    struct analyzer spectrum;
+    struct analyzer signal;
 
     /* This list is used as stack: it will contain all threads handlers in
      * inverse-order of deallocation, thus by pop-ing elements I obtain
@@ -68,6 +87,12 @@ struct main_data {
     /* This list contains instances of the rtstat_show structure. */
     dlist_t *stats;
 
+    /* Output of the traces, NULL if not required. */
+    const char *trace;
+
+    /* Metrics server, NULL if not required. */
+    metrics_t *metrics;
+
     #ifndef RT_DISABLE
     bool memlock;
     #endif
@@ -79,6 +104,129 @@ void drop_statistics (struct main_data *data)
     dlist_free(data->stats, free);
 }
 
+static
+void show_percentiles (const char *what, const thrd_hist_t *hist)
+{
+    LOG_FMT("\t\t%s (ns):", what);
+    LOG_FMT("\t\t\tp50 %10llu  p90 %10llu  p99 %10llu  p99.9 %10llu",
+            (unsigned long long) thrd_hist_percentile(hist, 50),
+            (unsigned long long) thrd_hist_percentile(hist, 90),
+            (unsigned long long) thrd_hist_percentile(hist, 99),
+            (unsigned long long) thrd_hist_percentile(hist, 99.9));
+}
+
+/* Hardware counters, averaged on the activations which were counted */
+static
+void show_counters (const thrd_rtstats_t *rts)
+{
+    LOG_FMT("\t\tAvg cycles:                     %10llu",
+            (unsigned long long) (rts->events[PERFCTR_CYCLES] /
+                                  rts->counted));
+    LOG_FMT("\t\tAvg instructions:               %10llu",
+            (unsigned long long) (rts->events[PERFCTR_INSTRUCTIONS] /
+                                  rts->counted));
+    if (rts->events[PERFCTR_CYCLES] > 0) {
+        LOG_FMT("\t\tInstructions per cycle:         %10.2f",
+                (double) rts->events[PERFCTR_INSTRUCTIONS] /
+                         rts->events[PERFCTR_CYCLES]);
+    }
+    LOG_FMT("\t\tAvg cache misses:               %10llu",
+            (unsigned long long) (rts->events[PERFCTR_CACHE_MISSES] /
+                                  rts->counted));
+    LOG_FMT("\t\tAvg branch misses:              %10llu",
+            (unsigned long long) (rts->events[PERFCTR_BRANCH_MISSES] /
+                                  rts->counted));
+}
+
+static
+void print_statistics (const struct rtstat_show *s)
+{
+    thrd_rtstats_t rts;
+
+    thrd_rtstats_snapshot(s->stats, &rts);
+
+    LOG_FMT("\tStatistics for thread '%s':", s->name);
+    if (rts.n_executions == 0) {
+        LOG_MSG("\t\tNot activated yet");
+        return;
+    }
+    LOG_FMT("\t\tAvg response time (ns):         %10llu",
+            (unsigned long long) (rts.response_times /
+                                 rts.n_executions));
+    LOG_FMT("\t\tWorst case response time (ns):  %10llu",
+            (unsigned long long) rts.wcrt);
+    LOG_FMT("\t\tNumber of executions:           %10llu",
+            (unsigned long long) rts.n_executions);
+    LOG_FMT("\t\tNumber of deadline misses:      %10llu", 
+            (unsigned long long) rts.dmiss_count);
+    LOG_FMT("\t\tNumber of skipped activations:  %10llu",
+            (unsigned long long) rts.skip_count);
+    LOG_FMT("\t\tAvg busy waiting (ns):          %10llu",
+            (unsigned long long) (rts.spin_time / rts.n_executions));
+    LOG_FMT("\t\tDeadline miss ratio (%%)         %10G",
+            100 * (double)((double)(rts.dmiss_count) /
+                                    rts.n_executions));
+    LOG_FMT("\t\tAvg activation lateness (ns):   %10llu",
+            (unsigned long long) (rts.lateness_times / rts.n_executions));
+    LOG_FMT("\t\tAvg execution time (ns):        %10llu",
+            (unsigned long long) (rts.exec_times / rts.n_executions));
+    LOG_FMT("\t\tAvg preemption time (ns):       %10llu",
+            (unsigned long long) (rts.preempt_times / rts.n_executions));
+    LOG_FMT("\t\tMinor page faults:              %10llu",
+            (unsigned long long) rts.minor_faults);
+    LOG_FMT("\t\tMajor page faults:              %10llu",
+            (unsigned long long) rts.major_faults);
+    LOG_FMT("\t\tActivations hit by faults:      %10llu",
+            (unsigned long long) rts.fault_count);
+    show_percentiles("Response time", &rts.response);
+    show_percentiles("Activation lateness", &rts.lateness);
+    show_percentiles("Execution time", &rts.execution);
+    show_percentiles("Preemption time", &rts.preemption);
+    if (rts.counted > 0) {
+        show_counters(&rts);
+    }
+    LOG_MSG("");
+}
+
+/* Age of the data when it reaches the screen */
+static
+void print_data_age (const plotsrv_t *plots)
+{
+    thrd_hist_t age;
+    uint64_t sum;
+
+    if (plots == NULL) {
+        return;
+    }
+    sum = plotsrv_get_age(plots, &age);
+
+    LOG_MSG("\tStatistics for the rendering:");
+    if (age.count == 0) {
+        LOG_MSG("\t\tNothing shown yet");
+        return;
+    }
+    LOG_FMT("\t\tAvg data age (ns):              %10llu",
+            (unsigned long long) (sum / age.count));
+    show_percentiles("Data age", &age);
+    LOG_MSG("");
+}
+
+/* Periodic report, while the threads are running */
+static
+void report_statistics (struct main_data *data)
+{
+    diter_t *iter;
+
+    LOG_MSG("Statistics report:");
+    iter = dlist_iter_new(&data->stats);
+    while (diter_hasnext(iter)) {
+        print_statistics((const struct rtstat_show *) diter_next(iter));
+    }
+    dlist_iter_free(iter);
+    print_data_age(data->plots);
+    rtlock_report();
+}
+
 static
 void show_statistics (struct main_data *data)
 {
@@ -86,25 +234,343 @@ void show_statistics (struct main_data *data)
 
     iter = dlist_iter_new(&data->stats);
     while (diter_hasnext(iter)) {
-        struct rtstat_show *s = diter_next(iter);
-        const thrd_rtstats_t * rts = s->stats;
-
-        LOG_FMT("\tStatistics for thread '%s':", s->name);
-        LOG_FMT("\t\tAvg response time (ns):         %10llu",
-                (unsigned long long) (rts->response_times /
-                                     rts->n_executions));
-        LOG_FMT("\t\tWorst case response time (ns):  %10llu",
-                (unsigned long long) rts->wcrt);
-        LOG_FMT("\t\tNumber of executions:           %10llu",
-                (unsigned long long) rts->n_executions);
-        LOG_FMT("\t\tNumber of deadline misses:      %10llu", 
-                (unsigned long long) rts->dmiss_count);
-        LOG_FMT("\t\tDeadline miss ratio (%%)         %10G\n",
-                100 * (double)((double)(rts->dmiss_count) /
-                                        rts->n_executions));
+        print_statistics((const struct rtstat_show *) diter_next(iter));
         diter_remove(iter, free);
     }
     dlist_iter_free(iter);
+    print_data_age(data->plots);
+    rtlock_report();
+}
+
+static
+struct rtstat_show * rtstat_show_new (const thrd_rtstats_t *stats,
+                                      const char *name)
+{   
+    struct rtstat_show *ret;
+    ret = (struct rtstat_show *) malloc(sizeof(struct rtstat_show));
+    assert(ret);
+    ret->stats = stats;
+    ret->name = name;
+
+    return ret;
+}
+
+/* Keeps the statistics of a thread for the reports and for the metrics
+ * server. */
+static
+struct rtstat_show * track_statistics (struct main_data *data,
+                                       const thrd_rtstats_t *rtstats,
+                                       const char *name)
+{
+    struct rtstat_show *s;
+
+    s = rtstat_show_new(rtstats, name);
+    data->stats = dlist_push(data->stats, s);
+    if (data->metrics) {
+        metrics_add_task(data->metrics, name, rtstats);
+    }
+    return s;
+}
+
+/* Bookkeeping for a just subscribed analyzer */
+static
+void analyzer_started (struct main_data *data, struct analyzer *an,
+                       const thrd_rtstats_t *rtstats)
+{
+    an->stats = track_statistics(data, rtstats, an->name);
+    data->threads = dlist_push(data->threads, an->handle);
+    plot_show(an->plot, 1);
+}
+
+static
+int start_spectrum (struct main_data *data)
+{
+    struct analyzer *an = &data->spectrum;
+    specth_graphics_t spec_graphs;
+    const thrd_rtstats_t *rtstats;
+    int i;
+
+    if (an->plot == NULL) {
+        an->plot = plot_new(data->plots, 4, sampth_get_size(data->sampth));
+        for (i = 0; i < 4; i ++) {
+            an->graphics[i] = plot_new_graphic(an->plot);
+        }
+    }
+    spec_graphs.r0 = an->graphics[0];
+    spec_graphs.i0 = an->graphics[1];
+    spec_graphs.r1 = an->graphics[2];
+    spec_graphs.i1 = an->graphics[3];
+
+    rtstats = specth_subscribe(&an->handle, data->pool, data->sampth,
+                               &spec_graphs);
+    if (rtstats == NULL) {
+        ERR_FMT("Unable to start Spectrum Analizer: %s",
+                thrd_strerr(data->pool, thrd_interr(data->pool)));
+        return -1;
+    }
+    analyzer_started(data, an, rtstats);
+    return 0;
+}
+
+static
+int start_signal (struct main_data *data)
+{
+    struct analyzer *an = &data->signal;
+    const thrd_rtstats_t *rtstats;
+
+    if (an->plot == NULL) {
+        an->plot = plot_new(data->plots, 2, sampth_get_size(data->sampth));
+        an->graphics[0] = plot_new_graphic(an->plot);
+        an->graphics[1] = plot_new_graphic(an->plot);
+        if (opts_phosphor_enabled(data->opts)) {
+            if (plot_graphic_persist(an->graphics[0], PLOT_PHOSPHOR_DECAY) ||
+                    plot_graphic_persist(an->graphics[1],
+                                         PLOT_PHOSPHOR_DECAY)) {
+                ERR_MSG("Unable to allocate the phosphor");
+                return -1;
+            }
+        }
+    }
+
+    rtstats = signth_subscribe(&an->handle, data->pool, data->sampth,
+                               an->graphics[0], an->graphics[1]);
+    if (rtstats == NULL) {
+        ERR_FMT("Unable to start Signal Analyzer: %s",
+                thrd_strerr(data->pool, thrd_interr(data->pool)));
+        return -1;
+    }
+    analyzer_started(data, an, rtstats);
+    return 0;
+}
+
+/* Removes an analyzer from the running pool. The sampler keeps running,
+ * so its buffer is not lost. */
+static
+void stop_analyzer (struct main_data *data, struct analyzer *an)
+{
+    diter_t *iter;
+
+    if (data->metrics) {
+        metrics_remove_task(data->metrics, an->stats->stats);
+    }
+
+    iter = dlist_iter_new(&data->threads);
+    while (diter_hasnext(iter)) {
+        if (diter_next(iter) == an->handle) {
+            diter_remove(iter, NULL);
+            break;
+        }
+    }
+    dlist_iter_free(iter);
+
+    iter = dlist_iter_new(&data->stats);
+    while (diter_hasnext(iter)) {
+        if (diter_next(iter) == an->stats) {
+            diter_remove(iter, free);
+            break;
+        }
+    }
+    dlist_iter_free(iter);
+
+    genth_sendkill(an->handle);
+    an->handle = NULL;
+    an->stats = NULL;
+    plot_show(an->plot, 0);
+}
+
+static
+void toggle_analyzer (struct main_data *data, struct analyzer *an,
+                      int (* start) (struct main_data *))
+{
+    if (an->handle) {
+        stop_analyzer(data, an);
+        LOG_FMT("'%s' turned off", an->name);
+    } else if (start(data) == 0) {
+        LOG_FMT("'%s' turned on", an->name);
+    }
+}
+
+/* Readers for the metrics server */
+
+static
+double capture_frames (void *context)
+{
+    alsagw_stats_t stats;
+
+    alsagw_get_stats((alsagw_t *) context, &stats);
+    return stats.frames;
+}
+
+static
+double capture_xruns (void *context)
+{
+    alsagw_stats_t stats;
+
+    alsagw_get_stats((alsagw_t *) context, &stats);
+    return stats.xruns;
+}
+
+static
+double capture_backlog (void *context)
+{
+    alsagw_stats_t stats;
+
+    alsagw_get_stats((alsagw_t *) context, &stats);
+    return stats.backlog;
+}
+
+static
+double capture_drift (void *context)
+{
+    alsagw_stats_t stats;
+
+    alsagw_get_stats((alsagw_t *) context, &stats);
+    return alsagw_drift(&stats, alsagw_get_rate((alsagw_t *) context));
+}
+
+static
+double render_frames (void *context)
+{
+    return plotsrv_get_frames((plotsrv_t *) context);
+}
+
+static
+uint64_t render_age (void *context, thrd_hist_t *age)
+{
+    return plotsrv_get_age((plotsrv_t *) context, age);
+}
+
+static
+double render_period (void *context)
+{
+    return plotth_get_period((genth_t *) context) / 1e9;
+}
+
+static
+double log_dropped (void *context)
+{
+    return logging_dropped();
+}
+
+static
+void expose_values (struct main_data *data)
+{
+    metrics_t *m = data->metrics;
+
+    metrics_add_value(m, "soto_capture_frames_total",
+                      "Frames read from the sound card.", METRICS_COUNTER,
+                      capture_frames, data->sampler);
+    metrics_add_value(m, "soto_capture_xruns_total",
+                      "Overruns of the capture buffer.", METRICS_COUNTER,
+                      capture_xruns, data->sampler);
+    metrics_add_value(m, "soto_capture_backlog_frames",
+                      "Frames left in the capture buffer after a read.",
+                      METRICS_GAUGE, capture_backlog, data->sampler);
+    metrics_add_value(m, "soto_capture_drift_ppm",
+                      "Drift of the sound card clock from the system one.",
+                      METRICS_GAUGE, capture_drift, data->sampler);
+    metrics_add_value(m, "soto_render_frames_total",
+                      "Windows redrawn.", METRICS_COUNTER,
+                      render_frames, data->plots);
+    metrics_add_value(m, "soto_render_period_seconds",
+                      "Period chosen by the frame pacing.", METRICS_GAUGE,
+                      render_period, data->plotth);
+    metrics_add_histogram(m, "soto_render_data_age_seconds",
+                          "Age of the captured data when shown.",
+                          render_age, data->plots);
+    metrics_add_value(m, "soto_log_dropped_total",
+                      "Log messages dropped because of a full ring.",
+                      METRICS_COUNTER, log_dropped, NULL);
+}
+
+static
+unsigned elapsed_seconds (const struct timespec *start)
+{
+    struct timespec now;
+
+    rtutils_get_now(&now);
+    return (unsigned) ((rtutils_time2ns(&now) - rtutils_time2ns(start)) /
+                       1000000000ULL);
+}
+
+static
+void dump_trace (struct main_data *data)
+{
+    if (data->trace == NULL) {
+        return;
+    }
+    if (thrd_trace_dump(data->pool, data->trace)) {
+        ERR_FMT("Unable to write the trace on '%s': %s", data->trace,
+                strerror(errno));
+    } else {
+        LOG_FMT("Trace written on '%s'", data->trace);
+    }
+}
+
+/* Signals consumed by run(). SIGHUP is among them only when there is a
+ * trace to dump, otherwise it keeps terminating the program. */
+static
+void run_signals (sigset_t *set, const char *trace)
+{
+    sigemptyset(set);
+    sigaddset(set, SIGUSR1);
+    sigaddset(set, SIGUSR2);
+    if (trace != NULL) {
+        sigaddset(set, SIGHUP);
+    }
+}
+
+/* Waits for the given time (forever if zero), reporting the statistics
+ * every interval seconds (never if zero). SIGUSR1 and SIGUSR2, blocked
+ * since the beginning, toggle respectively the Spectrum and the Signal
+ * analyzers, while SIGHUP dumps the traces. */
+static
+void run (struct main_data *data, unsigned run_for, unsigned interval)
+{
+    struct timespec start, timeout;
+    unsigned elapsed, next_report, step;
+    sigset_t toggles;
+    int sig;
+
+    run_signals(&toggles, data->trace);
+
+    rtutils_get_now(&start);
+    next_report = interval;
+    for (;;) {
+        elapsed = elapsed_seconds(&start);
+        if (run_for && elapsed >= run_for) {
+            return;
+        }
+        if (interval && elapsed >= next_report) {
+            report_statistics(data);
+            next_report += interval;
+            continue;
+        }
+
+        step = 0;
+        if (run_for) {
+            step = run_for - elapsed;
+        }
+        if (interval && (step == 0 || next_report - elapsed < step)) {
+            step = next_report - elapsed;
+        }
+
+        if (step) {
+            timeout.tv_sec = step;
+            timeout.tv_nsec = 0;
+            sig = sigtimedwait(&toggles, NULL, &timeout);
+        } else {
+            sig = sigwaitinfo(&toggles, NULL);
+        }
+
+        if (sig == SIGUSR1) {
+            toggle_analyzer(data, &data->spectrum, start_spectrum);
+        } else if (sig == SIGUSR2) {
+            toggle_analyzer(data, &data->signal, start_signal);
+        } else if (sig == SIGHUP) {
+            dump_trace(data);
+        }
+    }
 }
 
 static
@@ -116,6 +582,17 @@ void exit_handler (int xval, void *context)
                                "success" : "failure");
 
     if (data->opts) opts_destroy(data->opts);
+    if (data->metrics) metrics_destroy(data->metrics);
+
+    /* Statistics and traces must be consumed before killing: the storage
+     * is owned by the threads. */
+    if (data->pool) dump_trace(data);
+    if (xval == EXIT_SUCCESS) {
+        LOG_MSG("EXECUTION STATISTICS");
+        show_statistics(data);
+    } else {
+        drop_statistics(data);
+    }
 
     LOG_MSG("Sending kill to all threads...");
     while (!dlist_empty(data->threads)) {
@@ -126,25 +603,18 @@ void exit_handler (int xval, void *context)
     }
     dlist_free(data->threads, NULL);
 
-    if (xval == EXIT_SUCCESS) {
-        LOG_MSG("EXECUTION STATISTICS");
-        show_statistics(data);
-    } else {
-        drop_statistics(data);
-    }
-
-    LOG_MSG("Waiting until they're dead (WARNING: if you just closed");
-    LOG_MSG("the window, you've better to kill the program explicitly).");
+    LOG_MSG("Waiting until they're dead...");
     if (data->pool) thrd_destroy(data->pool);
     if (data->sampler) alsagw_destroy(data->sampler);
-    if (data->spectrum) plot_destroy(data->spectrum);
-    if (data->signal) plot_destroy(data->signal);
+    if (data->plots) plotsrv_destroy(data->plots);
 
     #ifndef RT_DISABLE
         if (data->memlock) munlockall();
     #endif
 
+    allocguard_report();
     LOG_MSG("Goodbye");
+    logging_stop();
 }
 
 static
@@ -153,26 +623,15 @@ void sigterm_handler (int sig)
     exit(EXIT_FAILURE);
 }
 
-static
-struct rtstat_show * rtstat_show_new (const thrd_rtstats_t *stats,
-                                      const char *name)
-{   
-    struct rtstat_show *ret;
-    ret = (struct rtstat_show *) malloc(sizeof(struct rtstat_show));
-    assert(ret);
-    ret->stats = stats;
-    ret->name = name;
-
-    return ret;
-}
-
 int main (int argc, char **argv)
 {
     struct main_data data;
-    genth_t *sampth;
+    const char *metrics;
     const thrd_rtstats_t * rtstats;
+    plotth_pacing_t pacing;
+    unsigned min, max;
+    sigset_t toggles;
     int err;
-    unsigned run_for;
 
     signal(SIGINT, sigterm_handler);
     signal(SIGTERM, sigterm_handler);
@@ -180,14 +639,74 @@ int main (int argc, char **argv)
     memset(&data, 0, sizeof(struct main_data));
     data.threads = dlist_new();
     data.stats = dlist_new();
+    data.spectrum.name = "Spectrum show";
+    data.signal.name = "Signal show";
 
     if ((data.opts = opts_parse(argc, argv)) == NULL) {
         exit(EXIT_FAILURE);
     }
 
+    /* Run time toggles are consumed by run(). Blocking them before any
+     * thread is created makes all the threads inherit the mask. */
+    run_signals(&toggles, opts_get_trace(data.opts));
+    pthread_sigmask(SIG_BLOCK, &toggles, NULL);
+
     on_exit(exit_handler, (void *) &data);
 
+    /* Locking memory before creating anything, so that the threads and
+     * their buffers are never paged out (nor faulted in lazily). */
+    #ifndef RT_DISABLE
+        data.memlock = false;
+        if (mlockall( MCL_CURRENT | MCL_FUTURE )) {
+            ERR_FMT("Unable to lock memory: %s", strerror(errno));
+            ERR_MSG("You need more privileges to do this!");
+            exit(EXIT_FAILURE);
+        }
+        data.memlock = true;
+    #endif
+
+    /* From now on the real time threads don't write the log. */
+    if (logging_start()) {
+        ERR_FMT("Unable to start the log writer: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    data.trace = opts_get_trace(data.opts);
+    rtlock_instrument(opts_lock_stats_enabled(data.opts));
+
+    if ((metrics = opts_get_metrics(data.opts)) != NULL) {
+        data.metrics = metrics_new(metrics);
+        if (data.metrics == NULL) {
+            ERR_FMT("Unable to serve the metrics on '%s': %s", metrics,
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
     data.pool = thrd_new(opts_get_minprio(data.opts));
+    switch (opts_get_sched(data.opts)) {
+        case OPTS_SCHED_RM:
+            break;
+        case OPTS_SCHED_EDF:
+            thrd_set_policy(data.pool, THRD_POLICY_EDF);
+            break;
+        case OPTS_SCHED_CYCLIC:
+            thrd_set_policy(data.pool, THRD_POLICY_CYCLIC);
+            break;
+    }
+    thrd_set_partitioned(data.pool, opts_partition_enabled(data.opts));
+    thrd_set_counters(data.pool, opts_perf_counters_enabled(data.opts));
+    thrd_set_watchdog(data.pool, opts_get_watchdog(data.opts));
+    switch (opts_get_admission(data.opts)) {
+        case OPTS_ADMIT_OFF:
+            break;
+        case OPTS_ADMIT_WARN:
+            thrd_set_admission(data.pool, THRD_ADMIT_WARN);
+            break;
+        case OPTS_ADMIT_REJECT:
+            thrd_set_admission(data.pool, THRD_ADMIT_REJECT);
+            break;
+    }
     data.sampler = alsagw_new(opts_get_device(data.opts),
                               opts_get_rate(data.opts),
                               &err);
@@ -196,96 +715,81 @@ int main (int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
-    rtstats = sampth_subscribe(&sampth, data.pool, data.sampler,
-                               opts_get_buffer_scale(data.opts));
+    rtstats = sampth_subscribe(&data.sampth, data.pool, data.sampler,
+                               opts_get_buffer_scale(data.opts),
+                               opts_spin_wake_enabled(data.opts)
+                               ? THRD_WAKE_SPIN : THRD_WAKE_SLEEP);
     if (rtstats == NULL) {
         ERR_FMT("Unable to start Sampler: %s",
                 thrd_strerr(data.pool, thrd_interr(data.pool)));
         exit(EXIT_FAILURE);
     }
-    data.threads = dlist_push(data.threads, sampth);
-    data.stats = dlist_push(data.stats, rtstat_show_new(rtstats,
-                            "Sampling"));
+    data.threads = dlist_push(data.threads, data.sampth);
+    track_statistics(&data, rtstats, "Sampling");
 
-    if (opts_spectrum_shown(data.opts)) {
-        genth_t *handle;
-        specth_graphics_t spec_graphs;
+    data.plots = plotsrv_new(opts_xshm_enabled(data.opts) ?
+                             PLOT_BACKEND_XSHM : PLOT_BACKEND_LIBPLOT);
+    if (data.plots == NULL) {
+        ERR_MSG("Unable to open the X display");
+        exit(EXIT_FAILURE);
+    }
 
-        data.spectrum = plot_new(4, sampth_get_size(sampth));
-        rtstats = plotth_subscribe(&handle, data.pool, data.spectrum);
-        if (rtstats == NULL) {
-            ERR_FMT("Unable to start Spectrum Plotter: %s",
-                    thrd_strerr(data.pool, thrd_interr(data.pool)));
-            exit(EXIT_FAILURE);
-        }
-        data.threads = dlist_push(data.threads, handle);
-        data.stats = dlist_push(data.stats, rtstat_show_new(rtstats,
-                                "Spectrum's plot updater"));
+    /* All the windows are rendered by the same thread. */
+    opts_get_plot_period(data.opts, &min, &max);
+    pacing.min = rtutils_ns2time((uint64_t)min * 1000000);
+    pacing.max = rtutils_ns2time((uint64_t)max * 1000000);
+    pacing.utilization = opts_get_plot_util(data.opts);
+    rtstats = plotth_subscribe(&data.plotth, data.pool, data.plots,
+                               &pacing);
+    if (rtstats == NULL) {
+        ERR_FMT("Unable to start Plotter: %s",
+                thrd_strerr(data.pool, thrd_interr(data.pool)));
+        exit(EXIT_FAILURE);
+    }
+    data.threads = dlist_push(data.threads, data.plotth);
+    track_statistics(&data, rtstats, "Plot updater");
+    if (data.metrics) {
+        expose_values(&data);
+    }
 
-        spec_graphs.r0 = plot_new_graphic(data.spectrum);
-        spec_graphs.i0 = plot_new_graphic(data.spectrum);
-        spec_graphs.r1 = plot_new_graphic(data.spectrum);
-        spec_graphs.i1 = plot_new_graphic(data.spectrum);
+    if (opts_spectrum_shown(data.opts) && start_spectrum(&data)) {
+        exit(EXIT_FAILURE);
+    }
 
-        rtstats = specth_subscribe(&handle, data.pool, sampth,
-                                   &spec_graphs);
-        if (rtstats == NULL) {
-            ERR_FMT("Unable to start Spectrum Analizer: %s",
-                    thrd_strerr(data.pool, thrd_interr(data.pool)));
-            exit(EXIT_FAILURE);
-        }
-        data.threads = dlist_push(data.threads, handle);
-        data.stats = dlist_push(data.stats, rtstat_show_new(rtstats,
-                                "Spectrum show"));
+    if (opts_signal_shown(data.opts) && start_signal(&data)) {
+        exit(EXIT_FAILURE);
     }
 
-    if (opts_signal_shown(data.opts)) {
+    if (opts_xy_shown(data.opts)) {
         genth_t *handle;
+        plot_t *xy;
+        plotgr_t *scatter;
 
-        data.signal = plot_new(2, sampth_get_size(sampth));
-        rtstats = plotth_subscribe(&handle, data.pool, data.signal);
-        if (rtstats == NULL) {
-            ERR_FMT("Unable to start Signal Plotter: %s",
-                    thrd_strerr(data.pool, thrd_interr(data.pool)));
+        xy = plot_new(data.plots, 2, XY_CORR_HISTORY);
+        scatter = plot_new_graphic(xy);
+        if (plot_graphic_persist(scatter, XY_DECAY)) {
+            ERR_MSG("Unable to allocate the XY plot");
             exit(EXIT_FAILURE);
         }
-        data.threads = dlist_push(data.threads, handle);
-        data.stats = dlist_push(data.stats, rtstat_show_new(rtstats,
-                                "Signal's plot updater"));
-
-        rtstats = signth_subscribe(&handle, data.pool, sampth,
-                                   plot_new_graphic(data.signal),
-                                   plot_new_graphic(data.signal));
+        rtstats = xyth_subscribe(&handle, data.pool, data.sampth, scatter,
+                                 plot_new_graphic(xy));
         if (rtstats == NULL) {
-            ERR_FMT("Unable to start Signal Analyzer: %s",
+            ERR_FMT("Unable to start XY Analyzer: %s",
                     thrd_strerr(data.pool, thrd_interr(data.pool)));
             exit(EXIT_FAILURE);
         }
         data.threads = dlist_push(data.threads, handle);
-        data.stats = dlist_push(data.stats, rtstat_show_new(rtstats,
-                                "Signal show"));
+        track_statistics(&data, rtstats, "XY show");
     }
 
-    /* Locking memory */
-    #ifndef RT_DISABLE
-        data.memlock = false;
-        if (mlockall( MCL_CURRENT | MCL_FUTURE )) {
-            ERR_FMT("Unable to lock memory: %s", strerror(errno));
-            ERR_MSG("You need more privileges to do this!");
-            exit(EXIT_FAILURE);
-        }
-        data.memlock = true;
-    #endif
-
     if (thrd_start(data.pool)) {
         ERR_FMT("Unable to start Signal Analyzer: %s",
                 thrd_strerr(data.pool, thrd_interr(data.pool)));
         exit(EXIT_FAILURE);
     }
 
-    run_for = opts_get_run_for(data.opts);
-    if (run_for) sleep(opts_get_run_for(data.opts));
-    else pause();
+    run(&data, opts_get_run_for(data.opts),
+        opts_get_stats_interval(data.opts));
 
     exit(EXIT_SUCCESS);
 }
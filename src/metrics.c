@@ -0,0 +1,567 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <dacav/dacav.h>
+
+#include "headers/metrics.h"
+#include "headers/logging.h"
+
+/* Time given to the clients for sending their request (us), and room
+ * for the request. Plain clients send nothing, HTTP clients send a GET. */
+#define METRICS_REQUEST_TIMEOUT_uS  100000
+#define METRICS_REQUEST_SIZE        1024
+
+/* Time given to the clients for reading the metrics (us): a client which
+ * doesn't read must not stall the following ones. */
+#define METRICS_SEND_TIMEOUT_uS     500000
+
+/* Upper bounds of the histogram buckets (ns) */
+static const uint64_t buckets[] = {
+    1000, 2000, 5000,
+    10000, 20000, 50000,
+    100000, 200000, 500000,
+    1000000, 2000000, 5000000,
+    10000000, 20000000, 50000000,
+    100000000, 200000000, 500000000,
+    1000000000
+};
+
+struct metrics_task {
+    const char *name;
+    const thrd_rtstats_t *stats;
+};
+
+struct metrics_value {
+    const char *name;
+    const char *help;
+    metrics_type_t type;
+    metrics_read_cb_t read;
+    void *context;
+};
+
+struct metrics_histogram {
+    const char *name;
+    const char *help;
+    metrics_hist_cb_t read;
+    void *context;
+};
+
+struct metrics {
+    char *path;             /* Path of the socket; */
+    int sock;               /* Listening socket; */
+    pthread_t handler;      /* Server thread; */
+    int stop;               /* Termination request (atomic); */
+
+    pthread_mutex_t lock;   /* Protects the following lists; */
+    dlist_t *tasks;         /* List of struct metrics_task; */
+    dlist_t *values;        /* List of struct metrics_value; */
+    dlist_t *histograms;    /* List of struct metrics_histogram. */
+};
+
+static
+void family (FILE *out, const char *name, const char *help,
+             const char *type)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static
+void seconds (FILE *out, uint64_t ns)
+{
+    fprintf(out, "%llu.%09llu\n", (unsigned long long) (ns / 1000000000),
+            (unsigned long long) (ns % 1000000000));
+}
+
+/* Writes the samples of a histogram, labelled with the task name unless
+ * task is NULL. The family must be already declared. */
+static
+void histogram (FILE *out, const char *name, const char *task,
+                const thrd_hist_t *hist, uint64_t sum)
+{
+    char labels[128], selector[128];
+    unsigned b;
+
+    if (task) {
+        snprintf(labels, sizeof(labels), "task=\"%s\",", task);
+        snprintf(selector, sizeof(selector), "{task=\"%s\"}", task);
+    } else {
+        labels[0] = selector[0] = '\0';
+    }
+
+    for (b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b ++) {
+        fprintf(out, "%s_bucket{%sle=\"%g\"} %llu\n", name, labels,
+                buckets[b] / 1e9, (unsigned long long)
+                thrd_hist_cumulative(hist, buckets[b]));
+    }
+    fprintf(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels,
+            (unsigned long long) hist->count);
+    fprintf(out, "%s_sum%s ", name, selector);
+    seconds(out, sum);
+    fprintf(out, "%s_count%s %llu\n", name, selector,
+            (unsigned long long) hist->count);
+}
+
+/* Writes the hardware counters of the tasks (zero if not counted) */
+static
+void counters (FILE *out, const struct metrics_task *tasks,
+               const thrd_rtstats_t *snap, unsigned n)
+{
+    char name[64];
+    unsigned i;
+    int e;
+
+    family(out, "soto_task_counted_total",
+           "Activations measured with the hardware counters.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_counted_total{task=\"%s\"} %llu\n",
+                tasks[i].name, (unsigned long long) snap[i].counted);
+    }
+
+    for (e = 0; e < PERFCTR_EVENTS; e ++) {
+        snprintf(name, sizeof(name), "soto_task_%s_total",
+                 perfctr_name(e));
+        family(out, name, "Hardware events of the counted activations.",
+               "counter");
+        for (i = 0; i < n; i ++) {
+            fprintf(out, "%s{task=\"%s\"} %llu\n", name, tasks[i].name,
+                    (unsigned long long) snap[i].events[e]);
+        }
+    }
+}
+
+/* Writes the per-task metrics from the given snapshots */
+static
+void expose_tasks (FILE *out, const struct metrics_task *tasks,
+                   const thrd_rtstats_t *snap, unsigned n)
+{
+    unsigned i;
+
+    family(out, "soto_task_response_seconds",
+           "Response time of the activations.", "histogram");
+    for (i = 0; i < n; i ++) {
+        histogram(out, "soto_task_response_seconds", tasks[i].name,
+                  &snap[i].response, snap[i].response_times);
+    }
+
+    family(out, "soto_task_worst_response_seconds",
+           "Worst case response time.", "gauge");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_worst_response_seconds{task=\"%s\"} ",
+                tasks[i].name);
+        seconds(out, snap[i].wcrt);
+    }
+
+    family(out, "soto_task_deadline_misses_total",
+           "Activations finished after their deadline.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_deadline_misses_total{task=\"%s\"} %llu\n",
+                tasks[i].name, (unsigned long long) snap[i].dmiss_count);
+    }
+
+    family(out, "soto_task_skipped_total",
+           "Activations skipped by the overrun policy.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_skipped_total{task=\"%s\"} %llu\n",
+                tasks[i].name, (unsigned long long) snap[i].skip_count);
+    }
+
+    family(out, "soto_task_lateness_seconds_total",
+           "Time between the scheduled and the actual activations.",
+           "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_lateness_seconds_total{task=\"%s\"} ",
+                tasks[i].name);
+        seconds(out, snap[i].lateness_times);
+    }
+
+    family(out, "soto_task_execution_seconds_total",
+           "CPU time consumed by the activations.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_execution_seconds_total{task=\"%s\"} ",
+                tasks[i].name);
+        seconds(out, snap[i].exec_times);
+    }
+
+    family(out, "soto_task_preemption_seconds_total",
+           "Time spent by the activations off the CPU.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_preemption_seconds_total{task=\"%s\"} ",
+                tasks[i].name);
+        seconds(out, snap[i].preempt_times);
+    }
+
+    family(out, "soto_task_spin_seconds_total",
+           "Time spent busy waiting for the activations.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_spin_seconds_total{task=\"%s\"} ",
+                tasks[i].name);
+        seconds(out, snap[i].spin_time);
+    }
+
+    family(out, "soto_task_page_faults_total",
+           "Page faults within the callbacks.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_page_faults_total{task=\"%s\","
+                     "kind=\"minor\"} %llu\n", tasks[i].name,
+                (unsigned long long) snap[i].minor_faults);
+        fprintf(out, "soto_task_page_faults_total{task=\"%s\","
+                     "kind=\"major\"} %llu\n", tasks[i].name,
+                (unsigned long long) snap[i].major_faults);
+    }
+
+    family(out, "soto_task_faulted_total",
+           "Activations hit by page faults.", "counter");
+    for (i = 0; i < n; i ++) {
+        fprintf(out, "soto_task_faulted_total{task=\"%s\"} %llu\n",
+                tasks[i].name, (unsigned long long) snap[i].fault_count);
+    }
+
+    counters(out, tasks, snap, n);
+}
+
+/* Writes all the metrics. The statistics are copied under the sequence
+ * locks, so the real time threads never wait for this. */
+static
+void expose (metrics_t *m, FILE *out)
+{
+    struct metrics_task *tasks;
+    thrd_rtstats_t *snap;
+    unsigned n = 0;
+    diter_t *i;
+
+    pthread_mutex_lock(&m->lock);
+
+    i = dlist_iter_new(&m->tasks);
+    while (diter_hasnext(i)) {
+        diter_next(i);
+        n ++;
+    }
+    dlist_iter_free(i);
+
+    if (n > 0) {
+        tasks = (struct metrics_task *) calloc(n,
+                                               sizeof(struct metrics_task));
+        snap = (thrd_rtstats_t *) calloc(n, sizeof(thrd_rtstats_t));
+        assert(tasks && snap);
+
+        n = 0;
+        i = dlist_iter_new(&m->tasks);
+        while (diter_hasnext(i)) {
+            memcpy(&tasks[n], diter_next(i), sizeof(struct metrics_task));
+            thrd_rtstats_snapshot(tasks[n].stats, &snap[n]);
+            n ++;
+        }
+        dlist_iter_free(i);
+
+        expose_tasks(out, tasks, snap, n);
+        free(tasks);
+        free(snap);
+    }
+
+    i = dlist_iter_new(&m->values);
+    while (diter_hasnext(i)) {
+        struct metrics_value *v = (struct metrics_value *) diter_next(i);
+
+        family(out, v->name, v->help,
+               v->type == METRICS_COUNTER ? "counter" : "gauge");
+        fprintf(out, "%s %.9g\n", v->name, v->read(v->context));
+    }
+    dlist_iter_free(i);
+
+    i = dlist_iter_new(&m->histograms);
+    while (diter_hasnext(i)) {
+        struct metrics_histogram *h;
+        thrd_hist_t hist;
+        uint64_t sum;
+
+        h = (struct metrics_histogram *) diter_next(i);
+        sum = h->read(h->context, &hist);
+        family(out, h->name, h->help, "histogram");
+        histogram(out, h->name, NULL, &hist, sum);
+    }
+    dlist_iter_free(i);
+
+    pthread_mutex_unlock(&m->lock);
+}
+
+static
+int send_all (int fd, const char *buffer, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = send(fd, buffer, len, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buffer += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Reads the request, if any, then writes the metrics. HTTP requests get
+ * an HTTP response, so that the socket can be scraped through a proxy. */
+static
+void serve (metrics_t *m, int fd)
+{
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = METRICS_REQUEST_TIMEOUT_uS
+    };
+    struct timeval send_tv = {
+        .tv_sec = 0,
+        .tv_usec = METRICS_SEND_TIMEOUT_uS
+    };
+    char request[METRICS_REQUEST_SIZE + 1];
+    char header[128];
+    size_t used = 0, len = 0;
+    char *text = NULL;
+    ssize_t n;
+    FILE *out;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_tv,
+               sizeof(struct timeval));
+    while (used < METRICS_REQUEST_SIZE) {
+        n = recv(fd, request + used, METRICS_REQUEST_SIZE - used, 0);
+        if (n <= 0) break;
+        used += n;
+        request[used] = '\0';
+        if (strstr(request, "\r\n\r\n")) break;
+    }
+
+    out = open_memstream(&text, &len);
+    assert(out);
+    expose(m, out);
+    fclose(out);
+
+    if (used >= 4 && memcmp(request, "GET ", 4) == 0) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %zu\r\n\r\n", len);
+        if (send_all(fd, header, strlen(header))) {
+            free(text);
+            return;
+        }
+    }
+    send_all(fd, text, len);
+    free(text);
+}
+
+static
+void * server_routine (void *arg)
+{
+    metrics_t *m = (metrics_t *) arg;
+    int fd;
+
+    for (;;) {
+        fd = accept(m->sock, NULL, NULL);
+        if (fd == -1) {
+            if (__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            ERR_FMT("Metrics server stopped: %s", strerror(errno));
+            break;
+        }
+        serve(m, fd);
+        close(fd);
+    }
+
+    pthread_exit(NULL);
+}
+
+metrics_t * metrics_new (const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    sigset_t all, old;
+    metrics_t *m;
+    int err;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    m = (metrics_t *) calloc(1, sizeof(metrics_t));
+    assert(m);
+    m->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m->sock == -1) {
+        free(m);
+        return NULL;
+    }
+
+    /* Only a stale socket is replaced: anything else on the path is
+     * most likely a typo, and it's not ours to delete. */
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            close(m->sock);
+            free(m);
+            errno = EEXIST;
+            return NULL;
+        }
+        unlink(path);
+    }
+    if (bind(m->sock, (struct sockaddr *) &addr,
+             sizeof(struct sockaddr_un)) || listen(m->sock, 4)) {
+        err = errno;
+        close(m->sock);
+        free(m);
+        errno = err;
+        return NULL;
+    }
+
+    m->path = strdup(path);
+    assert(m->path);
+    m->tasks = dlist_new();
+    m->values = dlist_new();
+    m->histograms = dlist_new();
+    pthread_mutex_init(&m->lock, NULL);
+
+    /* Default attributes: the server doesn't run in real time. Signals
+     * are left to the other threads. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&m->handler, NULL, server_routine, (void *) m);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        close(m->sock);
+        unlink(m->path);
+        dlist_free(m->tasks, NULL);
+        dlist_free(m->values, NULL);
+        dlist_free(m->histograms, NULL);
+        pthread_mutex_destroy(&m->lock);
+        free(m->path);
+        free(m);
+        errno = err;
+        return NULL;
+    }
+
+    return m;
+}
+
+void metrics_destroy (metrics_t *m)
+{
+    /* Shutting down the socket makes accept() fail */
+    __atomic_store_n(&m->stop, 1, __ATOMIC_RELEASE);
+    shutdown(m->sock, SHUT_RDWR);
+    pthread_join(m->handler, NULL);
+
+    close(m->sock);
+    unlink(m->path);
+    dlist_free(m->tasks, free);
+    dlist_free(m->values, free);
+    dlist_free(m->histograms, free);
+    pthread_mutex_destroy(&m->lock);
+    free(m->path);
+    free(m);
+}
+
+void metrics_add_task (metrics_t *m, const char *name,
+                       const thrd_rtstats_t *stats)
+{
+    struct metrics_task *t;
+
+    t = (struct metrics_task *) malloc(sizeof(struct metrics_task));
+    assert(t);
+    t->name = name;
+    t->stats = stats;
+
+    pthread_mutex_lock(&m->lock);
+    m->tasks = dlist_append(m->tasks, (void *) t);
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_remove_task (metrics_t *m, const thrd_rtstats_t *stats)
+{
+    diter_t *i;
+
+    pthread_mutex_lock(&m->lock);
+    i = dlist_iter_new(&m->tasks);
+    while (diter_hasnext(i)) {
+        struct metrics_task *t = (struct metrics_task *) diter_next(i);
+
+        if (t->stats == stats) {
+            diter_remove(i, free);
+            break;
+        }
+    }
+    dlist_iter_free(i);
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_add_value (metrics_t *m, const char *name, const char *help,
+                        metrics_type_t type, metrics_read_cb_t read,
+                        void *context)
+{
+    struct metrics_value *v;
+
+    v = (struct metrics_value *) malloc(sizeof(struct metrics_value));
+    assert(v);
+    v->name = name;
+    v->help = help;
+    v->type = type;
+    v->read = read;
+    v->context = context;
+
+    pthread_mutex_lock(&m->lock);
+    m->values = dlist_append(m->values, (void *) v);
+    pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_add_histogram (metrics_t *m, const char *name,
+                            const char *help, metrics_hist_cb_t read,
+                            void *context)
+{
+    struct metrics_histogram *h;
+
+    h = (struct metrics_histogram *) malloc(
+                                        sizeof(struct metrics_histogram));
+    assert(h);
+    h->name = name;
+    h->help = help;
+    h->read = read;
+    h->context = context;
+
+    pthread_mutex_lock(&m->lock);
+    m->histograms = dlist_append(m->histograms, (void *) h);
+    pthread_mutex_unlock(&m->lock);
+}
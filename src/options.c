@@ -48,7 +48,8 @@ struct opts {
         SHOW_NOTHING  = 0,
         SHOW_SIGNAL   = 1 << 0,
         SHOW_SPECTRUM = 1 << 1,
-        SHOW_BOTH     = 1 | (1 << 1)
+        SHOW_BOTH     = 1 | (1 << 1),
+        SHOW_XY       = 1 << 2
     } show;
 
     /* Multiplicative factor that defines the proportion between the
@@ -57,17 +58,73 @@ struct opts {
     unsigned buffer_scale;
 
     unsigned run_for;
+
+    /* Render trough MIT-SHM instead of libplot */
+    bool xshm;
+
+    /* Show the signal in persistence mode */
+    bool phosphor;
+
+    /* Plotting period bounds (ms) and target utilization (percent) */
+    unsigned plot_min;
+    unsigned plot_max;
+    unsigned plot_util;
+
+    /* Scheduling policy */
+    opts_sched_t sched;
+
+    /* Pin each thread on a single CPU */
+    bool partition;
+
+    /* Schedulability test at startup */
+    opts_admission_t admission;
+
+    /* Seconds between two statistics reports */
+    unsigned stats_interval;
+
+    /* Contention statistics of the locks */
+    bool lock_stats;
+
+    /* Busy waiting for the sampler activations */
+    bool spin_wake;
+
+    /* Output of the thread traces, NULL if not required */
+    const char *trace;
+
+    /* Socket of the metrics server, NULL if not required */
+    const char *metrics;
+
+    /* Hardware performance counters of the threads */
+    bool perf_counters;
+
+    /* Periods a thread may stall before the watchdog reports it */
+    unsigned watchdog;
 };
 
-static const char optstring[] = "d:r:m:U::u::s:t:h";
+static const char optstring[] = "d:r:m:U::u::x::s:t:X::P::p:F:S:C::A:I:L::W::T:M:H::D:h";
 static const struct option longopts[] = {
     {"dev", 1, NULL, 'd'},
     {"rate", 1, NULL, 'r'},
     {"minprio", 1, NULL, 'm'},
     {"show-spectrum", 2, NULL, 'U'},
     {"show-signal", 2, NULL, 'u'},
+    {"show-xy", 2, NULL, 'x'},
     {"buffer-scale", 1, NULL, 's'},
     {"run-for", 1, NULL, 't'},
+    {"xshm", 2, NULL, 'X'},
+    {"phosphor", 2, NULL, 'P'},
+    {"plot-period", 1, NULL, 'p'},
+    {"plot-util", 1, NULL, 'F'},
+    {"sched", 1, NULL, 'S'},
+    {"partition", 2, NULL, 'C'},
+    {"admission", 1, NULL, 'A'},
+    {"stats-interval", 1, NULL, 'I'},
+    {"lock-stats", 2, NULL, 'L'},
+    {"spin-wake", 2, NULL, 'W'},
+    {"trace", 1, NULL, 'T'},
+    {"metrics", 1, NULL, 'M'},
+    {"perf-counters", 2, NULL, 'H'},
+    {"watchdog", 1, NULL, 'D'},
     {"help", 0, NULL, 'h'},
     {NULL, 0, NULL, 0}
 };
@@ -83,6 +140,9 @@ static const char help [] =
 "        Show the spectrum of the audio stream (default: yes);\n\n"
 "  --show-signal[={bool}] | -u [{bool}] \n"
 "        Show the signal of the audio stream (default: no);\n\n"
+"  --show-xy[={bool}] | -x [{bool}] \n"
+"        Show channel 0 against channel 1 (goniometer) and their\n"
+"        correlation (default: no);\n\n"
 "  --buffer-scale={factor} | -s {factor}\n"
 "        Provide the proportion between sampling buffer and read buffer\n"
 "        (default: 10);\n\n"
@@ -93,6 +153,66 @@ static const char help [] =
 "        Requires the program to run for a certain amount of time.\n"
 "        By providing 0 (which is the default) the program will run\n"
 "        until interrupted\n\n"
+"  --xshm[={bool}] | -X [{bool}]\n"
+"        Rasterize the plots and push them trough the MIT-SHM X extension\n"
+"        instead of using libplot (default: no);\n\n"
+"  --phosphor[={bool}] | -P [{bool}]\n"
+"        Show the signal as a digital phosphor: traces are accumulated\n"
+"        into a decaying heatmap (default: no);\n\n"
+"  --plot-period={min}:{max} | -p {min}:{max}\n"
+"        Bounds in milliseconds for the refresh period of the plots\n"
+"        (default: 16:100);\n\n"
+"  --plot-util={percent} | -F {percent}\n"
+"        Target CPU utilization for the plotting thread, which adapts its\n"
+"        refresh period accordingly. By providing 0 the refresh period is\n"
+"        fixed (default: 20);\n\n";
+
+/* Split from help[], which would exceed the length of a string literal
+ * an ISO C99 compiler is required to support. */
+static const char help_sched [] =
+"  --sched={rm|edf|cyclic} | -S {rm|edf|cyclic}\n"
+"        Scheduling policy for the real-time threads: Rate Monotonic\n"
+"        priorities on SCHED_FIFO, Earliest Deadline First on\n"
+"        SCHED_DEADLINE, or a cyclic executive running all the tasks on\n"
+"        a single thread (default: rm);\n\n"
+"  --partition[={bool}] | -C [{bool}]\n"
+"        Pin each thread on a single CPU, placing them first-fit by\n"
+"        decreasing utilization, as measured by --admission (without\n"
+"        it each thread counts as 10% of a CPU). Allowed only with\n"
+"        --sched=rm (default: no);\n\n"
+"  --admission={off|warn|reject} | -A {off|warn|reject}\n"
+"        Measure the execution time of each thread before starting, and\n"
+"        check whether the threads can meet their deadlines. Either warn\n"
+"        or refuse to run if they can't (default: off);\n\n"
+"  --stats-interval={seconds} | -I {seconds}\n"
+"        Report the statistics of the threads periodically while they\n"
+"        are running. By providing 0 (which is the default) they are\n"
+"        reported only at exit;\n\n"
+"  --lock-stats[={bool}] | -L [{bool}]\n"
+"        Measure wait time, hold time and contentions of the locks\n"
+"        shared among threads, and report them along with the\n"
+"        statistics of the threads (default: no);\n\n"
+"  --spin-wake[={bool}] | -W [{bool}]\n"
+"        Wake up the sampling thread by sleeping until shortly before\n"
+"        its activation, then busy waiting. This reduces the activation\n"
+"        jitter, at the price of some CPU time (default: no);\n\n"
+"  --trace={file} | -T {file}\n"
+"        Write the recent activations of the threads to the given file\n"
+"        on exit and on SIGHUP, in the format of chrome://tracing\n"
+"        (default: no trace);\n\n"
+"  --metrics={path} | -M {path}\n"
+"        Serve the statistics in the Prometheus text format on a Unix\n"
+"        domain socket having the given path (default: no server);\n\n"
+"  --perf-counters[={bool}] | -H [{bool}]\n"
+"        Count cycles, instructions, cache misses and branch misses of\n"
+"        each activation of the threads with the hardware performance\n"
+"        counters, and report them along with the statistics of the\n"
+"        threads (default: no);\n\n"
+"  --watchdog={periods} | -D {periods}\n"
+"        Report on stderr the threads not completing an activation for\n"
+"        the given number of their periods, along with their recent\n"
+"        events and their stack. By providing 0 (which is the default)\n"
+"        the watchdog is disabled;\n\n"
 "  --help  | -h\n"
 "        Print this help.\n";
 
@@ -100,6 +220,7 @@ static inline
 void print_help (const char *progname)
 {
     fprintf(stderr, help, progname);
+    fputs(help_sched, stderr);
 }
 
 static inline
@@ -160,6 +281,60 @@ int to_bool (const char *arg, bool *val)
     return -1;
 }
 
+static
+int to_range (const char *arg, unsigned *min, unsigned *max)
+{
+    char tail;
+
+    if (sscanf(arg, "%u:%u%c", min, max, &tail) != 2)
+        return -1;
+    if (*min == 0 || *min > *max)
+        return -2;
+    return 0;
+}
+
+static
+int to_sched (const char *arg, opts_sched_t *sched)
+{
+    const char *allowed[] = {
+        "rm", "edf", "cyclic", NULL
+    };
+
+    switch (check_case_optarg(arg, allowed)) {
+        case 0:
+            *sched = OPTS_SCHED_RM;
+            return 0;
+        case 1:
+            *sched = OPTS_SCHED_EDF;
+            return 0;
+        case 2:
+            *sched = OPTS_SCHED_CYCLIC;
+            return 0;
+    }
+    return -1;
+}
+
+static
+int to_admission (const char *arg, opts_admission_t *mode)
+{
+    const char *allowed[] = {
+        "off", "warn", "reject", NULL
+    };
+
+    switch (check_case_optarg(arg, allowed)) {
+        case 0:
+            *mode = OPTS_ADMIT_OFF;
+            return 0;
+        case 1:
+            *mode = OPTS_ADMIT_WARN;
+            return 0;
+        case 2:
+            *mode = OPTS_ADMIT_REJECT;
+            return 0;
+    }
+    return -1;
+}
+
 static
 int to_priority (const char *arg, int *prio)
 {
@@ -183,6 +358,21 @@ void set_defaults (opts_t *so)
     so->show = SHOW_SPECTRUM;
     so->buffer_scale = DEFAULT_BUFFER_SCALE;
     so->run_for = DEFAULT_RUN_FOR;
+    so->xshm = false;
+    so->phosphor = false;
+    so->plot_min = PLOT_PERIOD_MIN_mSEC;
+    so->plot_max = PLOT_PERIOD_MAX_mSEC;
+    so->plot_util = PLOT_UTILIZATION;
+    so->sched = OPTS_SCHED_RM;
+    so->partition = false;
+    so->admission = OPTS_ADMIT_OFF;
+    so->stats_interval = 0;
+    so->lock_stats = false;
+    so->spin_wake = false;
+    so->trace = NULL;
+    so->metrics = NULL;
+    so->perf_counters = false;
+    so->watchdog = 0;
 }
 
 opts_t * opts_parse (int argc, char * const argv[])
@@ -230,6 +420,18 @@ opts_t * opts_parse (int argc, char * const argv[])
                     so->show &= ~SHOW_SIGNAL;
                 }
                 break;
+            case 'x':
+                if (to_bool(optarg, &b)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                if (b) {
+                    so->show |= SHOW_XY;
+                } else {
+                    so->show &= ~SHOW_XY;
+                }
+                break;
             case 's':
                 if (to_unsigned(optarg, &so->buffer_scale)) {
                     notify_error(argv[0], "invalid scale: '%s'", optarg);
@@ -255,6 +457,99 @@ opts_t * opts_parse (int argc, char * const argv[])
                     return NULL;
                 }
                 break;
+            case 'X':
+                if (to_bool(optarg, &so->xshm)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'P':
+                if (to_bool(optarg, &so->phosphor)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'p':
+                switch (to_range(optarg, &so->plot_min, &so->plot_max)) {
+                    case -1:
+                        notify_error(argv[0], "invalid plot period: '%s'",
+                                     optarg);
+                        return NULL;
+                    case -2:
+                        notify_error(argv[0], "bad plot period bounds: %s",
+                                     optarg);
+                        return NULL;
+                }
+                break;
+            case 'F':
+                if (to_unsigned(optarg, &so->plot_util)
+                        || so->plot_util > 100) {
+                    notify_error(argv[0], "invalid utilization: '%s'",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'S':
+                if (to_sched(optarg, &so->sched)) {
+                    notify_error(argv[0], "unknown policy: '%s'", optarg);
+                    return NULL;
+                }
+                break;
+            case 'C':
+                if (to_bool(optarg, &so->partition)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'A':
+                if (to_admission(optarg, &so->admission)) {
+                    notify_error(argv[0], "unknown admission mode: '%s'",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'I':
+                if (to_unsigned(optarg, &so->stats_interval)) {
+                    notify_error(argv[0], "invalid interval: '%s'", optarg);
+                    return NULL;
+                }
+                break;
+            case 'L':
+                if (to_bool(optarg, &so->lock_stats)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'W':
+                if (to_bool(optarg, &so->spin_wake)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'T':
+                so->trace = optarg;
+                break;
+            case 'M':
+                so->metrics = optarg;
+                break;
+            case 'H':
+                if (to_bool(optarg, &so->perf_counters)) {
+                    notify_error(argv[0], "cannot evaluate '%s' as bool",
+                                 optarg);
+                    return NULL;
+                }
+                break;
+            case 'D':
+                if (to_unsigned(optarg, &so->watchdog)) {
+                    notify_error(argv[0], "invalid periods: '%s'", optarg);
+                    return NULL;
+                }
+                break;
             case 'h':
             case '?':
                 print_help(argv[0]);
@@ -302,7 +597,83 @@ bool opts_signal_shown (opts_t *o)
     return (o->show & SHOW_SIGNAL) != 0;
 }
 
+bool opts_xy_shown (opts_t *o)
+{
+    return (o->show & SHOW_XY) != 0;
+}
+
 unsigned opts_get_run_for (opts_t *o)
 {
     return o->run_for;    
 }
+
+bool opts_xshm_enabled (opts_t *o)
+{
+    return o->xshm;
+}
+
+bool opts_phosphor_enabled (opts_t *o)
+{
+    return o->phosphor;
+}
+
+void opts_get_plot_period (opts_t *o, unsigned *min, unsigned *max)
+{
+    *min = o->plot_min;
+    *max = o->plot_max;
+}
+
+unsigned opts_get_plot_util (opts_t *o)
+{
+    return o->plot_util;
+}
+
+opts_sched_t opts_get_sched (opts_t *o)
+{
+    return o->sched;
+}
+
+bool opts_partition_enabled (opts_t *o)
+{
+    return o->partition;
+}
+
+opts_admission_t opts_get_admission (opts_t *o)
+{
+    return o->admission;
+}
+
+unsigned opts_get_stats_interval (opts_t *o)
+{
+    return o->stats_interval;
+}
+
+bool opts_lock_stats_enabled (opts_t *o)
+{
+    return o->lock_stats;
+}
+
+bool opts_spin_wake_enabled (opts_t *o)
+{
+    return o->spin_wake;
+}
+
+const char * opts_get_trace (opts_t *o)
+{
+    return o->trace;
+}
+
+const char * opts_get_metrics (opts_t *o)
+{
+    return o->metrics;
+}
+
+bool opts_perf_counters_enabled (opts_t *o)
+{
+    return o->perf_counters;
+}
+
+unsigned opts_get_watchdog (opts_t *o)
+{
+    return o->watchdog;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "headers/perfctr.h"
+
+struct perfctr {
+    int fd[PERFCTR_EVENTS];
+    struct perf_event_mmap_page *page[PERFCTR_EVENTS];
+    size_t page_size;
+};
+
+static const uint64_t configs[PERFCTR_EVENTS] = {
+    [PERFCTR_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [PERFCTR_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [PERFCTR_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+    [PERFCTR_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static const char * const names[PERFCTR_EVENTS] = {
+    [PERFCTR_CYCLES] = "cycles",
+    [PERFCTR_INSTRUCTIONS] = "instructions",
+    [PERFCTR_CACHE_MISSES] = "cache_misses",
+    [PERFCTR_BRANCH_MISSES] = "branch_misses"
+};
+
+/* The events are a group, led by the first one: they are scheduled on
+ * the PMU all together. */
+static
+int open_event (uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/* Reads a counter through the mapped page, as documented in
+ * perf_event_open(2). When the event is not on the PMU, or the CPU has
+ * no rdpmc, the kernel is asked. */
+static
+uint64_t read_event (const perfctr_t *pc, int n)
+{
+    volatile struct perf_event_mmap_page *page = pc->page[n];
+    uint64_t count;
+    uint32_t seq;
+
+    do {
+        seq = page->lock;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+        #if defined(__i386__) || defined(__x86_64__)
+        if (page->cap_user_rdpmc && page->index &&
+                page->pmc_width > 0 && page->pmc_width <= 64) {
+            unsigned shift = 64 - page->pmc_width;
+            uint64_t raw = __builtin_ia32_rdpmc(page->index - 1);
+
+            /* The counter is pmc_width bits wide, and signed */
+            count = page->offset + ((int64_t) (raw << shift) >> shift);
+        } else
+        #endif
+        if (read(pc->fd[n], &count, sizeof(uint64_t))
+                != sizeof(uint64_t)) {
+            count = 0;
+        }
+
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    } while (page->lock != seq);
+
+    return count;
+}
+
+perfctr_t * perfctr_open (void)
+{
+    perfctr_t *pc;
+    int n, err;
+
+    pc = (perfctr_t *) calloc(1, sizeof(perfctr_t));
+    assert(pc);
+    pc->page_size = sysconf(_SC_PAGESIZE);
+    for (n = 0; n < PERFCTR_EVENTS; n ++) {
+        pc->fd[n] = -1;
+    }
+
+    for (n = 0; n < PERFCTR_EVENTS; n ++) {
+        pc->fd[n] = open_event(configs[n], n == 0 ? -1 : pc->fd[0]);
+        if (pc->fd[n] == -1) {
+            goto fail;
+        }
+
+        /* Only the first page is needed, the one describing the counter */
+        pc->page[n] = mmap(NULL, pc->page_size, PROT_READ, MAP_SHARED,
+                           pc->fd[n], 0);
+        if (pc->page[n] == MAP_FAILED) {
+            pc->page[n] = NULL;
+            goto fail;
+        }
+    }
+    return pc;
+
+  fail:
+    err = errno;
+    perfctr_close(pc);
+    errno = err;
+    return NULL;
+}
+
+void perfctr_read (perfctr_t *pc, uint64_t values[PERFCTR_EVENTS])
+{
+    int n;
+
+    for (n = 0; n < PERFCTR_EVENTS; n ++) {
+        values[n] = read_event(pc, n);
+    }
+}
+
+void perfctr_close (perfctr_t *pc)
+{
+    int n;
+
+    for (n = PERFCTR_EVENTS - 1; n >= 0; n --) {
+        if (pc->page[n]) {
+            munmap(pc->page[n], pc->page_size);
+        }
+        if (pc->fd[n] != -1) {
+            close(pc->fd[n]);
+        }
+    }
+    free(pc);
+}
+
+const char * perfctr_name (perfctr_event_t event)
+{
+    assert(event < PERFCTR_EVENTS);
+    return names[event];
+}
@@ -19,6 +19,9 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
 
 #include "headers/logging.h"
 #include "headers/constants.h"
@@ -27,23 +30,109 @@
 #include "headers/plotthread.h"
 #include "headers/thrd.h"
 
+struct plotth_data {
+    plotsrv_t *srv;                 /* Rendering server; */
+
+    /* Frame pacing (all times in nanoseconds). A null utilization
+     * disables the pacing. */
+    const thrd_rtstats_t *stats;    /* Statistics of this very thread; */
+    uint64_t min, max;              /* Period bounds; */
+    unsigned utilization;           /* Target utilization (percent); */
+    uint64_t period;                /* Current period (atomic); */
+    uint64_t last_exec;             /* Execution times at last check; */
+    uint64_t last_nexec;            /* Executions at last check. */
+};
+
+static
+int destroy_cb (void *arg)
+{
+    free(arg);
+    return 0;
+}
+
+/* Frame pacing: the average CPU time of this thread over the last window
+ * of activations is taken as the rendering cost, and the period moves
+ * halfway towards the one which would give the target utilization. The
+ * response time would also count the preemption by the other tasks, and
+ * the time spent waiting for the X server in XSync(), during which the
+ * CPU is free: neither is part of our utilization. */
+static
+void adjust_period (struct plotth_data *ctx)
+{
+    const thrd_rtstats_t *stats = ctx->stats;
+    uint64_t nexec, cost, target;
+    struct timespec period;
+
+    nexec = stats->n_executions - ctx->last_nexec;
+    if (nexec < PLOT_PACING_WINDOW) {
+        return;
+    }
+    cost = (stats->exec_times - ctx->last_exec) / nexec;
+    ctx->last_exec = stats->exec_times;
+    ctx->last_nexec = stats->n_executions;
+
+    target = cost * 100 / ctx->utilization;
+    if (target < ctx->min) target = ctx->min;
+    if (target > ctx->max) target = ctx->max;
+    target = (ctx->period + target) / 2;
+
+    if (target != ctx->period) {
+        DEBUG_FMT("Plot period: %llu ns", (unsigned long long)target);
+        __atomic_store_n(&ctx->period, target, __ATOMIC_RELAXED);
+        period = rtutils_ns2time(target);
+        thrd_set_period(&period);
+    }
+}
+
+/* Rendering took more than a period: it's pointless to wait for the
+ * pacing window, the period gets the upper bound straight away. */
+static
+void overrun_cb (void *arg, unsigned missed)
+{
+    struct plotth_data *ctx = (struct plotth_data *)arg;
+    struct timespec period;
+
+    if (ctx->period < ctx->max) {
+        DEBUG_FMT("Plot overrun (%u frames): period %llu ns", missed,
+                  (unsigned long long)ctx->max);
+        __atomic_store_n(&ctx->period, ctx->max, __ATOMIC_RELAXED);
+        period = rtutils_ns2time(ctx->period);
+        thrd_set_period(&period);
+    }
+}
+
 static
 int thread_cb (void *arg)
 {
-    plot_redraw((plot_t *)arg);
+    struct plotth_data *ctx = (struct plotth_data *)arg;
+
+    plotsrv_redraw(ctx->srv);
+    if (ctx->utilization) {
+        adjust_period(ctx);
+    }
     return 0;
 }
 
 const thrd_rtstats_t * plotth_subscribe (genth_t **handle,
                                          thrd_pool_t *pool,
-                                         plot_t *plot)
+                                         plotsrv_t *srv,
+                                         const plotth_pacing_t *pacing)
 {
     thrd_info_t thi;
+    struct plotth_data *ctx;
+    const thrd_rtstats_t *ret;
 
+    memset(&thi, 0, sizeof(thrd_info_t));
     thi.init = NULL;
     thi.callback = thread_cb;
-    thi.destroy = NULL;
-    thi.context = (void *) plot;
+    thi.destroy = destroy_cb;
+    thi.name = "Plot updater";
+    thi.stack_size = TASK_STACK_SIZE;
+
+    ctx = (struct plotth_data *) calloc(1, sizeof(struct plotth_data));
+    assert(ctx);
+    thi.context = (void *) ctx;
+    ctx->srv = srv;
 
     /* Plotting thread starts immediatly */
     thi.delay.tv_sec = 0;
@@ -52,6 +141,34 @@ const thrd_rtstats_t * plotth_subscribe (genth_t **handle,
     thi.period.tv_sec = PLOT_PERIOD_SEC;
     thi.period.tv_nsec = PLOT_PERIOD_nSEC;
 
-    return genth_subscribe(handle, pool, &thi);
+    /* Late frames are not worth drawing */
+    thi.overrun = THRD_OVERRUN_SKIP;
+    ctx->period = rtutils_time2ns(&thi.period);
+
+    if (pacing != NULL && pacing->utilization > 0) {
+        ctx->utilization = pacing->utilization;
+        ctx->min = rtutils_time2ns(&pacing->min);
+        ctx->max = rtutils_time2ns(&pacing->max);
+        assert(ctx->min > 0 && ctx->min <= ctx->max);
+
+        /* Start from the default period, within the bounds */
+        if (ctx->period < ctx->min) ctx->period = ctx->min;
+        if (ctx->period > ctx->max) ctx->period = ctx->max;
+        thi.period = rtutils_ns2time(ctx->period);
+        thi.overrun = THRD_OVERRUN_DEGRADE;
+        thi.on_overrun = overrun_cb;
+    }
+
+    /* On failure the context is released by destroy_cb() */
+    if ((ret = genth_subscribe(handle, pool, &thi)) != NULL) {
+        ctx->stats = ret;
+    }
+    return ret;
 }
 
+uint64_t plotth_get_period (const genth_t *handle)
+{
+    const struct plotth_data *ctx = genth_get_context(handle);
+
+    return __atomic_load_n(&ctx->period, __ATOMIC_RELAXED);
+}
@@ -22,19 +22,87 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include <string.h>
 #include <pthread.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
 #include "headers/plotting.h"
 #include "headers/constants.h"
 #include "headers/logging.h"
+#include "headers/config.h"
+#include "headers/rtlock.h"
+#include "headers/rtutils.h"
+
+/* Vector of phosphor cells, processed at once by the decay pass. */
+typedef uint16_t phosphor_vec_t __attribute__ ((vector_size (16)));
+#define PHOSPHOR_VEC_LEN (sizeof(phosphor_vec_t) / sizeof(uint16_t))
+
+/* End of a list of plot::bucket. */
+#define PHOSPHOR_NIL UINT32_MAX
+
+/* Number of cells of a phosphor histogram, rounded up to a whole number
+ * of vectors. */
+#define PLOT_PHOSPHOR_CELLS \
+    ((PLOT_WIDTH * PLOT_HEIGHT + PHOSPHOR_VEC_LEN - 1) & \
+     ~(PHOSPHOR_VEC_LEN - 1))
+
+/* Values for plot::request */
+#define PLOT_REQ_NONE   0
+#define PLOT_REQ_SHOW   1
+#define PLOT_REQ_HIDE   2
+
+struct plot_server {
+    Display *display;   /* Connection shared by all the windows; */
+    Atom wm_delete;     /* Window manager's close request; */
+    plot_backend_t backend; /* Drawing backend used by the plots; */
+
+    plot_t **plots;     /* Array of owned plots; */
+    size_t nplots;      /* Number of owned plots; */
+    rtlock_t lock;      /* Protects the array from plot_new(); */
+    uint64_t frames;    /* Windows redrawn so far (atomic); */
+
+    /* Age of the data at render time, see record_ages(). Written by the
+     * redrawing thread only, read under the sequence counter. */
+    thrd_hist_t age;
+    uint64_t age_sum;   /* Sum of the recorded ages (ns); */
+    uint32_t age_seq;   /* Sequence counter, odd while writing; */
+    uint64_t shown_at;  /* End of the last redraw (ns), 0 if the ages
+                         * of that redraw are recorded already. */
+};
 
 struct plot {
     size_t ngraphics;   /* Number of graphics in the window; */
     plotgr_t *graphics; /* Array of graphics; */
-    size_t used;        /* Number of graphics in use; */
+    size_t used;        /* Number of graphics in use, published once
+                         * each one is set up (see graphics_ready()); */
     unsigned max_x;     /* Maximum value for the x axis; */
 
-    plPlotter *handle;  /* libplot handle. */
+    plotsrv_t *server;  /* Owner of the plot; */
+    Window window;      /* Window showing the plot; */
+    GC gc;              /* Graphic context for buffer swapping; */
+    int hidden;         /* The user closed the window; */
+    int request;        /* Pending plot_show() request (PLOT_REQ_*); */
+    int dirty;          /* Some graphic got modified since last redraw; */
+
+    /* PLOT_BACKEND_LIBPLOT */
+    Pixmap buffer;      /* Back buffer where libplot draws; */
+    plPlotter *handle;  /* libplot handle; */
+
+    XColor line;        /* Color of the line (used by the phosphor); */
+    uint32_t *bucket;   /* Next lit cell of the same level, for each
+                         * cell (libplot phosphor only, see
+                         * draw_phosphor()); */
+
+    /* PLOT_BACKEND_XSHM */
+    XImage *image;              /* Client side pixel buffer; */
+    XShmSegmentInfo shminfo;    /* Shared memory segment of the image; */
+    unsigned long fg;           /* Pixel value of the line; */
+    unsigned long bg;           /* Pixel value of the background; */
+    uint32_t palette[PLOT_PHOSPHOR_LEVELS]; /* Phosphor heatmap. */
 };
 
 struct graphic {
@@ -42,16 +110,32 @@ struct graphic {
     int y_offset;       /* Vertical offset of this graphic; */
     int16_t *values;    /* Stored values that gets modified; */
 
+    /* Persistence mode (see plot_graphic_persist()): intensity histogram
+     * with the same size of the window, or NULL. */
+    uint16_t *phosphor;
+    unsigned decay;     /* Decay shift applied at each commit; */
+
+    uint64_t stamp;     /* Capture time of the data (see
+                         * plot_graphic_stamp()), 0 if unknown; */
+    uint64_t shown;     /* Stamp of the last redrawn data; */
+    uint64_t drawn;     /* Stamp redrawn and not recorded yet (only
+                         * touched by the redrawing thread); */
+
     /* Two kind of threads may access this: the one which is updating the
      * plot and the possibly multiple ones updating the data. */
-    pthread_mutex_t lock;
+    rtlock_t lock;
 };
 
 /* Reentrant initialization for libplot. Thanks to the guy who fixed the
  * libplot.
+ *
+ * The plotter is an X Drawable one: it draws on the back buffer of a
+ * window created by us, so that all the windows share the connection of
+ * the server instead of opening one each.
  */
 static
-plPlotter * init_libplot (size_t nplots, int max_x)
+plPlotter * init_libplot (Display *display, Pixmap *buffer,
+                          size_t nplots, int max_x)
 {
     plPlotter *plot;
     plPlotterParams *params;
@@ -60,16 +144,14 @@ plPlotter * init_libplot (size_t nplots, int max_x)
     params = pl_newplparams();
     assert(params);
 
-    err = pl_setplparam(params, "BITMAPSIZE", PLOT_BITMAPSIZE);
+    err = pl_setplparam(params, "XDRAWABLE_DISPLAY", (void *)display);
     assert(err >= 0);
-    err = pl_setplparam(params, "VANISH_ON_DELETE", "yes");
-    assert(err >= 0);
-    err = pl_setplparam(params, "USE_DOUBLE_BUFFERING", "yes");
+    err = pl_setplparam(params, "XDRAWABLE_DRAWABLE1", (void *)buffer);
     assert(err >= 0);
     err = pl_setplparam(params, "BG_COLOR", PLOT_BGCOLOR);
     assert(err >= 0);
 
-    plot = pl_newpl_r("X", NULL, NULL, stderr, params);
+    plot = pl_newpl_r("Xdrawable", NULL, NULL, stderr, params);
     assert(plot);
 
     pl_deleteplparams(params);
@@ -87,7 +169,205 @@ plPlotter * init_libplot (size_t nplots, int max_x)
     return plot;
 }
 
-plot_t * plot_new (size_t n, unsigned max_x)
+/* Maps the phosphor intensity on the heatmap: the intensity first
+ * brings up the line color from black, then it turns to white as the
+ * histogram saturates. The 1 - (1 - t)^2 curve gives visibility to the
+ * rare (hence dim) transients. */
+static
+void phosphor_color (const XColor *line, unsigned level, XColor *out)
+{
+    double t = (double)level / (PLOT_PHOSPHOR_LEVELS - 1);
+    double base, white;
+
+    t = t * (2.0 - t);
+    base = t < 0.5 ? 2.0 * t : 1.0;
+    white = t < 0.5 ? 0.0 : 2.0 * t - 1.0;
+
+    out->red = line->red * base + (65535 - line->red) * white;
+    out->green = line->green * base + (65535 - line->green) * white;
+    out->blue = line->blue * base + (65535 - line->blue) * white;
+}
+
+static
+unsigned long pack_channel (unsigned short val, unsigned long mask)
+{
+    int shift = 0;
+
+    if (mask == 0) return 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        shift ++;
+    }
+    return ((unsigned long)val * mask / 65535) << shift;
+}
+
+/* Builds the heatmap palette for the shared memory image. */
+static
+void init_palette (plot_t *p)
+{
+    const XImage *img = p->image;
+    XColor c;
+    unsigned i;
+
+    for (i = 0; i < PLOT_PHOSPHOR_LEVELS; i ++) {
+        phosphor_color(&p->line, i, &c);
+        p->palette[i] = pack_channel(c.red, img->red_mask) |
+                        pack_channel(c.green, img->green_mask) |
+                        pack_channel(c.blue, img->blue_mask);
+    }
+}
+
+/* Set by shm_error() if the X server refuses to attach the segment (as
+ * it happens with remote displays). */
+static int shm_failed;
+
+static
+int shm_error (Display *d, XErrorEvent *ev)
+{
+    shm_failed = 1;
+    return 0;
+}
+
+static
+unsigned long named_pixel (Display *d, const char *name)
+{
+    Colormap cmap = DefaultColormap(d, DefaultScreen(d));
+    XColor color;
+
+    if (XParseColor(d, cmap, name, &color) == 0 ||
+            XAllocColor(d, cmap, &color) == 0) {
+        return WhitePixel(d, DefaultScreen(d));
+    }
+    return color.pixel;
+}
+
+/* Allocates the client side image, shared with the X server.
+ *
+ * @return 0 on success, -1 if shared memory cannot be used.
+ */
+static
+int init_shm (plot_t *p, Display *d)
+{
+    int screen = DefaultScreen(d);
+    XErrorHandler prev;
+    XShmSegmentInfo *info = &p->shminfo;
+
+    p->image = XShmCreateImage(d, DefaultVisual(d, screen),
+                               DefaultDepth(d, screen), ZPixmap, NULL,
+                               info, PLOT_WIDTH, PLOT_HEIGHT);
+    if (p->image == NULL) {
+        return -1;
+    }
+
+    /* The rasterizer writes whole 32 bit pixels. */
+    if (p->image->bits_per_pixel != 32) {
+        XDestroyImage(p->image);
+        p->image = NULL;
+        return -1;
+    }
+
+    info->shmid = shmget(IPC_PRIVATE,
+                         p->image->bytes_per_line * p->image->height,
+                         IPC_CREAT | 0600);
+    if (info->shmid == -1) {
+        XDestroyImage(p->image);
+        p->image = NULL;
+        return -1;
+    }
+    info->shmaddr = shmat(info->shmid, NULL, 0);
+    if (info->shmaddr == (void *)-1) {
+        shmctl(info->shmid, IPC_RMID, NULL);
+        XDestroyImage(p->image);
+        p->image = NULL;
+        return -1;
+    }
+    p->image->data = info->shmaddr;
+    info->readOnly = False;
+
+    shm_failed = 0;
+    prev = XSetErrorHandler(shm_error);
+    XShmAttach(d, info);
+    XSync(d, False);
+    XSetErrorHandler(prev);
+
+    /* The segment will be removed as soon as both sides detach. */
+    shmctl(info->shmid, IPC_RMID, NULL);
+
+    if (shm_failed) {
+        shmdt(info->shmaddr);
+        p->image->data = NULL;
+        XDestroyImage(p->image);
+        p->image = NULL;
+        return -1;
+    }
+
+    p->fg = named_pixel(d, PLOT_LINECOLOR);
+    p->bg = named_pixel(d, PLOT_BGCOLOR);
+    init_palette(p);
+
+    return 0;
+}
+
+/* Spawns the window and its back buffer. */
+static
+void init_window (plot_t *p, plotsrv_t *srv)
+{
+    Display *d = srv->display;
+    int screen = DefaultScreen(d);
+
+    p->window = XCreateSimpleWindow(d, RootWindow(d, screen), 0, 0,
+                                    PLOT_WIDTH, PLOT_HEIGHT, 0,
+                                    BlackPixel(d, screen),
+                                    BlackPixel(d, screen));
+    p->gc = XCreateGC(d, p->window, 0, NULL);
+
+    if (XParseColor(d, DefaultColormap(d, screen), PLOT_LINECOLOR,
+                    &p->line) == 0) {
+        p->line.red = p->line.green = p->line.blue = 65535;
+    }
+
+    /* The fallback is per plot: a failure on this window doesn't affect
+     * the other ones. */
+    if (srv->backend == PLOT_BACKEND_XSHM && init_shm(p, d) == -1) {
+        LOG_MSG("MIT-SHM not available, falling back to libplot");
+    }
+    if (p->image == NULL) {
+        p->buffer = XCreatePixmap(d, p->window, PLOT_WIDTH, PLOT_HEIGHT,
+                                  DefaultDepth(d, screen));
+    }
+
+    XStoreName(d, p->window, PACKAGE_NAME);
+    XSetWMProtocols(d, p->window, &srv->wm_delete, 1);
+    XMapWindow(d, p->window);
+    XFlush(d);
+}
+
+plotsrv_t * plotsrv_new (plot_backend_t backend)
+{
+    plotsrv_t *srv;
+    Display *d;
+
+    XInitThreads();
+    if ((d = XOpenDisplay(NULL)) == NULL) {
+        return NULL;
+    }
+
+    srv = calloc(1, sizeof(plotsrv_t));
+    assert(srv);
+    srv->display = d;
+    rtlock_init(&srv->lock, "Plot list");
+    srv->wm_delete = XInternAtom(d, "WM_DELETE_WINDOW", False);
+
+    if (backend == PLOT_BACKEND_XSHM && !XShmQueryExtension(d)) {
+        LOG_MSG("MIT-SHM not supported, falling back to libplot");
+        backend = PLOT_BACKEND_LIBPLOT;
+    }
+    srv->backend = backend;
+
+    return srv;
+}
+
+plot_t * plot_new (plotsrv_t *srv, size_t n, unsigned max_x)
 {
     plot_t *p;
 
@@ -98,8 +378,25 @@ plot_t * plot_new (size_t n, unsigned max_x)
     assert(p->graphics);
     p->ngraphics = n;
     p->used = 0;
-    p->handle = init_libplot(n, max_x);
     p->max_x = max_x;
+    p->server = srv;
+    p->hidden = 0;
+    p->request = PLOT_REQ_NONE;
+    p->dirty = 0;
+    p->image = NULL;
+    p->handle = NULL;
+    p->bucket = NULL;
+    init_window(p, srv);
+    if (p->image == NULL) {
+        p->handle = init_libplot(srv->display, &p->buffer, n, max_x);
+    }
+
+    rtlock_acquire(&srv->lock);
+    srv->plots = realloc(srv->plots, (srv->nplots + 1) * sizeof(plot_t *));
+    assert(srv->plots);
+    srv->plots[srv->nplots ++] = p;
+    rtlock_release(&srv->lock);
+
     return p;
 }
 
@@ -113,17 +410,31 @@ plotgr_t * plot_new_graphic (plot_t *p)
     }
     used = p->used;
     g = p->graphics + used; 
-    p->used ++;
 
     g->main_plot = p;
     g->y_offset = used * (PLOT_MAX_Y - PLOT_MIN_Y)
                   + (p->ngraphics - 1) * PLOT_MIN_Y;
     g->values = calloc(p->max_x, sizeof(int16_t));
-    pthread_mutex_init(&g->lock, NULL);
+    assert(g->values);
+    g->phosphor = NULL;
+    g->stamp = g->shown = g->drawn = 0;
+    rtlock_init(&g->lock, "Plot graphic");
+
+    /* The plot may be shown already: the graphic becomes visible to the
+     * rendering thread only now. */
+    __atomic_store_n(&p->used, used + 1, __ATOMIC_RELEASE);
 
     return g;
 }
 
+/* Number of graphics which are completely set up, for the rendering
+ * thread (see plot_new_graphic()). */
+static inline
+size_t graphics_ready (const plot_t *p)
+{
+    return __atomic_load_n(&p->used, __ATOMIC_ACQUIRE);
+}
+
 static
 void draw_lines (plPlotter *plot, int16_t vals[], size_t nvals,
                  int offset)
@@ -139,20 +450,405 @@ void draw_lines (plPlotter *plot, int16_t vals[], size_t nvals,
     pl_endpath_r(plot);
 }
 
-void plot_redraw(plot_t *p)
+/* Vertical mapping from the plot space to the pixel rows. The space is
+ * the same used for libplot, namely from PLOT_MAX_Y * n (top) to
+ * PLOT_MIN_Y * n (bottom).
+ */
+static inline
+int raster_row (const plot_t *p, int y)
 {
-    int i;
+    const int64_t top = (int64_t)PLOT_MAX_Y * (int64_t)p->ngraphics;
+    const int64_t bottom = (int64_t)PLOT_MIN_Y * (int64_t)p->ngraphics;
+    int64_t row;
+
+    row = ((int64_t)y - top) * (PLOT_HEIGHT - 1) / (bottom - top);
+    if (row < 0) return 0;
+    if (row >= PLOT_HEIGHT) return PLOT_HEIGHT - 1;
+    return (int)row;
+}
+
+/* Inverse of raster_row(), used to draw the phosphor with libplot. */
+static inline
+int raster_row_to_y (const plot_t *p, int row)
+{
+    const int64_t top = (int64_t)PLOT_MAX_Y * (int64_t)p->ngraphics;
+    const int64_t bottom = (int64_t)PLOT_MIN_Y * (int64_t)p->ngraphics;
+
+    return (int)(top + (int64_t)row * (bottom - top) / (PLOT_HEIGHT - 1));
+}
+
+/* Called while redrawing a graphic, under its lock: data which was not
+ * shown yet gets its age recorded by record_ages(). */
+static inline
+void take_stamp (plotgr_t *g)
+{
+    if (g->stamp != g->shown) {
+        g->shown = g->drawn = g->stamp;
+    }
+}
+
+/* Span writer for raster_trace(): draws the vertical span y0..y1 on the
+ * column x of a buffer. */
+typedef void (* span_cb_t) (void *buffer, int x, int y0, int y1,
+                            uint32_t value);
+
+/* Span writer for the pixels of the image. */
+static
+void pixel_span (void *buffer, int x, int y0, int y1, uint32_t pixel)
+{
+    const XImage *img = (const XImage *)buffer;
+    const unsigned stride = img->bytes_per_line >> 2;
+    uint32_t *col;
+    int y;
+
+    col = (uint32_t *)img->data + y0 * stride + x;
+    for (y = y0; y <= y1; y ++) {
+        *col = pixel;
+        col += stride;
+    }
+}
+
+/* Span writer for the phosphor histogram: saturated increment. */
+static
+void phosphor_span (void *buffer, int x, int y0, int y1, uint32_t hit)
+{
+    uint16_t *col = (uint16_t *)buffer + y0 * PLOT_WIDTH + x;
+    uint32_t v;
+    int y;
+
+    for (y = y0; y <= y1; y ++) {
+        v = *col + hit;
+        *col = v > UINT16_MAX ? UINT16_MAX : v;
+        col += PLOT_WIDTH;
+    }
+}
+
+static inline
+void raster_span (span_cb_t span, void *buffer, int x, int y0, int y1,
+                  uint32_t value)
+{
+    if (y0 > y1) {
+        span(buffer, x, y1, y0, value);
+    } else {
+        span(buffer, x, y0, y1, value);
+    }
+}
+
+/* Rasterizes the polyline of a graphic. The x coordinate is monotonic,
+ * thus each segment is drawn as a sequence of vertical spans, one per
+ * pixel column. When samples outnumber the columns this degenerates into
+ * a min/max span per column, which is what libplot would draw anyway. */
+static
+void raster_trace (const plot_t *p, const int16_t vals[], int offset,
+                   span_cb_t span, void *buffer, uint32_t value)
+{
+    const unsigned nvals = p->max_x;
+    int x0, y0, x1, y1, x, ya, yb;
+    unsigned i;
+
+    x0 = 0;
+    y0 = raster_row(p, vals[0] + offset);
+    for (i = 1; i < nvals; i ++) {
+        x1 = (int)((uint64_t)i * (PLOT_WIDTH - 1) / (nvals - 1));
+        y1 = raster_row(p, vals[i] + offset);
+
+        if (x1 == x0) {
+            raster_span(span, buffer, x0, y0, y1, value);
+        } else {
+            ya = y0;
+            for (x = x0; x < x1; x ++) {
+                yb = y0 + (y1 - y0) * (x + 1 - x0) / (x1 - x0);
+                raster_span(span, buffer, x, ya, yb, value);
+                ya = yb;
+            }
+        }
+        x0 = x1;
+        y0 = y1;
+    }
+    raster_span(span, buffer, x0, y0, y0, value);
+}
+
+/* Level 0 is the background: any lit cell gets at least level 1. */
+static inline
+unsigned phosphor_level (uint16_t intensity)
+{
+    return 1 + (((uint32_t)intensity * (PLOT_PHOSPHOR_LEVELS - 1)) >> 16);
+}
+
+static
+void raster_phosphor (plot_t *p, const uint16_t *hist)
+{
+    const XImage *img = p->image;
+    const unsigned stride = img->bytes_per_line >> 2;
+    uint32_t *row = (uint32_t *)img->data;
+    int x, y;
+
+    for (y = 0; y < PLOT_HEIGHT; y ++) {
+        for (x = 0; x < PLOT_WIDTH; x ++) {
+            if (hist[x]) {
+                row[x] = p->palette[phosphor_level(hist[x])];
+            }
+        }
+        hist += PLOT_WIDTH;
+        row += stride;
+    }
+}
+
+static
+void raster_redraw (plot_t *p)
+{
+    XImage *img = p->image;
+    uint32_t *pixels = (uint32_t *)img->data;
+    const size_t npixels = (img->bytes_per_line >> 2) * img->height;
+    size_t i, n;
+    int j;
     plotgr_t *g;
 
+    if (p->bg == 0) {
+        memset(pixels, 0, npixels << 2);
+    } else {
+        for (i = 0; i < npixels; i ++) pixels[i] = (uint32_t)p->bg;
+    }
+
     g = p->graphics;
-    for (i = 0; i < p->used; i ++) {
-        pthread_mutex_lock(&g->lock);
-        draw_lines(p->handle, g->values, p->max_x,
-                   g->y_offset);
-        pthread_mutex_unlock(&g->lock);
+    n = graphics_ready(p);
+    for (j = 0; j < n; j ++) {
+        rtlock_acquire(&g->lock);
+        take_stamp(g);
+        if (g->phosphor) {
+            raster_phosphor(p, g->phosphor);
+        } else {
+            raster_trace(p, g->values, g->y_offset, pixel_span,
+                         (void *)img, (uint32_t)p->fg);
+        }
+        rtlock_release(&g->lock);
         g ++;
     }
+
+    XShmPutImage(p->server->display, p->window, p->gc, img, 0, 0, 0, 0,
+                 PLOT_WIDTH, PLOT_HEIGHT, False);
+}
+
+/* libplot has no bitmap primitive: the heatmap is drawn one point per
+ * lit cell, grouping the cells by level to limit the color changes. The
+ * histogram is scanned once, chaining the lit cells in a list per level
+ * (see plot::bucket). */
+static
+void draw_phosphor (plot_t *p, const uint16_t *hist)
+{
+    plPlotter *plot = p->handle;
+    uint32_t head[PLOT_PHOSPHOR_LEVELS];
+    uint32_t *next = p->bucket;
+    unsigned level;
+    uint32_t i;
+    XColor c;
+
+    for (level = 0; level < PLOT_PHOSPHOR_LEVELS; level ++) {
+        head[level] = PHOSPHOR_NIL;
+    }
+    for (i = 0; i < PLOT_WIDTH * PLOT_HEIGHT; i ++) {
+        if (hist[i]) {
+            level = phosphor_level(hist[i]);
+            next[i] = head[level];
+            head[level] = i;
+        }
+    }
+
+    for (level = 1; level < PLOT_PHOSPHOR_LEVELS; level ++) {
+        if (head[level] == PHOSPHOR_NIL) {
+            continue;
+        }
+        phosphor_color(&p->line, level, &c);
+        pl_pencolor_r(plot, c.red, c.green, c.blue);
+
+        for (i = head[level]; i != PHOSPHOR_NIL; i = next[i]) {
+            pl_point_r(plot,
+                       (i % PLOT_WIDTH) * (p->max_x - 1) / (PLOT_WIDTH - 1),
+                       raster_row_to_y(p, i / PLOT_WIDTH));
+        }
+    }
+    pl_pencolorname_r(plot, PLOT_LINECOLOR);
+}
+
+void plot_redraw(plot_t *p)
+{
+    size_t i, n;
+    plotgr_t *g;
+
+    if (p->image) {
+        raster_redraw(p);
+        return;
+    }
+
     pl_erase_r(p->handle);
+    g = p->graphics;
+    n = graphics_ready(p);
+    for (i = 0; i < n; i ++) {
+        rtlock_acquire(&g->lock);
+        take_stamp(g);
+        if (g->phosphor) {
+            draw_phosphor(p, g->phosphor);
+        } else {
+            draw_lines(p->handle, g->values, p->max_x,
+                       g->y_offset);
+        }
+        rtlock_release(&g->lock);
+        g ++;
+    }
+    pl_flushpl_r(p->handle);
+
+    /* Swap the back buffer on the window */
+    XCopyArea(p->server->display, p->buffer, p->window, p->gc, 0, 0,
+              PLOT_WIDTH, PLOT_HEIGHT, 0, 0);
+}
+
+/* The only event we care about is the window closing: just like libplot
+ * did with VANISH_ON_DELETE, the window gets hidden. */
+static
+void handle_events (plotsrv_t *srv)
+{
+    Display *d = srv->display;
+    XEvent ev;
+    int i;
+
+    while (XPending(d)) {
+        XNextEvent(d, &ev);
+        if (ev.type != ClientMessage ||
+                (Atom) ev.xclient.data.l[0] != srv->wm_delete) {
+            continue;
+        }
+        for (i = 0; i < srv->nplots; i ++) {
+            plot_t *p = srv->plots[i];
+
+            if (p->window == ev.xclient.window) {
+                XUnmapWindow(d, p->window);
+                p->hidden = 1;
+            }
+        }
+    }
+}
+
+/* Applies a pending plot_show() request */
+static
+void apply_request (plot_t *p)
+{
+    Display *d = p->server->display;
+
+    switch (__atomic_exchange_n(&p->request, PLOT_REQ_NONE,
+                                __ATOMIC_ACQ_REL)) {
+        case PLOT_REQ_SHOW:
+            if (p->hidden) {
+                XMapWindow(d, p->window);
+                p->hidden = 0;
+                p->dirty = 1;
+            }
+            break;
+        case PLOT_REQ_HIDE:
+            if (!p->hidden) {
+                XUnmapWindow(d, p->window);
+                p->hidden = 1;
+            }
+            break;
+    }
+}
+
+/* Records the age of the data which reached the screen during the
+ * previous redraw, which ended at now_ns. Each piece of data is accounted
+ * once, when it is first shown, so the histogram measures the
+ * capture-to-display latency and not the refresh rate of idle graphics.
+ * Called under the lock of the server, which protects the array of
+ * plots. */
+static
+void record_ages (plotsrv_t *srv, uint64_t now_ns)
+{
+    plotgr_t *g;
+    size_t n;
+    int i, j;
+
+    __atomic_store_n(&srv->age_seq, srv->age_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (i = 0; i < srv->nplots; i ++) {
+        g = srv->plots[i]->graphics;
+        n = graphics_ready(srv->plots[i]);
+        for (j = 0; j < n; j ++) {
+            if (g->drawn != 0) {
+                if (now_ns > g->drawn) {
+                    thrd_hist_add(&srv->age, now_ns - g->drawn);
+                    srv->age_sum += now_ns - g->drawn;
+                }
+                g->drawn = 0;
+            }
+            g ++;
+        }
+    }
+
+    __atomic_store_n(&srv->age_seq, srv->age_seq + 1, __ATOMIC_RELEASE);
+}
+
+void plotsrv_redraw (plotsrv_t *srv)
+{
+    int i;
+    int shm = 0;
+
+    struct timespec now;
+
+    rtlock_acquire(&srv->lock);
+    if (srv->shown_at) {
+        record_ages(srv, srv->shown_at);
+        srv->shown_at = 0;
+    }
+    handle_events(srv);
+    for (i = 0; i < srv->nplots; i ++) {
+        plot_t *p = srv->plots[i];
+
+        apply_request(p);
+        if (__atomic_exchange_n(&p->dirty, 0, __ATOMIC_ACQ_REL) &&
+                !p->hidden) {
+            plot_redraw(p);
+            __atomic_add_fetch(&srv->frames, 1, __ATOMIC_RELAXED);
+            shm |= p->image != NULL;
+        }
+    }
+    rtlock_release(&srv->lock);
+
+    /* With shared memory the image must not be touched until the server
+     * is done with it, so a round trip is needed only if some image got
+     * sent. This happens without the lock, which plot_new() would wait
+     * for: the ages are recorded at the next redraw. */
+    if (shm) {
+        XSync(srv->display, False);
+    } else {
+        XFlush(srv->display);
+    }
+    rtutils_get_now(&now);
+    srv->shown_at = rtutils_time2ns(&now);
+}
+
+uint64_t plotsrv_get_frames (const plotsrv_t *srv)
+{
+    return __atomic_load_n(&srv->frames, __ATOMIC_RELAXED);
+}
+
+uint64_t plotsrv_get_age (const plotsrv_t *srv, thrd_hist_t *age)
+{
+    uint32_t seq;
+    uint64_t sum;
+
+    do {
+        while ((seq = __atomic_load_n(&srv->age_seq, __ATOMIC_ACQUIRE)) & 1);
+        memcpy((void *)age, (const void *)&srv->age, sizeof(thrd_hist_t));
+        sum = srv->age_sum;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&srv->age_seq, __ATOMIC_RELAXED) != seq);
+
+    return sum;
+}
+
+void plot_show (plot_t *p, int shown)
+{
+    __atomic_store_n(&p->request, shown ? PLOT_REQ_SHOW : PLOT_REQ_HIDE,
+                     __ATOMIC_RELEASE);
 }
 
 void plot_graphic_set (plotgr_t *g, unsigned pos, int16_t val)
@@ -161,24 +857,150 @@ void plot_graphic_set (plotgr_t *g, unsigned pos, int16_t val)
 
     assert(pos < p->max_x);
 
-    pthread_mutex_lock(&g->lock);
+    rtlock_acquire(&g->lock);
     g->values[pos] = val;
-    pthread_mutex_unlock(&g->lock);
+    rtlock_release(&g->lock);
+    __atomic_store_n(&p->dirty, 1, __ATOMIC_RELEASE);
+}
+
+void plot_graphic_stamp (plotgr_t *g, uint64_t capture)
+{
+    rtlock_acquire(&g->lock);
+    g->stamp = capture;
+    rtlock_release(&g->lock);
 }
 
+int plot_graphic_persist (plotgr_t *g, unsigned decay)
+{
+    plot_t *p = g->main_plot;
+    void *hist;
+
+    assert(decay > 0 && decay < 16);
+    if (p->image == NULL && p->bucket == NULL) {
+        p->bucket = malloc(PLOT_WIDTH * PLOT_HEIGHT * sizeof(uint32_t));
+        if (p->bucket == NULL) {
+            return -1;
+        }
+    }
+    if (posix_memalign(&hist, sizeof(phosphor_vec_t),
+                       PLOT_PHOSPHOR_CELLS * sizeof(uint16_t))) {
+        return -1;
+    }
+    memset(hist, 0, PLOT_PHOSPHOR_CELLS * sizeof(uint16_t));
+
+    rtlock_acquire(&g->lock);
+    g->phosphor = (uint16_t *)hist;
+    g->decay = decay;
+    rtlock_release(&g->lock);
+
+    return 0;
+}
+
+/* Decay pass: each cell loses 1/2^shift of its intensity, rounded up,
+ * so that a cell which is not hit anymore eventually goes dark (the
+ * rounded down loss would be zero below 2^shift). The rounding bit is
+ * 1 when the low bits are not zero, and it is computed without a
+ * comparison to keep the loop vectorized. This runs on the whole
+ * histogram for every trace, so it works on vectors of cells (the
+ * histogram size is rounded up accordingly). */
+static
+void phosphor_decay (uint16_t *hist, unsigned shift)
+{
+    phosphor_vec_t *v = (phosphor_vec_t *)hist;
+    const uint16_t mask = (1 << shift) - 1;
+    size_t i;
+
+    for (i = 0; i < PLOT_PHOSPHOR_CELLS / PHOSPHOR_VEC_LEN; i ++) {
+        v[i] -= (v[i] >> shift) + (((v[i] & mask) + mask) >> shift);
+    }
+}
+
+void plot_graphic_commit (plotgr_t *g)
+{
+    plot_t *p = g->main_plot;
+
+    if (g->phosphor) {
+        rtlock_acquire(&g->lock);
+        phosphor_decay(g->phosphor, g->decay);
+        raster_trace(p, g->values, g->y_offset, phosphor_span,
+                     (void *)g->phosphor, PLOT_PHOSPHOR_HIT);
+        rtlock_release(&g->lock);
+    }
+    __atomic_store_n(&p->dirty, 1, __ATOMIC_RELEASE);
+}
+
+/* Horizontal mapping of a scatter point: the x axis covers a square
+ * region, centered in the window, as high as the slot of a graphic. */
+static inline
+int scatter_column (const plot_t *p, int16_t x)
+{
+    const int side = PLOT_HEIGHT / p->ngraphics;
+    const int left = (PLOT_WIDTH - side) / 2;
+
+    return left + ((int32_t)x - INT16_MIN) * (side - 1) / UINT16_MAX;
+}
+
+void plot_graphic_scatter (plotgr_t *g, const int16_t xy[], size_t npoints)
+{
+    plot_t *p = g->main_plot;
+    uint16_t *hist = g->phosphor;
+    uint32_t v;
+    uint16_t *cell;
+    size_t i;
+
+    assert(hist != NULL);
+
+    rtlock_acquire(&g->lock);
+    phosphor_decay(hist, g->decay);
+    for (i = 0; i < npoints; i ++) {
+        cell = hist + raster_row(p, xy[1] + g->y_offset) * PLOT_WIDTH
+               + scatter_column(p, xy[0]);
+        v = *cell + PLOT_SCATTER_HIT;
+        *cell = v > UINT16_MAX ? UINT16_MAX : v;
+        xy += 2;
+    }
+    rtlock_release(&g->lock);
+    __atomic_store_n(&p->dirty, 1, __ATOMIC_RELEASE);
+}
+
+static
 void plot_destroy (plot_t *p)
 {
     int i;
     plotgr_t *graphics;
+    Display *d = p->server->display;
 
-    pl_closepl_r(p->handle);
-    pl_deletepl_r(p->handle);
+    if (p->image) {
+        XShmDetach(d, &p->shminfo);
+        XDestroyImage(p->image);
+        shmdt(p->shminfo.shmaddr);
+    } else {
+        pl_closepl_r(p->handle);
+        pl_deletepl_r(p->handle);
+        XFreePixmap(d, p->buffer);
+        free(p->bucket);
+    }
+    XFreeGC(d, p->gc);
+    XDestroyWindow(d, p->window);
     graphics = p->graphics;
     for (i = 0; i < p->used; i ++) {
-        pthread_mutex_destroy(&graphics[i].lock);
+        rtlock_destroy(&graphics[i].lock);
         free(graphics[i].values);
+        free(graphics[i].phosphor);
     }
     free(p->graphics);
     free(p);
 }
 
+void plotsrv_destroy (plotsrv_t *srv)
+{
+    int i;
+
+    for (i = 0; i < srv->nplots; i ++) {
+        plot_destroy(srv->plots[i]);
+    }
+    free(srv->plots);
+    rtlock_destroy(&srv->lock);
+    XCloseDisplay(srv->display);
+    free(srv);
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dacav/dacav.h>
+
+#include "headers/rtlock.h"
+#include "headers/rtutils.h"
+#include "headers/thrd.h"
+#include "headers/logging.h"
+
+static int instrument;
+
+/* Instrumented locks, protected by registry_lock. */
+static dlist_t *registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline
+uint64_t now_ns (void)
+{
+    struct timespec t;
+
+    rtutils_get_now(&t);
+    return rtutils_time2ns(&t);
+}
+
+void rtlock_instrument (int enable)
+{
+    instrument = enable;
+}
+
+void rtlock_init (rtlock_t *lock, const char *name)
+{
+    pthread_mutexattr_t attr;
+    int err;
+
+    memset(lock, 0, sizeof(rtlock_t));
+    lock->name = name;
+    lock->instrumented = instrument;
+
+    err = pthread_mutexattr_init(&attr);
+    assert(err == 0);
+    err = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    assert(err == 0);
+    err = pthread_mutex_init(&lock->mux, &attr);
+    assert(err == 0);
+    pthread_mutexattr_destroy(&attr);
+
+    if (lock->instrumented) {
+        pthread_mutex_lock(&registry_lock);
+        if (registry == NULL) {
+            registry = dlist_new();
+        }
+        registry = dlist_append(registry, (void *) lock);
+        pthread_mutex_unlock(&registry_lock);
+    }
+}
+
+void rtlock_destroy (rtlock_t *lock)
+{
+    diter_t *i;
+
+    if (lock->instrumented) {
+        pthread_mutex_lock(&registry_lock);
+        i = dlist_iter_new(&registry);
+        while (diter_hasnext(i)) {
+            if (diter_next(i) == lock) {
+                diter_remove(i, NULL);
+                break;
+            }
+        }
+        dlist_iter_free(i);
+        pthread_mutex_unlock(&registry_lock);
+    }
+    pthread_mutex_destroy(&lock->mux);
+}
+
+void rtlock_acquire (rtlock_t *lock)
+{
+    uint64_t start, wait;
+    rtlock_stats_t *stats;
+
+    /* The uncontended case costs at most a single clock reading */
+    stats = &lock->stats;
+    if (pthread_mutex_trylock(&lock->mux) == 0) {
+        if (lock->instrumented) {
+            lock->taken = now_ns();
+            stats->acquisitions ++;
+        }
+        return;
+    }
+
+    /* Waits are traced even without instrumentation */
+    start = now_ns();
+    pthread_mutex_lock(&lock->mux);
+    lock->taken = now_ns();
+    wait = lock->taken - start;
+    thrd_trace(THRD_EVENT_LOCK, wait);
+
+    if (!lock->instrumented) {
+        return;
+    }
+
+    stats->acquisitions ++;
+    stats->contentions ++;
+    stats->wait_total += wait;
+    if (wait > stats->wait_max) {
+        stats->wait_max = wait;
+    }
+}
+
+void rtlock_release (rtlock_t *lock)
+{
+    uint64_t hold;
+    rtlock_stats_t *stats;
+
+    if (lock->instrumented) {
+        stats = &lock->stats;
+        hold = now_ns() - lock->taken;
+        stats->hold_total += hold;
+        if (hold > stats->hold_max) {
+            stats->hold_max = hold;
+        }
+    }
+    pthread_mutex_unlock(&lock->mux);
+}
+
+/* Sums the statistics of a lock to the given ones */
+static
+void merge (rtlock_stats_t *sum, rtlock_t *lock)
+{
+    rtlock_stats_t s;
+
+    pthread_mutex_lock(&lock->mux);
+    memcpy(&s, &lock->stats, sizeof(rtlock_stats_t));
+    pthread_mutex_unlock(&lock->mux);
+
+    sum->acquisitions += s.acquisitions;
+    sum->contentions += s.contentions;
+    sum->wait_total += s.wait_total;
+    sum->hold_total += s.hold_total;
+    if (s.wait_max > sum->wait_max) sum->wait_max = s.wait_max;
+    if (s.hold_max > sum->hold_max) sum->hold_max = s.hold_max;
+}
+
+static
+void show (const char *name, unsigned nlocks, const rtlock_stats_t *s)
+{
+    if (nlocks > 1) {
+        LOG_FMT("\tLocks '%s' (%u instances):", name, nlocks);
+    } else {
+        LOG_FMT("\tLock '%s':", name);
+    }
+    if (s->acquisitions == 0) {
+        LOG_MSG("\t\tNever acquired");
+        return;
+    }
+    LOG_FMT("\t\tAcquisitions:                   %10llu",
+            (unsigned long long) s->acquisitions);
+    LOG_FMT("\t\tContentions:                    %10llu",
+            (unsigned long long) s->contentions);
+    LOG_FMT("\t\tAvg / max wait (ns):            %10llu %10llu",
+            (unsigned long long) (s->contentions
+                                  ? s->wait_total / s->contentions : 0),
+            (unsigned long long) s->wait_max);
+    LOG_FMT("\t\tAvg / max hold (ns):            %10llu %10llu",
+            (unsigned long long) (s->hold_total / s->acquisitions),
+            (unsigned long long) s->hold_max);
+    LOG_MSG("");
+}
+
+void rtlock_report (void)
+{
+    diter_t *i, *j;
+    rtlock_stats_t sum;
+    unsigned nlocks;
+
+    pthread_mutex_lock(&registry_lock);
+    i = dlist_iter_new(&registry);
+    while (diter_hasnext(i)) {
+        rtlock_t *lock = (rtlock_t *) diter_next(i);
+        int first = 1;
+
+        /* Only the first lock having a name reports for all of them */
+        j = dlist_iter_new(&registry);
+        while (diter_hasnext(j)) {
+            rtlock_t *other = (rtlock_t *) diter_next(j);
+
+            if (other == lock) break;
+            if (strcmp(other->name, lock->name) == 0) {
+                first = 0;
+                break;
+            }
+        }
+        dlist_iter_free(j);
+        if (!first) continue;
+
+        memset(&sum, 0, sizeof(rtlock_stats_t));
+        nlocks = 0;
+        j = dlist_iter_new(&registry);
+        while (diter_hasnext(j)) {
+            rtlock_t *other = (rtlock_t *) diter_next(j);
+
+            if (strcmp(other->name, lock->name) == 0) {
+                merge(&sum, other);
+                nlocks ++;
+            }
+        }
+        dlist_iter_free(j);
+        show(lock->name, nlocks, &sum);
+    }
+    dlist_iter_free(i);
+    pthread_mutex_unlock(&registry_lock);
+}
@@ -21,12 +21,14 @@
 #include <signal.h>
 #include <alsa/asoundlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "headers/sampthread.h"
 #include "headers/logging.h"
 #include "headers/constants.h"
 #include "headers/rtutils.h"
+#include "headers/rtlock.h"
 
 /* Sampling thread internal information set. */
 struct sampth_data {
@@ -35,8 +37,11 @@ struct sampth_data {
     alsagw_frame_t * buffer;              /* Reading buffer; */
     snd_pcm_uframes_t slot_size;        /* Size of a sample; */
     size_t nslots;                      /* Room for samples; */
+    uint64_t *stamps;                   /* Capture time of each slot; */
     unsigned slot;                      /* Slot cursor; */
-    pthread_mutex_t mux;                /* Mutex protecting the cursor; */
+    uint64_t nfilled;                   /* Slots filled so far; */
+    rtlock_t mux;                       /* Lock protecting the cursor; */
+    unsigned rate;                      /* Nominal rate of the sampler; */
 
     /* Sometimes alsa has tantrums and issues EAGAIN on reading (despite
      * this is not documented anywere, LOL). In this case we wait up to
@@ -55,12 +60,31 @@ int destroy_cb (void *arg)
 {
     struct sampth_data *ctx = (struct sampth_data *) arg;
 
-    pthread_mutex_destroy(&ctx->mux);
+    rtlock_destroy(&ctx->mux);
     free((void *)ctx->buffer);
+    free(ctx->stamps);
 
     return 0;
 }
 
+/* Capture time of the last frame just read: the frames still waiting in
+ * the capture buffer came after it. */
+static
+uint64_t capture_time (const struct sampth_data *ctx)
+{
+    struct timespec now;
+    alsagw_stats_t stats;
+    uint64_t ns;
+
+    rtutils_get_now(&now);
+    alsagw_get_stats(ctx->sampler, &stats);
+    ns = rtutils_time2ns(&now);
+    if (ctx->rate > 0) {
+        ns -= stats.backlog * 1000000000ULL / ctx->rate;
+    }
+    return ns;
+}
+
 /* Core of the sampling */
 static
 int thread_cb (void *arg)
@@ -69,12 +93,17 @@ int thread_cb (void *arg)
     unsigned slot;
     int nread;
 
-    pthread_mutex_lock(&ctx->mux);
+    rtlock_acquire(&ctx->mux);
     slot = ctx->slot;
     nread = alsagw_read(ctx->sampler, ctx->buffer + slot * ctx->slot_size,
                       ctx->slot_size, ctx->alsa_wait_max);
+    /* On failure the slot keeps the old data, and so its old stamp */
+    if (nread > 0) {
+        ctx->stamps[slot] = capture_time(ctx);
+    }
     ctx->slot = (slot + 1) % ctx->nslots;
-    pthread_mutex_unlock(&ctx->mux);
+    ctx->nfilled ++;
+    rtlock_release(&ctx->mux);
 
     if (nread <= 0) {
         LOG_FMT("Alsa fails: %s", snd_strerror(nread));
@@ -86,16 +115,21 @@ int thread_cb (void *arg)
 const thrd_rtstats_t * sampth_subscribe (genth_t **handler,
                                          thrd_pool_t *pool,
                                          alsagw_t *samp,
-                                         size_t scaling_factor)
+                                         size_t scaling_factor,
+                                         thrd_wake_t wake)
 {
     thrd_info_t thi;
     struct sampth_data *ctx;
     const struct timespec * period;
     const thrd_rtstats_t * err;
 
+    memset(&thi, 0, sizeof(thrd_info_t));
     thi.init = NULL;
     thi.callback = thread_cb;
     thi.destroy = destroy_cb;
+    thi.name = "Sampling";
+    thi.stack_size = TASK_STACK_SIZE;
+    thi.wake = wake;
 
     /* Note: the thread is in charge of freeing this before shutting
      *       down, unless everything fails on genth_subscribe().
@@ -110,8 +144,11 @@ const thrd_rtstats_t * sampth_subscribe (genth_t **handler,
     ctx->slot_size = alsagw_get_nframes(samp);
     ctx->buffer = (alsagw_frame_t *) calloc(scaling_factor * ctx->slot_size,
                                           sizeof(alsagw_frame_t));
+    ctx->stamps = (uint64_t *) calloc(scaling_factor, sizeof(uint64_t));
+    assert(ctx->buffer && ctx->stamps);
     ctx->slot = 0;
-    pthread_mutex_init(&ctx->mux, NULL);
+    ctx->rate = alsagw_get_rate(samp);
+    rtlock_init(&ctx->mux, "Sampling buffer");
 
     thi.delay.tv_sec = SAMP_STARTUP_DELAY_SEC;
     thi.delay.tv_nsec = SAMP_STARTUP_DELAY_nSEC;
@@ -129,8 +166,8 @@ const thrd_rtstats_t * sampth_subscribe (genth_t **handler,
     /* Period request for the thread pool */
     rtutils_time_copy(&thi.period, period);
 
+    /* On failure destroy_cb() released the buffers */
     if ((err = genth_subscribe(handler, pool, &thi)) == 0) {
-        free(ctx->buffer);
         free(ctx);
     }
     return err;
@@ -142,15 +179,17 @@ snd_pcm_uframes_t sampth_get_size (const genth_t *handler)
     return ctx->slot_size * ctx->nslots;
 }
 
-void sampth_get_samples (genth_t *handler, alsagw_frame_t buffer[])
+uint64_t sampth_get_samples (genth_t *handler, alsagw_frame_t buffer[])
 {
     struct sampth_data *ctx = genth_get_context(handler);
     const size_t sls = ctx->slot_size;
     unsigned slot;
     snd_pcm_uframes_t nframes;
+    uint64_t stamp;
 
-    pthread_mutex_lock(&ctx->mux);
+    rtlock_acquire(&ctx->mux);
     slot = ctx->slot;
+    stamp = ctx->stamps[(slot + ctx->nslots - 1) % ctx->nslots];
     nframes = sls * (ctx->nslots - slot);
     memcpy((void *)buffer,
            (const void *)&ctx->buffer[sls * slot],
@@ -158,7 +197,42 @@ void sampth_get_samples (genth_t *handler, alsagw_frame_t buffer[])
     memcpy((void *)(buffer + nframes),
            (const void *)ctx->buffer,
            sizeof(alsagw_frame_t) * sls * slot);
-    pthread_mutex_unlock(&ctx->mux);
+    rtlock_release(&ctx->mux);
+
+    return stamp;
+}
+
+uint64_t sampth_get_fresh (genth_t *handler, alsagw_frame_t buffer[],
+                           uint64_t *seen, snd_pcm_uframes_t *nframes)
+{
+    struct sampth_data *ctx = genth_get_context(handler);
+    const size_t sls = ctx->slot_size;
+    uint64_t fresh, stamp;
+    unsigned slot, first, tail;
+
+    rtlock_acquire(&ctx->mux);
+    slot = ctx->slot;
+    stamp = ctx->stamps[(slot + ctx->nslots - 1) % ctx->nslots];
+
+    /* The slots overwritten meanwhile are lost */
+    fresh = ctx->nfilled - *seen;
+    if (fresh > ctx->nslots) {
+        fresh = ctx->nslots;
+    }
+    *seen = ctx->nfilled;
+
+    first = (slot + ctx->nslots - fresh) % ctx->nslots;
+    tail = first + fresh > ctx->nslots ? ctx->nslots - first : fresh;
+    memcpy((void *)buffer,
+           (const void *)&ctx->buffer[sls * first],
+           sizeof(alsagw_frame_t) * sls * tail);
+    memcpy((void *)(buffer + sls * tail),
+           (const void *)ctx->buffer,
+           sizeof(alsagw_frame_t) * sls * (fresh - tail));
+    rtlock_release(&ctx->mux);
+
+    *nframes = sls * fresh;
+    return stamp;
 }
 
 const struct timespec * sampth_get_period (const genth_t *handler)
@@ -19,6 +19,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "headers/signal_show.h"
 #include "headers/logging.h"
@@ -53,13 +54,18 @@ int thread_cb (void *arg)
     unsigned i;
     struct signth_data *ctx = (struct signth_data *)arg;
     alsagw_frame_t *buffer;
+    uint64_t stamp;
 
     buffer = ctx->buffer;
-    sampth_get_samples(ctx->sampth, buffer);
+    stamp = sampth_get_samples(ctx->sampth, buffer);
     for (i = 0; i < ctx->buflen; i ++) {
         plot_graphic_set(ctx->g0, i, buffer[i].ch0);
         plot_graphic_set(ctx->g1, i, buffer[i].ch1);
     }
+    plot_graphic_stamp(ctx->g0, stamp);
+    plot_graphic_stamp(ctx->g1, stamp);
+    plot_graphic_commit(ctx->g0);
+    plot_graphic_commit(ctx->g1);
 
     return 0;
 }
@@ -72,11 +78,13 @@ const thrd_rtstats_t * signth_subscribe (genth_t **handle,
 {
     struct signth_data *ctx;
     thrd_info_t thi;
-    const thrd_rtstats_t * err;
 
+    memset(&thi, 0, sizeof(thrd_info_t));
     thi.init = NULL;
     thi.callback = thread_cb;
     thi.destroy = destroy_cb;
+    thi.name = "Signal show";
+    thi.stack_size = TASK_STACK_SIZE;
 
     ctx = (struct signth_data *) calloc(1, sizeof(struct signth_data));
     assert(ctx);
@@ -92,6 +100,9 @@ const thrd_rtstats_t * signth_subscribe (genth_t **handle,
     rtutils_time_increment(&thi.delay, sampth_get_period(sampth));
     rtutils_time_copy(&thi.period, &thi.delay);
 
+    /* Late activations would plot the same buffer again */
+    thi.overrun = THRD_OVERRUN_SKIP;
+
     ctx->buflen = sampth_get_size(sampth);
     ctx->buffer = calloc(ctx->buflen, sizeof(alsagw_frame_t));
     assert(ctx->buffer);
@@ -100,10 +111,7 @@ const thrd_rtstats_t * signth_subscribe (genth_t **handle,
     ctx->g1 = g1;
     ctx->sampth = sampth;
 
-    if ((err = genth_subscribe(handle, pool, &thi)) == NULL) {
-        free(ctx->buffer);
-        free(ctx);
-    }
-    return err;
+    /* On failure the context is released by destroy_cb() */
+    return genth_subscribe(handle, pool, &thi);
 }
 
@@ -0,0 +1,609 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Offline simulator: replays the execution times recorded in a trace of
+ * soto (see thrd_trace_dump()) on the scheduling policies of the thread
+ * pool (see thrd_simulate()). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <getopt.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "headers/config.h"
+#include "headers/thrd.h"
+#include "headers/rtutils.h"
+#include "headers/logging.h"
+
+/* Exit status when the simulation predicts deadline misses, or the
+ * schedulability test refuses the task set */
+#define SIM_EXIT_MISSES     2
+
+/* Default simulated time (s) */
+#define SIM_DEFAULT_LENGTH  60
+
+/* A task of the simulation */
+struct task {
+    char *name;
+    unsigned tid;               /* Track in the trace; */
+    uint64_t period;            /* Period (ns); */
+    uint64_t deadline;          /* Relative deadline (ns); */
+    thrd_overrun_t overrun;     /* Overrun policy; */
+    unsigned catchup;           /* Late activations kept; */
+
+    uint64_t *samples;          /* Recorded execution times (ns); */
+    size_t nsamples;
+    size_t size;                /* Room in samples; */
+    size_t cursor;              /* Next sample to be replayed; */
+    double scale;               /* Factor for the execution times; */
+
+    const thrd_rtstats_t *stats;
+};
+
+struct sim {
+    struct task *tasks;
+    unsigned ntasks;
+
+    thrd_policy_t policy;
+    bool partition;
+    unsigned cpus;
+    unsigned length;            /* Simulated time (s); */
+    bool shuffle;               /* Draw the samples at random; */
+    unsigned seed;
+
+    const char **scales;        /* --scale arguments; */
+    unsigned nscales;
+    const char **adds;          /* --add arguments; */
+    unsigned nadds;
+};
+
+/* The samples are drawn by the pool, which has no room for this */
+static struct sim *current;
+
+static const char optstring[] = "S:C::c:t:s:a:R:h";
+static const struct option longopts[] = {
+    {"sched", 1, NULL, 'S'},
+    {"partition", 2, NULL, 'C'},
+    {"cpus", 1, NULL, 'c'},
+    {"sim-for", 1, NULL, 't'},
+    {"scale", 1, NULL, 's'},
+    {"add", 1, NULL, 'a'},
+    {"random", 1, NULL, 'R'},
+    {"help", 0, NULL, 'h'},
+    {0, 0, 0, 0}
+};
+
+static const char help [] =
+"\n" PACKAGE_STRING " - schedulability simulator\n"
+"Usage: %s [options] {trace}\n\n"
+"  Replays the execution times recorded in a trace written by soto\n"
+"  --trace, and reports the deadline misses and the response times the\n"
+"  threads would have.\n\n"
+"  --sched={rm|edf|cyclic} | -S {rm|edf|cyclic}\n"
+"        Scheduling policy: Rate Monotonic priorities, Earliest Deadline\n"
+"        First, or a cyclic executive running all the tasks on a single\n"
+"        thread (default: rm);\n\n"
+"  --partition[={bool}] | -C [{bool}]\n"
+"        Pin each task on a single CPU, placing them first-fit by\n"
+"        decreasing utilization. Allowed only with --sched=rm\n"
+"        (default: no);\n\n"
+"  --cpus={n} | -c {n}\n"
+"        Number of CPUs of the simulated machine (default: 1);\n\n"
+"  --sim-for={time in seconds} | -t {time in seconds}\n"
+"        Simulated time (default: 60);\n\n"
+"  --scale=[{task}:]{factor} | -s [{task}:]{factor}\n"
+"        Multiply the execution times of the given task, or of all the\n"
+"        tasks, by the given factor. Can be repeated;\n\n"
+"  --add={name}:{period in us}:{task}[:{factor}]\n"
+"  | -a {name}:{period in us}:{task}[:{factor}]\n"
+"        Add a task having the given period, and the execution times of\n"
+"        the given task multiplied by the factor (default: 1). Can be\n"
+"        repeated;\n\n"
+"  --random={seed} | -R {seed}\n"
+"        Draw the execution times at random among the recorded ones,\n"
+"        instead of replaying them in order;\n\n"
+"  --help  | -h\n"
+"        Print this help.\n";
+
+static
+void print_help (const char *progname)
+{
+    fprintf(stderr, help, progname);
+}
+
+static
+bool to_bool (const char *arg, bool *val)
+{
+    if (arg == NULL || strcasecmp(arg, "yes") == 0 ||
+            strcasecmp(arg, "y") == 0 || strcasecmp(arg, "true") == 0 ||
+            strcmp(arg, "1") == 0) {
+        *val = true;
+        return true;
+    }
+    if (strcasecmp(arg, "no") == 0 || strcasecmp(arg, "n") == 0 ||
+            strcasecmp(arg, "false") == 0 || strcmp(arg, "0") == 0) {
+        *val = false;
+        return true;
+    }
+    return false;
+}
+
+/* Returns the index of the trace argument, or -1 on error */
+static
+int parse (struct sim *s, int argc, char * const argv[])
+{
+    extern char *optarg;
+    extern int optind;
+    unsigned val;
+    int opt;
+
+    s->policy = THRD_POLICY_RM;
+    s->cpus = 1;
+    s->length = SIM_DEFAULT_LENGTH;
+    s->scales = (const char **) calloc(argc, sizeof(const char *));
+    s->adds = (const char **) calloc(argc, sizeof(const char *));
+    assert(s->scales && s->adds);
+
+    while ((opt = getopt_long(argc, argv, optstring, longopts, NULL))
+           != -1) {
+        switch (opt) {
+            case 'S':
+                if (strcasecmp(optarg, "rm") == 0) {
+                    s->policy = THRD_POLICY_RM;
+                } else if (strcasecmp(optarg, "edf") == 0) {
+                    s->policy = THRD_POLICY_EDF;
+                } else if (strcasecmp(optarg, "cyclic") == 0) {
+                    s->policy = THRD_POLICY_CYCLIC;
+                } else {
+                    fprintf(stderr, "%s: invalid policy: '%s'\n", argv[0],
+                            optarg);
+                    return -1;
+                }
+                break;
+            case 'C':
+                if (!to_bool(optarg, &s->partition)) {
+                    fprintf(stderr, "%s: cannot evaluate '%s' as bool\n",
+                            argv[0], optarg);
+                    return -1;
+                }
+                break;
+            case 'c':
+                if (sscanf(optarg, "%u", &val) != 1 || val == 0 ||
+                        val > CPU_SETSIZE) {
+                    fprintf(stderr, "%s: invalid CPUs: '%s'\n", argv[0],
+                            optarg);
+                    return -1;
+                }
+                s->cpus = val;
+                break;
+            case 't':
+                if (sscanf(optarg, "%u", &val) != 1 || val == 0) {
+                    fprintf(stderr, "%s: invalid time: '%s'\n", argv[0],
+                            optarg);
+                    return -1;
+                }
+                s->length = val;
+                break;
+            case 's':
+                s->scales[s->nscales ++] = optarg;
+                break;
+            case 'a':
+                s->adds[s->nadds ++] = optarg;
+                break;
+            case 'R':
+                if (sscanf(optarg, "%u", &s->seed) != 1) {
+                    fprintf(stderr, "%s: invalid seed: '%s'\n", argv[0],
+                            optarg);
+                    return -1;
+                }
+                s->shuffle = true;
+                break;
+            case 'h':
+            default:
+                print_help(argv[0]);
+                return -1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "%s: a trace is required\n", argv[0]);
+        print_help(argv[0]);
+        return -1;
+    }
+    return optind;
+}
+
+static
+struct task * find_task (struct sim *s, const char *name, unsigned tid)
+{
+    unsigned k;
+
+    for (k = 0; k < s->ntasks; k ++) {
+        if (name ? strcmp(s->tasks[k].name, name) == 0
+                 : s->tasks[k].tid == tid) {
+            return &s->tasks[k];
+        }
+    }
+    return NULL;
+}
+
+static
+struct task * new_task (struct sim *s)
+{
+    struct task *t;
+
+    s->tasks = (struct task *) realloc(s->tasks, (s->ntasks + 1) *
+                                                 sizeof(struct task));
+    assert(s->tasks);
+    t = &s->tasks[s->ntasks ++];
+    memset(t, 0, sizeof(struct task));
+    t->scale = 1.0;
+    return t;
+}
+
+static
+void add_sample (struct task *t, uint64_t exec)
+{
+    if (t->nsamples == t->size) {
+        t->size = t->size ? t->size * 2 : 256;
+        t->samples = (uint64_t *) realloc(t->samples,
+                                          t->size * sizeof(uint64_t));
+        assert(t->samples);
+    }
+    t->samples[t->nsamples ++] = exec;
+}
+
+/* Numeric field of a trace record */
+static
+bool field_u64 (const char *record, const char *key, uint64_t *val)
+{
+    char pattern[32];
+    const char *p;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    if (record == NULL || (p = strstr(record, pattern)) == NULL) {
+        return false;
+    }
+    return sscanf(p + strlen(pattern), "%" SCNu64, val) == 1;
+}
+
+/* String field of a trace record, newly allocated */
+static
+char * field_str (const char *record, const char *key)
+{
+    char pattern[32];
+    const char *p, *end;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    if (record == NULL || (p = strstr(record, pattern)) == NULL) {
+        return NULL;
+    }
+    p += strlen(pattern);
+    if ((end = strchr(p, '"')) == NULL) {
+        return NULL;
+    }
+    return strndup(p, end - p);
+}
+
+/* Track of a thread: name and timing parameters */
+static
+bool load_track (struct sim *s, const char *record)
+{
+    const char *args = strstr(record, "\"args\":");
+    struct task *t;
+    uint64_t tid, catchup = 0;
+    char *overrun;
+
+    t = new_task(s);
+    if (!field_u64(record, "tid", &tid) ||
+            (t->name = field_str(args, "name")) == NULL ||
+            !field_u64(args, "period_ns", &t->period) ||
+            !field_u64(args, "deadline_ns", &t->deadline)) {
+        return false;
+    }
+    t->tid = (unsigned) tid;
+    field_u64(args, "catchup", &catchup);
+    t->catchup = (unsigned) catchup;
+
+    t->overrun = THRD_OVERRUN_CATCHUP;
+    if ((overrun = field_str(args, "overrun")) != NULL) {
+        if (strcmp(overrun, "skip") == 0) {
+            t->overrun = THRD_OVERRUN_SKIP;
+        } else if (strcmp(overrun, "degrade") == 0) {
+            t->overrun = THRD_OVERRUN_DEGRADE;
+        }
+        free(overrun);
+    }
+    return true;
+}
+
+/* The trace is written one record per line. Activations are the slices
+ * having an execution time, the other slices are lock waits. */
+static
+bool load_trace (struct sim *s, const char *path)
+{
+    FILE *in;
+    char *line = NULL;
+    size_t len = 0;
+    uint64_t tid, exec;
+    struct task *t;
+    bool ok = true;
+
+    if ((in = fopen(path, "r")) == NULL) {
+        ERR_FMT("Cannot open '%s': %s", path, strerror(errno));
+        return false;
+    }
+    while (ok && getline(&line, &len, in) != -1) {
+        if (strstr(line, "\"name\":\"thread_name\"")) {
+            if (!load_track(s, line)) {
+                ERR_FMT("'%s': track without period, was the trace written"
+                        " by " PACKAGE_STRING "?", path);
+                ok = false;
+            }
+        } else if (strstr(line, "\"ph\":\"X\"") &&
+                field_u64(line, "exec_ns", &exec) &&
+                field_u64(line, "tid", &tid)) {
+            if ((t = find_task(s, NULL, (unsigned) tid)) != NULL) {
+                add_sample(t, exec);
+            }
+        }
+    }
+    free(line);
+    fclose(in);
+    return ok;
+}
+
+/* Applies the --scale arguments */
+static
+bool apply_scales (struct sim *s)
+{
+    char name[128];
+    double factor;
+    struct task *t;
+    unsigned k, j;
+
+    for (k = 0; k < s->nscales; k ++) {
+        const char *arg = s->scales[k];
+
+        if (sscanf(arg, "%127[^:]:%lf", name, &factor) == 2) {
+            if ((t = find_task(s, name, 0)) == NULL) {
+                ERR_FMT("Unknown task '%s'", name);
+                return false;
+            }
+            t->scale *= factor;
+        } else if (sscanf(arg, "%lf", &factor) == 1) {
+            for (j = 0; j < s->ntasks; j ++) {
+                s->tasks[j].scale *= factor;
+            }
+        } else {
+            ERR_FMT("Invalid scale '%s'", arg);
+            return false;
+        }
+        if (factor <= 0) {
+            ERR_FMT("Invalid scale '%s'", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Applies the --add arguments */
+static
+bool apply_adds (struct sim *s)
+{
+    char name[128], source[128];
+    unsigned period;
+    double factor;
+    struct task *t, *src, copy;
+    unsigned k;
+    int n;
+
+    for (k = 0; k < s->nadds; k ++) {
+        const char *arg = s->adds[k];
+
+        factor = 1.0;
+        n = sscanf(arg, "%127[^:]:%u:%127[^:]:%lf", name, &period, source,
+                   &factor);
+        if (n < 3 || period == 0 || factor <= 0) {
+            ERR_FMT("Invalid task '%s'", arg);
+            return false;
+        }
+        if ((src = find_task(s, source, 0)) == NULL) {
+            ERR_FMT("Unknown task '%s'", source);
+            return false;
+        }
+
+        /* The source may move, being in the same array */
+        memcpy(&copy, src, sizeof(struct task));
+        t = new_task(s);
+        t->name = strdup(name);
+        t->samples = (uint64_t *) malloc((copy.nsamples + 1) *
+                                         sizeof(uint64_t));
+        assert(t->name && t->samples);
+        memcpy(t->samples, copy.samples, copy.nsamples * sizeof(uint64_t));
+        t->nsamples = t->size = copy.nsamples;
+        t->period = t->deadline = (uint64_t) period * 1000;
+        t->overrun = copy.overrun;
+        t->catchup = copy.catchup;
+        t->scale = factor * copy.scale;
+    }
+    return true;
+}
+
+/* Execution time of the next activation of a task (see thrd_exec_cb_t) */
+static
+uint64_t next_exec (void *context)
+{
+    struct task *t = (struct task *) context;
+    uint64_t exec;
+
+    if (current->shuffle) {
+        exec = t->samples[rand_r(&current->seed) % t->nsamples];
+    } else {
+        exec = t->samples[t->cursor];
+        t->cursor = (t->cursor + 1) % t->nsamples;
+    }
+    return (uint64_t) (exec * t->scale);
+}
+
+/* The simulated threads never run */
+static
+int no_callback (void *context)
+{
+    return 1;
+}
+
+static
+uint64_t worst_sample (const struct task *t)
+{
+    uint64_t worst = 0;
+    size_t k;
+
+    for (k = 0; k < t->nsamples; k ++) {
+        if (t->samples[k] > worst) worst = t->samples[k];
+    }
+    return (uint64_t) (worst * t->scale);
+}
+
+static
+void show_percentiles (const char *what, const thrd_hist_t *hist)
+{
+    LOG_FMT("\t\t%s (ns):", what);
+    LOG_FMT("\t\t\tp50 %10llu  p90 %10llu  p99 %10llu  p99.9 %10llu",
+            (unsigned long long) thrd_hist_percentile(hist, 50),
+            (unsigned long long) thrd_hist_percentile(hist, 90),
+            (unsigned long long) thrd_hist_percentile(hist, 99),
+            (unsigned long long) thrd_hist_percentile(hist, 99.9));
+}
+
+/* Returns the number of deadline misses */
+static
+uint64_t show_task (const struct task *t)
+{
+    thrd_rtstats_t rts;
+
+    thrd_rtstats_snapshot(t->stats, &rts);
+
+    LOG_FMT("\tPrediction for task '%s':", t->name);
+    LOG_FMT("\t\tPeriod (ns):                    %10llu",
+            (unsigned long long) t->period);
+    LOG_FMT("\t\tRecorded activations:           %10llu",
+            (unsigned long long) t->nsamples);
+    if (rts.n_executions == 0) {
+        LOG_MSG("\t\tNever activated");
+        return 0;
+    }
+    LOG_FMT("\t\tNumber of executions:           %10llu",
+            (unsigned long long) rts.n_executions);
+    LOG_FMT("\t\tNumber of deadline misses:      %10llu",
+            (unsigned long long) rts.dmiss_count);
+    LOG_FMT("\t\tDeadline miss ratio (%%)         %10G",
+            100 * (double) rts.dmiss_count / rts.n_executions);
+    LOG_FMT("\t\tNumber of skipped activations:  %10llu",
+            (unsigned long long) rts.skip_count);
+    LOG_FMT("\t\tAvg execution time (ns):        %10llu",
+            (unsigned long long) (rts.exec_times / rts.n_executions));
+    LOG_FMT("\t\tAvg response time (ns):         %10llu",
+            (unsigned long long) (rts.response_times / rts.n_executions));
+    LOG_FMT("\t\tWorst case response time (ns):  %10llu",
+            (unsigned long long) rts.wcrt);
+    show_percentiles("Response time", &rts.response);
+    show_percentiles("Activation lateness", &rts.lateness);
+    LOG_MSG("");
+
+    return rts.dmiss_count;
+}
+
+int main (int argc, char **argv)
+{
+    struct sim s;
+    thrd_pool_t *pool;
+    thrd_info_t thi;
+    thrd_sim_t params;
+    uint64_t misses = 0;
+    unsigned k;
+    int unsched;
+    int trace;
+
+    memset(&s, 0, sizeof(struct sim));
+    if ((trace = parse(&s, argc, argv)) == -1 ||
+            !load_trace(&s, argv[trace]) ||
+            !apply_scales(&s) || !apply_adds(&s)) {
+        exit(EXIT_FAILURE);
+    }
+    current = &s;
+
+    pool = thrd_new(0);
+    thrd_set_policy(pool, s.policy);
+    thrd_set_partitioned(pool, s.partition);
+    for (k = 0; k < s.ntasks; k ++) {
+        struct task *t = &s.tasks[k];
+
+        if (t->nsamples == 0) {
+            LOG_FMT("Task '%s' never activated in the trace, ignored",
+                    t->name);
+            continue;
+        }
+        memset(&thi, 0, sizeof(thrd_info_t));
+        thi.callback = no_callback;
+        thi.context = (void *) t;
+        thi.name = t->name;
+        thi.period = rtutils_ns2time(t->period);
+        thi.deadline = rtutils_ns2time(t->deadline);
+        thi.runtime = rtutils_ns2time(worst_sample(t));
+        thi.overrun = t->overrun;
+        thi.catchup = t->catchup;
+        t->stats = thrd_add(pool, &thi);
+    }
+
+    params.cpus = s.cpus;
+    params.length.tv_sec = s.length;
+    params.length.tv_nsec = 0;
+    params.exec = next_exec;
+    unsched = thrd_simulate(pool, &params);
+    if (unsched < 0) {
+        ERR_FMT("Simulation failed: %s",
+                thrd_strerr(pool, thrd_interr(pool)));
+        thrd_destroy(pool);
+        exit(EXIT_FAILURE);
+    }
+
+    LOG_FMT("SIMULATED STATISTICS (%u s, %u CPUs)", s.length, s.cpus);
+    for (k = 0; k < s.ntasks; k ++) {
+        if (s.tasks[k].stats) {
+            misses += show_task(&s.tasks[k]);
+        }
+    }
+    thrd_destroy(pool);
+
+    for (k = 0; k < s.ntasks; k ++) {
+        free(s.tasks[k].name);
+        free(s.tasks[k].samples);
+    }
+    free(s.tasks);
+    free(s.scales);
+    free(s.adds);
+
+    exit(misses || unsched ? SIM_EXIT_MISSES : EXIT_SUCCESS);
+}
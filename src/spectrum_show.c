@@ -19,6 +19,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <fftw3.h>
 
 #include "headers/spectrum_show.h"
@@ -115,14 +116,19 @@ static
 int thread_cb (void *arg)
 {
     struct specth_data *ctx = (struct specth_data *)arg;
+    uint64_t stamp;
 
-    sampth_get_samples(ctx->sampth, ctx->buffer);
+    stamp = sampth_get_samples(ctx->sampth, ctx->buffer);
     build_spectrum(&ctx->ft, ctx->buffer, ctx->buflen,
                    ctx->graphs.i0, ctx->graphs.r0,
                    normalize_ch0);
     build_spectrum(&ctx->ft, ctx->buffer, ctx->buflen,
                    ctx->graphs.i1, ctx->graphs.r1,
                    normalize_ch1);
+    plot_graphic_stamp(ctx->graphs.r0, stamp);
+    plot_graphic_stamp(ctx->graphs.i0, stamp);
+    plot_graphic_stamp(ctx->graphs.r1, stamp);
+    plot_graphic_stamp(ctx->graphs.i1, stamp);
     return 0;
 }
 
@@ -133,12 +139,14 @@ const thrd_rtstats_t * specth_subscribe (genth_t **handle,
 {
     struct specth_data *ctx;
     thrd_info_t thi;
-    const thrd_rtstats_t *err;
     size_t buflen;
 
+    memset(&thi, 0, sizeof(thrd_info_t));
     thi.init = NULL;
     thi.callback = thread_cb;
     thi.destroy = destroy_cb;
+    thi.name = "Spectrum show";
+    thi.stack_size = TASK_STACK_SIZE;
 
     ctx = (struct specth_data *) calloc(1, sizeof(struct specth_data));
     assert(ctx);
@@ -154,6 +162,9 @@ const thrd_rtstats_t * specth_subscribe (genth_t **handle,
     rtutils_time_increment(&thi.delay, sampth_get_period(sampth));
     rtutils_time_copy(&thi.period, &thi.delay);
 
+    /* A late transform would be computed on the same samples */
+    thi.overrun = THRD_OVERRUN_SKIP;
+
     memcpy(&ctx->graphs, graphs, sizeof(specth_graphics_t));
     ctx->buflen = buflen = sampth_get_size(sampth);
     ctx->buffer = calloc(buflen, sizeof(alsagw_frame_t));
@@ -168,10 +179,7 @@ const thrd_rtstats_t * specth_subscribe (genth_t **handle,
     ctx->ft.plan = fftw_plan_dft_r2c_1d(buflen, ctx->ft.in, ctx->ft.out,
                                         FFTW_MEASURE);
 
-    if ((err = genth_subscribe(handle, pool, &thi)) == NULL) {
-        free(ctx->buffer);
-        free(ctx);
-    }
-    return err;
+    /* On failure the context is released by destroy_cb() */
+    return genth_subscribe(handle, pool, &thi);
 }
 
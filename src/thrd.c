@@ -20,6 +20,7 @@
 
 #include "headers/thrd.h"
 #include "headers/rtutils.h"
+#include "headers/allocguard.h"
 #include "headers/config.h"
 
 #include <sched.h>
@@ -31,275 +32,2934 @@
 #include <signal.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
 
 /* Flags for thrd_t::status */
 #define THRD_ALIVE          1 << 0
 #define THRD_INITIALIZED    1 << 2
+#define THRD_DEADLINE       1 << 3  /* Running under SCHED_DEADLINE */
+#define THRD_READY          1 << 4  /* Cyclic: "Start" executed; */
+#define THRD_DONE           1 << 5  /* Cyclic: task terminated; */
+#define THRD_EXITED         1 << 6  /* The thread routine returned. */
+
+/* Number of activations used to measure the budget of EDF threads, and
+ * percent of the measured worst case given as budget. */
+#define THRD_EDF_PROBES     32
+#define THRD_EDF_MARGIN     125
+
+/* Smallest budget accepted by the kernel, nanoseconds */
+#define THRD_EDF_MIN_RUNTIME 1024
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE      6
+#endif
+
+/* Stack left untouched by the prefaulting, for the frames of the thread
+ * routine and for the C library. */
+#define THRD_STACK_RESERVE  (16 * 1024)
+
+/* Watchdog: period of the checks and shortest stall reported (ns), events
+ * of the trace and depth of the stack reported for a stalled thread. */
+#define THRD_WATCHDOG_TICK      10000000ULL
+#define THRD_WATCHDOG_MIN       100000000ULL
+#define THRD_WATCHDOG_EVENTS    16
+#define THRD_WATCHDOG_DEPTH     32
+#define THRD_WATCHDOG_NAME      64
+
+/* Number of executions of each callback during the calibration phase */
+#define THRD_CALIB_RUNS     64
 
 /* Flags for thrd_pool_t::status */
-#define THRD_POOL_ACTIVE    1 << 7 /**< Active pool (running threads) */
-#define THRD_POOL_KILLALL   1 << 6 /**< All threads shutting down */
-#define THRD_POOL_SORTED    1 << 5 /**< The pool threads are sorted */
+#define THRD_POOL_ACTIVE    1 << 15 /**< Active pool (running threads) */
+#define THRD_POOL_KILLALL   1 << 14 /**< All threads shutting down */
+#define THRD_POOL_SORTED    1 << 13 /**< The pool threads are sorted */
+
+/* Values for thrd_t::gate, the outcome of the admission test */
+#define THRD_GATE_WAIT      0   /* Test pending; */
+#define THRD_GATE_GO        1   /* Admitted; */
+#define THRD_GATE_KILL      2   /* Refused, the thread gets destroyed. */
+
+/* All error OR-ed, for cleanup, used by strerr */
+#define THRD_ERR_ALL \
+    ( THRD_ERR_LIBRARY | THRD_ERR_NULLPER | \
+      THRD_ERR_EMPTY | THRD_ERR_AFFINITY | THRD_ERR_UNSCHED )
+
+/* Busy waiting wake up: initial margin before the activation, and its
+ * bounds (ns). The margin never exceeds 1/THRD_SPIN_PERIOD_SHARE of the
+ * period. */
+#define THRD_SPIN_MARGIN        50000
+#define THRD_SPIN_MIN_MARGIN    2000
+#define THRD_SPIN_MAX_MARGIN    200000
+#define THRD_SPIN_PERIOD_SHARE  4
+
+/* Cyclic executive: shortest minor frame (ns), and maximum number of
+ * frames in the schedule table. */
+#define THRD_CYCLIC_MIN_FRAME   100000
+#define THRD_CYCLIC_MAX_FRAMES  4096
+
+/* Partitioning: utilizations are in parts per million. Tasks having
+ * neither a calibrated execution time nor a budget are assumed to use
+ * THRD_PART_DEFAULT_UTIL, and each CPU is filled up to the Liu-Layland
+ * asymptotic bound for Rate Monotonic. */
+#define THRD_PART_FULL          1000000
+#define THRD_PART_RM_BOUND      693147
+#define THRD_PART_DEFAULT_UTIL  100000
+
+/* Internal descriptor for a thread */
+typedef struct {
+
+    int priority;               /* Thread's priority; */
+    thrd_policy_t policy;       /* Scheduling policy; */
+    thrd_pool_t *pool;          /* Pool owning the thread; */
+    uint64_t wcet;              /* Calibrated execution time (ns); */
+    uint64_t period;            /* thrd_info_t::period (ns), for the other
+                                 * threads (atomic); */
+    int calibrated;             /* Calibration done (pool lock); */
+    int gate;                   /* Admission outcome (pool lock); */
+    int stop;                   /* Termination request (atomic); */
+    uint64_t margin;            /* Busy waiting margin (ns); */
+    perfctr_t *counters;        /* Hardware counters, or NULL; */
+    pthread_t handler;          /* Handler of the thread; */
+    uint8_t status;             /* Status flags; */
+    thrd_info_t info;           /* User defined thread info. Defined in
+                                   headers/thrd.h; */
+
+    struct timespec start;      /* Pool start time, used for computing the
+                                   delay during startup phase; */
+
+    /* Cyclic executive only */
+    struct timespec next;       /* Next release; */
+    uint64_t cyc_source;        /* Period the table was built on (ns); */
+    uint64_t cyc_period;        /* Period quantized on the frames (ns); */
+    unsigned cyc_frames;        /* Quantized period, as frames; */
+    unsigned cyc_phase;         /* First frame in the table. */
+
+    thrd_rtstats_t statistics;  /* Statistics about the task; */
+
+    /* Trace, written only by the thread running the task */
+    unsigned id;                /* Track in the dumped trace; */
+    uint64_t trace_head;        /* Events recorded so far (atomic); */
+    thrd_event_t trace[THRD_TRACE_EVENTS];
+
+    /* Watchdog */
+    uint64_t heartbeat;         /* Callback entries and exits, odd within
+                                 * the callback (atomic); */
+    uint64_t beat_seen;         /* Heartbeat at the last check; */
+    uint64_t beat_time;         /* Time of the last change (ns); */
+    int stalled;                /* Stall reported. */
+} thrd_t; 
+
+/* Static schedule of the cyclic executive: the tasks released in the
+ * frame f are slots[first[f]] ... slots[first[f + 1] - 1]. */
+struct thrd_cyclic {
+    pthread_t handler;      /* Dispatcher thread; */
+    int running;            /* Dispatcher to be joined; */
+    int pause;              /* Dispatcher required to return (atomic); */
+    int verdict;            /* Outcome of the startup (pool lock); */
+    int priority;           /* Priority of the dispatcher; */
+    uint64_t margin;        /* Busy waiting margin (ns); */
+    perfctr_t *counters;    /* Hardware counters, or NULL; */
+    size_t stack_size;      /* Stack of the dispatcher, zero for the
+                             * default one; */
+    size_t prefault;        /* Stack touched by the dispatcher; */
+
+    uint64_t minor;         /* Minor frame (ns); */
+    unsigned nframes;       /* Frames in the hyperperiod; */
+    unsigned *first;
+    thrd_t **slots;
+};
+
+struct thrd_pool {
+    dlist_t *threads;        /**< List of thrd_t objects (@see thrd.c); */
+    size_t nthreads;         /**< Number of sampling threads; */
+
+    uint16_t status;         /**< Status flags: */
+    int err;                 /**< Stores error codes; */
+    int minprio;             /**< Minimum priority; */
+    thrd_policy_t policy;    /**< Scheduling policy; */
+    int partitioned;         /**< Partitioned scheduling enabled; */
+    int counters;            /**< Hardware counters enabled; */
+    unsigned watchdog;       /**< Allowed stall, periods (0 if off); */
+
+    thrd_admission_t admission; /**< Admission control mode; */
+    pthread_mutex_t lock;    /**< Protects the calibration phase; */
+    pthread_cond_t cond;     /**< Signals calibration and release; */
+
+    struct thrd_cyclic cyclic;  /**< Cyclic executive; */
+    unsigned last_id;           /**< Last track given to a thread; */
+
+    pthread_t watcher;          /**< Watchdog thread; */
+    int watching;               /**< Watchdog running (atomic); */
+    pthread_mutex_t watch;      /**< Protects the list of threads against
+                                 *   the watchdog. */
+};
+
+/* Descriptor of the task running on the calling thread. */
+static __thread thrd_t *current;
+
+/* Period of a task (ns). Only the thread running the task may use
+ * thrd_info_t::period, which thrd_set_period() rewrites. */
+static inline
+uint64_t period_ns (const thrd_t *t)
+{
+    return __atomic_load_n(&t->period, __ATOMIC_RELAXED);
+}
+
+/* CPU time consumed by the calling thread, in nanoseconds */
+static
+uint64_t cpu_time (void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return rtutils_time2ns(&t);
+}
+
+/* Runs the periodic callback of a task. The heartbeat is odd during the
+ * call, for the watchdog. With the allocation guard the callback must not
+ * use the heap. */
+static inline
+int run_callback (thrd_t *thrd, void *context)
+{
+    int ret;
+
+    __atomic_store_n(&thrd->heartbeat, thrd->heartbeat + 1,
+                     __ATOMIC_RELAXED);
+    allocguard_enter(thrd->info.name);
+    ret = thrd->info.callback(context);
+    allocguard_leave();
+    __atomic_store_n(&thrd->heartbeat, thrd->heartbeat + 1,
+                     __ATOMIC_RELAXED);
+    return ret;
+}
+
+/* Page faults of the calling thread so far */
+static
+void page_faults (uint64_t *minor, uint64_t *major)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_THREAD, &ru);
+    *minor = ru.ru_minflt;
+    *major = ru.ru_majflt;
+}
+
+/* Size given to pthread_attr_setstacksize(), zero for the default */
+static
+size_t stack_size (size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+    return size < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : size;
+}
+
+/* Bytes of stack to be touched for a thread having the given size */
+static
+size_t stack_prefault (size_t size)
+{
+    if (size == 0) {
+        return THRD_STACK_PREFAULT;
+    }
+    size = stack_size(size);
+    return size > THRD_STACK_RESERVE ? size - THRD_STACK_RESERVE : 0;
+}
+
+/* Touches each page of the given amount of stack below the current
+ * frame. The memory is locked by mlockall(), so that the pages stay there
+ * once mapped. */
+static
+void prefault_stack (size_t size)
+{
+    unsigned char stack[size ? size : 1];
+    volatile unsigned char *touch = stack;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = 0; i < size; i += page) {
+        touch[i] = 0;
+    }
+}
+
+/* Parameters of the sched_setattr(2) system call, which is not wrapped
+ * by the C library. */
+struct thrd_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+/* Moves the calling thread under SCHED_DEADLINE, with the budget,
+ * deadline and period of the given task. On failure the thread keeps
+ * running under SCHED_FIFO with its Rate Monotonic priority. */
+static
+void set_deadline (thrd_t *thrd)
+{
+    #ifndef RT_DISABLE
+    struct thrd_sched_attr attr;
+    int err;
+
+    memset(&attr, 0, sizeof(struct thrd_sched_attr));
+    attr.size = sizeof(struct thrd_sched_attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_period = rtutils_time2ns(&thrd->info.period);
+    attr.sched_deadline = rtutils_time_iszero(&thrd->info.deadline)
+                        ? attr.sched_period
+                        : rtutils_time2ns(&thrd->info.deadline);
+    attr.sched_runtime = rtutils_time2ns(&thrd->info.runtime);
+    if (attr.sched_runtime > attr.sched_deadline) {
+        attr.sched_runtime = attr.sched_deadline;
+    }
+
+    #ifdef SYS_sched_setattr
+    err = syscall(SYS_sched_setattr, 0, &attr, 0) == 0 ? 0 : errno;
+    #else
+    err = ENOSYS;
+    #endif
+
+    if (err == 0) {
+        __atomic_or_fetch(&thrd->status, THRD_DEADLINE, __ATOMIC_RELEASE);
+    } else {
+        ERR_FMT("SCHED_DEADLINE refused (%s), keeping SCHED_FIFO",
+                strerror(err));
+    }
+    #endif
+}
+
+/* Sets the budget of an EDF thread from its measured worst case
+ * execution time. */
+static
+void set_runtime (thrd_t *thrd, uint64_t wcet)
+{
+    wcet = wcet * THRD_EDF_MARGIN / 100;
+    if (wcet < THRD_EDF_MIN_RUNTIME) {
+        wcet = THRD_EDF_MIN_RUNTIME;
+    }
+    thrd->info.runtime = rtutils_ns2time(wcet);
+    DEBUG_TIMESPEC("Measured EDF budget", thrd->info.runtime);
+}
+
+/* Bucket of an histogram value: exact below 2^THRD_HIST_SUB_BITS, then
+ * the exponent selects a row and the following bits select a column. */
+static inline
+unsigned hist_bucket (uint64_t value)
+{
+    unsigned exp;
+
+    if (value < (1 << THRD_HIST_SUB_BITS)) {
+        return value;
+    }
+    exp = 63 - __builtin_clzll(value);
+    return ((exp - THRD_HIST_SUB_BITS + 1) << THRD_HIST_SUB_BITS)
+           + ((value >> (exp - THRD_HIST_SUB_BITS))
+              & ((1 << THRD_HIST_SUB_BITS) - 1));
+}
+
+/* Largest value falling in a bucket */
+static
+uint64_t hist_bucket_max (unsigned bucket)
+{
+    unsigned shift;
+    uint64_t mant;
+
+    if (bucket < (1 << THRD_HIST_SUB_BITS)) {
+        return bucket;
+    }
+    shift = (bucket >> THRD_HIST_SUB_BITS) - 1;
+    mant = (1 << THRD_HIST_SUB_BITS)
+         + (bucket & ((1 << THRD_HIST_SUB_BITS) - 1));
+    return ((mant + 1) << shift) - 1;
+}
+
+void thrd_hist_add (thrd_hist_t *hist, uint64_t value)
+{
+    hist->buckets[hist_bucket(value)] ++;
+    hist->count ++;
+}
+
+uint64_t thrd_hist_percentile (const thrd_hist_t *hist, double perc)
+{
+    uint64_t target, sum = 0;
+    unsigned i;
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    target = (uint64_t) (perc * hist->count / 100.0 + 0.5);
+    if (target == 0) target = 1;
+    if (target > hist->count) target = hist->count;
+
+    for (i = 0; i < THRD_HIST_BUCKETS; i ++) {
+        sum += hist->buckets[i];
+        if (sum >= target) break;
+    }
+    return hist_bucket_max(i);
+}
+
+uint64_t thrd_hist_cumulative (const thrd_hist_t *hist, uint64_t value)
+{
+    uint64_t sum = 0;
+    unsigned i, last;
+
+    /* The bucket straddling the value is included: its samples may be
+     * up to the value. */
+    last = hist_bucket(value);
+    for (i = 0; i <= last; i ++) {
+        sum += hist->buckets[i];
+    }
+    return sum;
+}
+
+void thrd_rtstats_snapshot (const thrd_rtstats_t *stats,
+                            thrd_rtstats_t *copy)
+{
+    uint32_t seq;
+
+    do {
+        while ((seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE)) & 1);
+        memcpy((void *)copy, (const void *)stats, sizeof(thrd_rtstats_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&stats->seq, __ATOMIC_RELAXED) != seq);
+}
+
+/* Hardware counters before an activation */
+static inline
+void counters_start (perfctr_t *pc, uint64_t events[PERFCTR_EVENTS])
+{
+    if (pc) {
+        perfctr_read(pc, events);
+    }
+}
+
+/* Hardware counters consumed by an activation: the values read by
+ * counters_start() become the differences. Returns NULL if the counters
+ * are not enabled. */
+static inline
+const uint64_t * counters_stop (perfctr_t *pc,
+                                uint64_t events[PERFCTR_EVENTS])
+{
+    uint64_t now[PERFCTR_EVENTS];
+    int n;
+
+    if (pc == NULL) {
+        return NULL;
+    }
+    perfctr_read(pc, now);
+    for (n = 0; n < PERFCTR_EVENTS; n ++) {
+        events[n] = now[n] - events[n];
+    }
+    return events;
+}
+
+/* The update is the write side of a sequence lock, see
+ * thrd_rtstats_snapshot(). The activation released at r started at s and
+ * finished at f, consuming exec of CPU time (ns): the rest of the time
+ * between s and f was spent off the CPU. The callback hit minor and
+ * major page faults. The hardware counters of the activation are NULL if
+ * not measured. */
+static
+void update_statistics (thrd_rtstats_t *stats, uint64_t r, uint64_t s,
+                        uint64_t f, uint64_t exec, int deadline_miss,
+                        unsigned skipped, uint64_t spin, uint64_t minor,
+                        uint64_t major, const uint64_t *events)
+{
+    uint64_t response = f - r;
+    uint64_t lateness = s > r ? s - r : 0;
+    uint64_t preempt = f - s > exec ? f - s - exec : 0;
+    uint32_t seq = stats->seq;
+
+    __atomic_store_n(&stats->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    stats->response_times += response;
+    stats->n_executions ++;
+    if (stats->wcrt < response) {
+        stats->wcrt = response;
+    }
+    stats->lateness_times += lateness;
+    stats->exec_times += exec;
+    stats->preempt_times += preempt;
+    thrd_hist_add(&stats->response, response);
+    thrd_hist_add(&stats->lateness, lateness);
+    thrd_hist_add(&stats->execution, exec);
+    thrd_hist_add(&stats->preemption, preempt);
+    if (deadline_miss) {
+        stats->dmiss_count ++;
+    }
+    stats->skip_count += skipped;
+    stats->spin_time += spin;
+    stats->minor_faults += minor;
+    stats->major_faults += major;
+    if (minor + major) {
+        stats->fault_count ++;
+    }
+    if (events) {
+        int n;
+
+        stats->counted ++;
+        for (n = 0; n < PERFCTR_EVENTS; n ++) {
+            stats->events[n] += events[n];
+        }
+    }
+
+    __atomic_store_n(&stats->seq, seq + 2, __ATOMIC_RELEASE);
+    if (deadline_miss) {
+        DEBUG_MSG("Deadline miss");
+    }
+    if (minor + major) {
+        DEBUG_MSG("Page fault in callback");
+    }
+}
+
+/* Appends an event to the trace of a task. The head is published after
+ * the record, as the sequence counter of the statistics. */
+static inline
+void trace_put (thrd_t *thrd, thrd_event_type_t type, uint64_t time,
+                uint64_t arg)
+{
+    uint64_t head = thrd->trace_head;
+    thrd_event_t *ev;
+
+    ev = &thrd->trace[head & (THRD_TRACE_EVENTS - 1)];
+    ev->time = time;
+    ev->type = type;
+    ev->arg = arg > UINT32_MAX ? UINT32_MAX : (uint32_t) arg;
+    __atomic_store_n(&thrd->trace_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Traces the beginning of an activation released at r and started at s
+ * (ns) */
+static inline
+void trace_start (thrd_t *thrd, uint64_t r, uint64_t s)
+{
+    trace_put(thrd, THRD_EVENT_RELEASE, r, 0);
+    trace_put(thrd, THRD_EVENT_START, s, 0);
+}
+
+/* Traces the end of an activation finished at f, having the given
+ * absolute deadline (ns), consuming exec of CPU time (ns) and hit by the
+ * given page faults */
+static inline
+void trace_finish (thrd_t *thrd, uint64_t f, uint64_t deadline,
+                   uint64_t exec, unsigned skipped, uint64_t faults)
+{
+    trace_put(thrd, THRD_EVENT_FINISH, f, exec);
+    if (faults) {
+        trace_put(thrd, THRD_EVENT_FAULT, f, faults);
+    }
+    if (f > deadline) {
+        trace_put(thrd, THRD_EVENT_MISS, f, f - deadline);
+    }
+    if (skipped) {
+        trace_put(thrd, THRD_EVENT_SKIP, f, skipped);
+    }
+}
+
+void thrd_trace (thrd_event_type_t type, uint64_t arg)
+{
+    struct timespec now;
+
+    if (current == NULL) {
+        return;
+    }
+    rtutils_get_now(&now);
+    trace_put(current, type, rtutils_time2ns(&now), arg);
+}
+
+/* Waits until the given time. With busy waiting, the thread sleeps until
+ * a margin before it, then polls the clock. The margin follows the
+ * oversleeping observed on the clock_nanosleep() calls: it grows at once
+ * when the thread wakes up too late, it slowly shrinks when it wakes up
+ * early. Returns the time spent spinning (ns). */
+static
+uint64_t wake_at (thrd_wake_t mode, uint64_t *margin, uint64_t period,
+                  const struct timespec *when)
+{
+    struct timespec t;
+    uint64_t target, early, now, woke, over, limit;
+
+    if (mode != THRD_WAKE_SPIN) {
+        rtutils_wait(when);
+        return 0;
+    }
+
+    limit = period / THRD_SPIN_PERIOD_SHARE;
+    if (limit > THRD_SPIN_MAX_MARGIN) limit = THRD_SPIN_MAX_MARGIN;
+    if (limit < THRD_SPIN_MIN_MARGIN) limit = THRD_SPIN_MIN_MARGIN;
+    if (*margin == 0 || *margin > limit) {
+        *margin = THRD_SPIN_MARGIN < limit ? THRD_SPIN_MARGIN : limit;
+    }
+
+    target = rtutils_time2ns(when);
+    early = target > *margin ? target - *margin : 0;
+    rtutils_get_now(&t);
+    now = rtutils_time2ns(&t);
+    if (now >= target) {
+        return 0;
+    }
+
+    if (now < early) {
+        t = rtutils_ns2time(early);
+        rtutils_wait(&t);
+        rtutils_get_now(&t);
+        now = rtutils_time2ns(&t);
+
+        over = now - early;
+        if (over >= *margin) {
+            *margin = over + over / 4;
+        } else {
+            *margin -= (*margin - over) / 64;
+        }
+        if (*margin > limit) *margin = limit;
+        if (*margin < THRD_SPIN_MIN_MARGIN) *margin = THRD_SPIN_MIN_MARGIN;
+    }
+
+    woke = now;
+    while (now < target) {
+        rtutils_cpu_relax();
+        rtutils_get_now(&t);
+        now = rtutils_time2ns(&t);
+    }
+    return now - woke;
+}
+
+/* Applies the overrun policy of the thread after an activation finished at
+ * time f (ns), possibly moving forward the next activation by multiples of
+ * the period (ns). Returns the number of skipped activations. */
+static
+unsigned overrun (thrd_t *thrd, struct timespec *next_act, uint64_t f,
+                  uint64_t period)
+{
+    uint64_t next;
+    unsigned late, skip;
+
+    next = rtutils_time2ns(next_act);
+    if (f <= next) {
+        return 0;
+    }
+
+    /* Activations already due, including the next one */
+    late = (f - next) / period + 1;
+
+    switch (thrd->info.overrun) {
+        case THRD_OVERRUN_CATCHUP:
+            if (thrd->info.catchup == 0 || late <= thrd->info.catchup) {
+                return 0;
+            }
+            skip = late - thrd->info.catchup;
+            break;
+        case THRD_OVERRUN_SKIP:
+        case THRD_OVERRUN_DEGRADE:
+            skip = late;
+            break;
+        default:
+            assert(0);
+            return 0;
+    }
+
+    *next_act = rtutils_ns2time(next + skip * period);
+    return skip;
+}
+
+/* Signals the pool that the calling thread completed its calibration */
+static
+void calibration_done (thrd_t *thrd)
+{
+    thrd_pool_t *pool = thrd->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    thrd->calibrated = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Waits for the outcome of the admission test (one of THRD_GATE_*) */
+static
+int wait_release (thrd_t *thrd)
+{
+    thrd_pool_t *pool = thrd->pool;
+    int gate;
+
+    calibration_done(thrd);
+    pthread_mutex_lock(&pool->lock);
+    while ((gate = thrd->gate) == THRD_GATE_WAIT) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return gate;
+}
+
+/* Runs the callback THRD_CALIB_RUNS times, keeping the worst execution
+ * time. Returns non-zero if the callback required to terminate.
+ *
+ * The runs are back to back: on a running pool they would starve the
+ * admitted threads, thus they get the default scheduling. The measure
+ * is on the CPU-time clock, so being preempted doesn't inflate it. */
+static
+int calibrate (thrd_t *thrd, void *context)
+{
+    uint64_t start, exec;
+    unsigned n;
+    #ifndef RT_DISABLE
+    struct sched_param param = {
+        .sched_priority = 0
+    };
+
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    #endif
+
+    thrd->wcet = 0;
+    for (n = 0; n < THRD_CALIB_RUNS; n ++) {
+        start = cpu_time();
+        if (run_callback(thrd, context)) {
+            return 1;
+        }
+        exec = cpu_time() - start;
+        if (exec > thrd->wcet) {
+            thrd->wcet = exec;
+        }
+    }
+
+    /* Back to the priority, which may have been reassigned meanwhile */
+    #ifndef RT_DISABLE
+    param.sched_priority = __atomic_load_n(&thrd->priority,
+                                           __ATOMIC_RELAXED);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    #endif
+
+    /* EDF threads without a budget get the calibrated one, so they are
+     * not measured again. */
+    if (thrd->policy == THRD_POLICY_EDF
+            && rtutils_time_iszero(&thrd->info.runtime)) {
+        set_runtime(thrd, thrd->wcet);
+    }
+    return 0;
+}
+
+/* backtrace() loads libgcc on its first call, which allocates: this must
+ * not happen in the handler of the watchdog (see watchdog_signal()). */
+static
+void backtrace_prime (void)
+{
+    void *frame;
+
+    backtrace(&frame, 1);
+}
+
+/* Cleanup handler of thread_routine(), for every way out */
+static
+void thread_exited (void *arg)
+{
+    thrd_t *thrd = (thrd_t *)arg;
+
+    __atomic_or_fetch(&thrd->status, THRD_EXITED, __ATOMIC_RELEASE);
+}
+
+/* Each real-time thread of this project actually corresponds to the
+ * execution of this routine. */
+static
+void * thread_routine (void * arg)
+{
+    /* Thread management information is transparently keeped into the
+     * thread stack. The external callback system gives the abstraction. */
+    thrd_t *thrd = (thrd_t *)arg;
+    struct timespec next_act;
+    struct timespec finish_time;
+    struct timespec arrival_time;
+    struct timespec start_time;
+    struct timespec deadline;
+    uint64_t cpu_start, exec;
+    uint64_t minor_start, major_start, minor, major;
+    uint64_t events[PERFCTR_EVENTS];
+    uint64_t wcet = 0;
+    unsigned probes = 0;
+    unsigned skipped;
+    uint64_t spin;
+    void *context;
+
+    context = thrd->info.context;
+    current = thrd;
+    pthread_cleanup_push(thread_exited, thrd);
+
+    /* The stack is mapped before anything else runs on it. */
+    prefault_stack(stack_prefault(thrd->info.stack_size));
+    logging_attach();
+    if (thrd->pool->watchdog) {
+        backtrace_prime();
+    }
+
+    /* If the user declared an initialization function we execute it. */
+    if (thrd->info.init) {
+        if (thrd->info.init(context)) {
+            /* The user aborted thread startup. If there's a destructor
+             * callback it's time to call it. */
+            if (thrd->info.destroy) {
+                thrd->info.destroy(context);
+            }
+            if (thrd->pool->admission != THRD_ADMIT_OFF) {
+                calibration_done(thrd);
+            }
+            pthread_exit(NULL);
+        }
+    }
+
+    /* With admission control, the thread is calibrated and then waits
+     * for the outcome of the schedulability test. */
+    if (thrd->pool->admission != THRD_ADMIT_OFF) {
+        int quit;
+
+        quit = calibrate(thrd, context);
+        if (wait_release(thrd) == THRD_GATE_KILL) {
+            quit = 1;
+        }
+        if (quit) {
+            if (thrd->info.destroy) {
+                thrd->info.destroy(context);
+            }
+            pthread_exit(NULL);
+        }
+    }
+
+    /* Counters are per thread: the thread itself must open them. */
+    if (thrd->pool->counters && (thrd->counters = perfctr_open()) == NULL) {
+        ERR_FMT("Hardware counters unavailable: %s", strerror(errno));
+    }
+
+    /* Wait delayed activation. */
+    spin = wake_at(thrd->info.wake, &thrd->margin,
+                   rtutils_time2ns(&thrd->info.period), &thrd->start);
+
+    /* EDF threads without a budget are measured during the first
+     * activations, meanwhile they run with Rate Monotonic priority. */
+    if (thrd->policy == THRD_POLICY_EDF) {
+        if (rtutils_time_iszero(&thrd->info.runtime)) {
+            probes = THRD_EDF_PROBES;
+        } else {
+            set_deadline(thrd);
+        }
+    }
+
+    /* Periodic loop: at each cycle the next absoute activation time is
+     * computed. */
+    rtutils_get_now(&next_act);
+    for (;;) {
+        /* Termination required by thrd_remove() or thrd_destroy(). */
+        if (__atomic_load_n(&thrd->stop, __ATOMIC_ACQUIRE)) {
+            if (thrd->info.destroy) {
+                thrd->info.destroy(context);
+            }
+            pthread_exit(NULL);
+        }
+
+        rtutils_time_copy(&arrival_time, &next_act);
+
+        rtutils_get_now(&start_time);
+        trace_start(thrd, rtutils_time2ns(&arrival_time),
+                    rtutils_time2ns(&start_time));
+        page_faults(&minor_start, &major_start);
+        counters_start(thrd->counters, events);
+        cpu_start = cpu_time();
+        if (run_callback(thrd, context)) {
+            /* Thread required to shut down. If there's a destructor
+             * callback it shall be called now. */
+            if (thrd->info.destroy) {
+                thrd->info.destroy(context);
+            }
+            pthread_exit(NULL);
+        }
+        exec = cpu_time() - cpu_start;
+        page_faults(&minor, &major);
+        minor -= minor_start;
+        major -= major_start;
+        rtutils_get_now(&finish_time);
+
+        /* Computed after the callback, so that a period changed by
+         * thrd_set_period() applies to the next activation. */
+        rtutils_time_increment(&next_act, &thrd->info.period);
+
+        if (probes) {
+            if (exec > wcet) {
+                wcet = exec;
+            }
+            if (-- probes == 0) {
+                set_runtime(thrd, wcet);
+                set_deadline(thrd);
+            }
+        }
+
+        if (rtutils_time_iszero(&thrd->info.deadline)) {
+            rtutils_time_copy(&deadline, &next_act);
+        } else {
+            rtutils_time_copy(&deadline, &arrival_time);
+            rtutils_time_increment(&deadline, &thrd->info.deadline);
+        }
+        skipped = overrun(thrd, &next_act, rtutils_time2ns(&finish_time),
+                          rtutils_time2ns(&thrd->info.period));
+        update_statistics(&thrd->statistics,
+                          rtutils_time2ns(&arrival_time),
+                          rtutils_time2ns(&start_time),
+                          rtutils_time2ns(&finish_time), exec,
+                          rtutils_time_cmp(&deadline, &finish_time) > 0,
+                          skipped, spin, minor, major,
+                          counters_stop(thrd->counters, events));
+        trace_finish(thrd, rtutils_time2ns(&finish_time),
+                     rtutils_time2ns(&deadline), exec, skipped,
+                     minor + major);
+        if (skipped && thrd->info.overrun == THRD_OVERRUN_DEGRADE &&
+                thrd->info.on_overrun) {
+            thrd->info.on_overrun(context, skipped);
+        }
+
+        /* Busy waiting would eat the SCHED_DEADLINE budget */
+        spin = wake_at((thrd->status & THRD_DEADLINE) ? THRD_WAKE_SLEEP
+                                                      : thrd->info.wake,
+                       &thrd->margin, rtutils_time2ns(&thrd->info.period),
+                       &next_act);
+    }
+
+    pthread_cleanup_pop(1);
+    pthread_exit(NULL);
+}
+
+/* Build activation time for the thread: we make a copy of the enable
+ * time and increment it with thread specification delay. */
+static
+void set_start (thrd_t *thrd, const struct timespec *enabtime)
+{
+    memcpy((void *) &thrd->start, (const void *)enabtime,
+           sizeof(struct timespec));
+    rtutils_time_increment(&thrd->start, &thrd->info.delay);
+}
+
+/* Thread startup */
+static
+int startup(thrd_t *thrd, struct timespec *enabtime)
+{   
+    pthread_attr_t attr;
+    #ifndef RT_DISABLE
+    struct sched_param param = {
+        .sched_priority = thrd->priority
+    };
+    #endif
+
+    int err;
+
+    DEBUG_TIMESPEC("Activating thread with period", thrd->info.period);
+
+    set_start(thrd, enabtime);
+
+    /* Setting stats to zero */
+    memset(&thrd->statistics, 0, sizeof(thrd_rtstats_t));
+
+    err = pthread_attr_init(&attr);
+    assert(err == 0);
+
+    if (thrd->info.stack_size) {
+        err = pthread_attr_setstacksize(&attr,
+                                        stack_size(thrd->info.stack_size));
+        assert(err == 0);
+    }
+
+    /* Pinning, if required, is part of the thread creation, so that the
+     * thread never runs on a different CPU. */
+    if (CPU_COUNT(&thrd->info.cpus) > 0) {
+        err = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t),
+                                          &thrd->info.cpus);
+        assert(err == 0);
+    }
+
+    #ifndef RT_DISABLE
+        /* Setting thread as real-time, scheduled as FIFO and with the given
+         * priority. */
+        err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        assert(err == 0);
+        err = pthread_attr_setschedparam(&attr, &param);
+        assert(err == 0);
+        err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        assert(err == 0);
+    #endif
+
+    err = pthread_create(&thrd->handler, &attr, thread_routine,
+                         (void *) thrd);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0) return err;
+
+    /* Activation achieved: update flags. */
+    __atomic_or_fetch(&thrd->status, THRD_ALIVE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Cyclic executive: the tasks are dispatched by a single thread, following
+ * a static table which covers the hyperperiod. */
+
+static
+uint64_t gcd (uint64_t a, uint64_t b)
+{
+    uint64_t r;
+
+    while (b) {
+        r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/* Tasks which still have to be dispatched */
+static inline
+int cyclic_live (const thrd_t *t)
+{
+    return (t->status & (THRD_READY | THRD_DONE)) == THRD_READY;
+}
+
+/* Terminates a task of the cyclic executive */
+static
+void cyclic_finish (thrd_t *t)
+{
+    if (t->info.destroy) {
+        t->info.destroy(t->info.context);
+    }
+    __atomic_or_fetch(&t->status, THRD_DONE, __ATOMIC_RELEASE);
+}
+
+/* Comparsion between tasks, sorts by increasing quantized period. */
+static
+int frames_cmp (const void *a, const void *b)
+{
+    const thrd_t *t0 = *(thrd_t * const *)a;
+    const thrd_t *t1 = *(thrd_t * const *)b;
+
+    if (t0->cyc_frames == t1->cyc_frames) return 0;
+    return t0->cyc_frames < t1->cyc_frames ? -1 : 1;
+}
+
+/* Builds the schedule table of the live tasks, the first frame starting
+ * at origin. The minor frame is the greatest common divisor of the
+ * periods (the shortest period if the divisor is too short), and the
+ * periods are rounded down to a multiple of it. If the hyperperiod is
+ * longer than THRD_CYCLIC_MAX_FRAMES, periods are rounded down to a power
+ * of two, so that they become harmonic. Returns the number of tasks in
+ * the table. */
+static
+unsigned cyclic_build (thrd_pool_t *pool, const struct timespec *origin)
+{
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    thrd_t **live;
+    diter_t *i;
+    unsigned n = 0, k, f, slot;
+    uint64_t minor = 0, shortest = 0, hyper = 1, start, next;
+
+    free(cyc->first);
+    free(cyc->slots);
+    cyc->first = NULL;
+    cyc->slots = NULL;
+    cyc->nframes = 0;
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        if (cyclic_live((const thrd_t *) diter_next(i))) n ++;
+    }
+    dlist_iter_free(i);
+    if (n == 0) {
+        return 0;
+    }
+
+    live = (thrd_t **) calloc(n, sizeof(thrd_t *));
+    assert(live);
+    n = 0;
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (!cyclic_live(t)) continue;
+        t->cyc_source = period_ns(t);
+        minor = gcd(minor, t->cyc_source);
+        if (shortest == 0 || t->cyc_source < shortest) {
+            shortest = t->cyc_source;
+        }
+        live[n ++] = t;
+    }
+    dlist_iter_free(i);
+
+    if (minor < THRD_CYCLIC_MIN_FRAME) {
+        minor = shortest;
+    }
+    for (k = 0; k < n; k ++) {
+        live[k]->cyc_frames = live[k]->cyc_source / minor;
+    }
+    for (k = 0; k < n && hyper <= THRD_CYCLIC_MAX_FRAMES; k ++) {
+        hyper = hyper / gcd(hyper, live[k]->cyc_frames)
+              * live[k]->cyc_frames;
+    }
+    if (hyper > THRD_CYCLIC_MAX_FRAMES) {
+        hyper = 1;
+        for (k = 0; k < n; k ++) {
+            f = 1;
+            while (f * 2 <= live[k]->cyc_frames
+                    && f * 2 <= THRD_CYCLIC_MAX_FRAMES) {
+                f *= 2;
+            }
+            live[k]->cyc_frames = f;
+            if (f > hyper) hyper = f;
+        }
+        DEBUG_MSG("Cyclic executive: periods made harmonic");
+    }
+
+    /* Each task is placed on the first frame following its next
+     * release. */
+    start = rtutils_time2ns(origin);
+    slot = 0;
+    for (k = 0; k < n; k ++) {
+        thrd_t *t = live[k];
+
+        t->cyc_period = t->cyc_frames * minor;
+        if (t->cyc_period != t->cyc_source) {
+            LOG_FMT("Cyclic executive: period of '%s' quantized from "
+                    "%llu ns to %llu ns", t->info.name ? t->info.name : "?",
+                    (unsigned long long) t->cyc_source,
+                    (unsigned long long) t->cyc_period);
+        }
+        next = rtutils_time2ns(&t->next);
+        if (next < start) {
+            next = start;
+            rtutils_time_copy(&t->next, origin);
+        }
+        t->cyc_phase = (next - start + minor - 1) / minor % t->cyc_frames;
+        slot += hyper / t->cyc_frames;
+    }
+    qsort(live, n, sizeof(thrd_t *), frames_cmp);
+
+    cyc->minor = minor;
+    cyc->nframes = hyper;
+    cyc->first = (unsigned *) calloc(hyper + 1, sizeof(unsigned));
+    cyc->slots = (thrd_t **) calloc(slot, sizeof(thrd_t *));
+    assert(cyc->first && cyc->slots);
+
+    /* Within a frame tasks are sorted Rate Monotonic */
+    slot = 0;
+    for (f = 0; f < hyper; f ++) {
+        cyc->first[f] = slot;
+        for (k = 0; k < n; k ++) {
+            if (f % live[k]->cyc_frames == live[k]->cyc_phase) {
+                cyc->slots[slot ++] = live[k];
+            }
+        }
+    }
+    cyc->first[hyper] = slot;
+    free(live);
+
+    DEBUG_FMT("Cyclic executive: %u frames of %llu ns", cyc->nframes,
+              (unsigned long long) minor);
+    return n;
+}
+
+/* Schedulability test for the table: the tasks released on each frame
+ * must fit in the frame. Returns 0 if the task set is schedulable. */
+static
+int cyclic_test (thrd_pool_t *pool)
+{
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    uint64_t load, worst = 0;
+    unsigned f, k, worst_frame = 0;
+
+    for (f = 0; f < cyc->nframes; f ++) {
+        load = 0;
+        for (k = cyc->first[f]; k < cyc->first[f + 1]; k ++) {
+            load += cyc->slots[k]->wcet;
+        }
+        if (load > worst) {
+            worst = load;
+            worst_frame = f;
+        }
+    }
+    LOG_FMT("Cyclic executive: %u frames of %llu ns, worst load %llu ns "
+            "(frame %u)%s", cyc->nframes,
+            (unsigned long long) cyc->minor,
+            (unsigned long long) worst, worst_frame,
+            worst > cyc->minor ? " (UNSCHEDULABLE)" : "");
+    return worst > cyc->minor ? -1 : 0;
+}
+
+/* Dispatches a task released on the frame starting at the given time.
+ * The time spent spinning before the frame is accounted to the first task
+ * of the frame, and dropped if that task is not released. Returns
+ * non-zero if the table must be rebuilt, since the task either terminated
+ * or changed its period. */
+static
+int cyclic_dispatch (thrd_t *t, const struct timespec *frame,
+                     uint64_t *spin)
+{
+    struct timespec start_time, finish_time;
+    uint64_t release, finish, deadline, cpu_start, exec;
+    uint64_t minor_start, major_start, minor, major;
+    uint64_t events[PERFCTR_EVENTS];
+    perfctr_t *counters = t->pool->cyclic.counters;
+    unsigned skipped;
+
+    if (!cyclic_live(t)) {
+        return 0;
+    }
+    if (__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+        cyclic_finish(t);
+        return 1;
+    }
+
+    /* Not started yet, or activation skipped after an overrun */
+    release = rtutils_time2ns(frame);
+    if (rtutils_time2ns(&t->next) > release) {
+        *spin = 0;
+        return 0;
+    }
+
+    current = t;
+    rtutils_get_now(&start_time);
+    trace_start(t, release, rtutils_time2ns(&start_time));
+    page_faults(&minor_start, &major_start);
+    counters_start(counters, events);
+    cpu_start = cpu_time();
+    if (run_callback(t, t->info.context)) {
+        cyclic_finish(t);
+        return 1;
+    }
+    exec = cpu_time() - cpu_start;
+    page_faults(&minor, &major);
+    minor -= minor_start;
+    major -= major_start;
+    rtutils_get_now(&finish_time);
+    finish = rtutils_time2ns(&finish_time);
+
+    deadline = release + (rtutils_time_iszero(&t->info.deadline)
+                          ? t->cyc_period
+                          : rtutils_time2ns(&t->info.deadline));
+    t->next = rtutils_ns2time(release + t->cyc_period);
+    skipped = overrun(t, &t->next, finish, t->cyc_period);
+    update_statistics(&t->statistics, release,
+                      rtutils_time2ns(&start_time), finish, exec,
+                      deadline < finish, skipped, *spin, minor, major,
+                      counters_stop(counters, events));
+    trace_finish(t, finish, deadline, exec, skipped, minor + major);
+    *spin = 0;
+    if (skipped && t->info.overrun == THRD_OVERRUN_DEGRADE &&
+            t->info.on_overrun) {
+        t->info.on_overrun(t->info.context, skipped);
+    }
+
+    return period_ns(t) != t->cyc_source;
+}
+
+/* Startup of the dispatcher: runs "Start" on the new tasks and, with
+ * admission control, calibrates them and tests the table. The outcome
+ * goes to the thread waiting in cyclic_start(). The table origin is
+ * stored in the given time. */
+static
+void cyclic_prepare (thrd_pool_t *pool, struct timespec *origin)
+{
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    int verdict = THRD_GATE_GO;
+    int fresh = 0;
+    diter_t *i;
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (t->status & (THRD_READY | THRD_DONE)) continue;
+
+        current = t;
+        __atomic_or_fetch(&t->status, THRD_READY, __ATOMIC_RELEASE);
+        if ((t->info.init && t->info.init(t->info.context)) ||
+                (pool->admission != THRD_ADMIT_OFF &&
+                 calibrate(t, t->info.context))) {
+            cyclic_finish(t);
+            continue;
+        }
+        fresh ++;
+    }
+    dlist_iter_free(i);
+
+    /* Startup delays count from now */
+    rtutils_get_now(origin);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (cyclic_live(t) && t->gate == THRD_GATE_WAIT) {
+            set_start(t, origin);
+            rtutils_time_copy(&t->next, &t->start);
+        }
+    }
+    dlist_iter_free(i);
+    cyclic_build(pool, origin);
+
+    if (fresh && pool->admission != THRD_ADMIT_OFF && cyclic_test(pool)) {
+        if (pool->admission == THRD_ADMIT_REJECT) {
+            verdict = THRD_GATE_KILL;
+        } else {
+            LOG_MSG("WARNING: the task set may be unschedulable");
+        }
+    }
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (!cyclic_live(t) || t->gate != THRD_GATE_WAIT) continue;
+        t->gate = verdict;
+        if (verdict == THRD_GATE_KILL) {
+            cyclic_finish(t);
+        }
+    }
+    dlist_iter_free(i);
+    if (verdict != THRD_GATE_GO) {
+        cyclic_build(pool, origin);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    cyc->verdict = verdict;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Frames releasing a task which requires busy waiting are waited that
+ * way. */
+static
+thrd_wake_t cyclic_wake (const struct thrd_cyclic *cyc, unsigned f)
+{
+    unsigned k;
+
+    for (k = cyc->first[f]; k < cyc->first[f + 1]; k ++) {
+        if (cyc->slots[k]->info.wake == THRD_WAKE_SPIN) {
+            return THRD_WAKE_SPIN;
+        }
+    }
+    return THRD_WAKE_SLEEP;
+}
+
+/* The dispatcher of the cyclic executive. Late frames are run back to
+ * back, while the overrun policy of each task decides whether its late
+ * activations are kept. */
+static
+void * cyclic_routine (void *arg)
+{
+    thrd_pool_t *pool = (thrd_pool_t *)arg;
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    struct timespec frame;
+    unsigned f = 0, k;
+    uint64_t spin = 0;
+    int rebuild;
+    diter_t *i;
+
+    prefault_stack(cyc->prefault);
+    logging_attach();
+    if (pool->watchdog) {
+        backtrace_prime();
+    }
+    if (pool->counters && (cyc->counters = perfctr_open()) == NULL) {
+        ERR_FMT("Hardware counters unavailable: %s", strerror(errno));
+    }
+    cyclic_prepare(pool, &frame);
+
+    while (cyc->nframes && !__atomic_load_n(&cyc->pause, __ATOMIC_ACQUIRE)) {
+        rebuild = 0;
+        for (k = cyc->first[f]; k < cyc->first[f + 1]; k ++) {
+            rebuild |= cyclic_dispatch(cyc->slots[k], &frame, &spin);
+        }
+
+        frame = rtutils_ns2time(rtutils_time2ns(&frame) + cyc->minor);
+        if (rebuild) {
+            cyclic_build(pool, &frame);
+            f = 0;
+        } else {
+            f = (f + 1) % cyc->nframes;
+        }
+        if (cyc->nframes) {
+            spin = wake_at(cyclic_wake(cyc, f), &cyc->margin, cyc->minor,
+                           &frame);
+        }
+    }
+
+    /* Tasks removed while pausing */
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (cyclic_live(t) && __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+            cyclic_finish(t);
+        }
+    }
+    dlist_iter_free(i);
+
+    if (cyc->counters) {
+        perfctr_close(cyc->counters);
+        cyc->counters = NULL;
+    }
+    return NULL;
+}
+
+/* Starts the dispatcher with the highest priority of the task set, then
+ * waits for the admission of the new tasks. The refused ones get
+ * destroyed. */
+static
+int cyclic_start (thrd_pool_t *pool)
+{
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    pthread_attr_t attr;
+    diter_t *i;
+    int err;
+
+    /* The callbacks run on the stack of the dispatcher: it gets the
+     * largest one required by the tasks. */
+    cyc->priority = pool->minprio;
+    cyc->stack_size = 0;
+    cyc->prefault = THRD_STACK_PREFAULT;
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (t->priority > cyc->priority) {
+            cyc->priority = t->priority;
+        }
+        if (stack_size(t->info.stack_size) > cyc->stack_size) {
+            cyc->stack_size = stack_size(t->info.stack_size);
+            cyc->prefault = stack_prefault(cyc->stack_size);
+        }
+    }
+    dlist_iter_free(i);
+
+    err = pthread_attr_init(&attr);
+    assert(err == 0);
+    if (cyc->stack_size) {
+        err = pthread_attr_setstacksize(&attr, cyc->stack_size);
+        assert(err == 0);
+    }
+
+    #ifndef RT_DISABLE
+    {
+        struct sched_param param = {
+            .sched_priority = cyc->priority
+        };
+
+        err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        assert(err == 0);
+        err = pthread_attr_setschedparam(&attr, &param);
+        assert(err == 0);
+        err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        assert(err == 0);
+    }
+    #endif
+
+    cyc->verdict = THRD_GATE_WAIT;
+    err = pthread_create(&cyc->handler, &attr, cyclic_routine,
+                         (void *) pool);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pool->status |= THRD_ERR_LIBRARY;
+        pool->err = err;
+        return -1;
+    }
+    cyc->running = 1;
+
+    pthread_mutex_lock(&pool->lock);
+    while (cyc->verdict == THRD_GATE_WAIT) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (cyc->verdict != THRD_GATE_GO) {
+        pool->status |= THRD_ERR_UNSCHED;
+        return -1;
+    }
+    return 0;
+}
+
+/* Stops the dispatcher at the end of the current frame, so that the task
+ * set can be changed. */
+static
+void cyclic_pause (thrd_pool_t *pool)
+{
+    struct thrd_cyclic *cyc = &pool->cyclic;
+
+    if (!cyc->running) {
+        return;
+    }
+    __atomic_store_n(&cyc->pause, 1, __ATOMIC_RELEASE);
+    pthread_join(cyc->handler, NULL);
+    cyc->pause = 0;
+    cyc->running = 0;
+}
+
+/* Rate Monotonic priorities after a change of period. The list is not
+ * relinked, since the owner of the pool may be walking it: each task gets
+ * its rank among the periods, ties broken by age. Called under
+ * pool::watch. */
+static
+void rerank (thrd_pool_t *pool)
+{
+    diter_t *i, *j;
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+        uint8_t status = __atomic_load_n(&t->status, __ATOMIC_ACQUIRE);
+        int prio = pool->minprio;
+
+        j = dlist_iter_new(&pool->threads);
+        while (diter_hasnext(j)) {
+            const thrd_t *h = (const thrd_t *) diter_next(j);
+
+            if (period_ns(h) > period_ns(t)
+                    || (period_ns(h) == period_ns(t) && h->id < t->id)) {
+                prio ++;
+            }
+        }
+        dlist_iter_free(j);
+
+        if (prio == t->priority) {
+            continue;
+        }
+        t->priority = prio;
+        #ifndef RT_DISABLE
+        if ((status & (THRD_ALIVE | THRD_EXITED | THRD_DEADLINE))
+                == THRD_ALIVE) {
+            struct sched_param param = {
+                .sched_priority = prio
+            };
+
+            pthread_setschedparam(t->handler, SCHED_FIFO, &param);
+        }
+        #else
+        (void) status;
+        #endif
+    }
+    dlist_iter_free(i);
+}
+
+void thrd_set_period (const struct timespec *period)
+{
+    thrd_pool_t *pool;
+
+    assert(current != NULL);
+    assert(!rtutils_time_iszero(period));
+
+    pool = current->pool;
+    if (rtutils_time2ns(period) == current->period) {
+        return;
+    }
+    rtutils_time_copy(&current->info.period, period);
+    __atomic_store_n(&current->period, rtutils_time2ns(period),
+                     __ATOMIC_RELAXED);
+    if (current->status & THRD_DEADLINE) {
+        set_deadline(current);
+    } else if (pool->policy == THRD_POLICY_RM) {
+        pthread_mutex_lock(&pool->watch);
+        rerank(pool);
+        pthread_mutex_unlock(&pool->watch);
+    }
+}
+
+void thrd_set_policy (thrd_pool_t *pool, thrd_policy_t policy)
+{
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    pool->policy = policy;
+}
+
+void thrd_set_partitioned (thrd_pool_t *pool, int enable)
+{
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    pool->partitioned = enable;
+}
+
+void thrd_set_admission (thrd_pool_t *pool, thrd_admission_t mode)
+{
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    pool->admission = mode;
+}
+
+void thrd_set_counters (thrd_pool_t *pool, int enable)
+{
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    pool->counters = enable;
+}
+
+void thrd_set_watchdog (thrd_pool_t *pool, unsigned periods)
+{
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    pool->watchdog = periods;
+}
+
+/* Comparsion between threads, allows to determine which has the smallest
+ * period.
+ */
+static
+int prio_cmp (const thrd_t *t0, const thrd_t *t1)
+{
+    return period_ns(t0) > period_ns(t1) ? -1 : 1;
+}
+
+/* Sorts the list basing on the period, getting a rate-monotonic priority
+ * assignment. The watchdog walks the list, so it is relinked under
+ * pool::watch. */
+static
+int set_rm_priorities (thrd_pool_t *pool)
+{
+    diter_t *i;
+    int prio = pool->minprio;
+
+    pthread_mutex_lock(&pool->watch);
+
+    /* Sort by period */
+    pool->threads = dlist_sort(pool->threads, (dcmp_func_t) prio_cmp);
+    i = dlist_iter_new(&pool->threads);
+
+    /* Assign priorities */
+    while (diter_hasnext(i)) {
+        thrd_t *t;
+
+        t = (thrd_t *) diter_next(i);
+        t->priority = prio ++;
+    }
+    dlist_iter_free(i);
+
+    pthread_mutex_unlock(&pool->watch);
+    return 0;
+}
+
+/* Utilization of a task, in parts per million. The calibrated execution
+ * time is preferred to the declared budget. */
+static
+uint32_t utilization (const thrd_t *t)
+{
+    uint64_t period, exec;
+
+    period = period_ns(t);
+    exec = t->wcet ? t->wcet : rtutils_time2ns(&t->info.runtime);
+    if (exec == 0) {
+        return THRD_PART_DEFAULT_UTIL;
+    }
+    if (period == 0) {
+        return THRD_PART_FULL;
+    }
+    return exec * THRD_PART_FULL / period;
+}
+
+/* Comparsion between threads, sorts by decreasing utilization. */
+static
+int util_cmp (const thrd_t *t0, const thrd_t *t1)
+{
+    return utilization(t0) > utilization(t1) ? -1 : 1;
+}
+
+/* CPUs available to the pool */
+static
+void available_cpus (cpu_set_t *avail)
+{
+    int err;
+
+    err = sched_getaffinity(0, sizeof(cpu_set_t), avail);
+    assert(err == 0);
+}
+
+/* Pins every unconstrained thread on a single CPU among the available
+ * ones, first-fit decreasing by utilization. When no CPU has room left
+ * the least loaded one gets the thread. */
+static
+void partition (thrd_pool_t *pool, const cpu_set_t *avail)
+{
+    uint32_t *load;
+    diter_t *i;
+    int cpu;
+
+    load = (uint32_t *) calloc(CPU_SETSIZE, sizeof(uint32_t));
+    assert(load);
+
+    /* Load of the threads which are already pinned */
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (CPU_COUNT(&t->info.cpus) == 1) {
+            for (cpu = 0; !CPU_ISSET(cpu, &t->info.cpus); cpu ++);
+            load[cpu] += utilization(t);
+        }
+    }
+    dlist_iter_free(i);
+
+    /* Relinked under pool::watch, like in set_rm_priorities() */
+    pthread_mutex_lock(&pool->watch);
+    pool->threads = dlist_sort(pool->threads, (dcmp_func_t) util_cmp);
+    pthread_mutex_unlock(&pool->watch);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+        uint32_t u;
+        int best = -1;
+
+        if (CPU_COUNT(&t->info.cpus) > 0) continue;
+
+        u = utilization(t);
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu ++) {
+            if (!CPU_ISSET(cpu, avail)) continue;
+            if (load[cpu] + u <= THRD_PART_RM_BOUND) {
+                best = cpu;
+                break;
+            }
+            if (best == -1 || load[cpu] < load[best]) {
+                best = cpu;
+            }
+        }
+        if (load[best] + u > THRD_PART_RM_BOUND) {
+            LOG_FMT("No room for a thread, overloading CPU %d", best);
+        }
+        DEBUG_FMT("Thread pinned on CPU %d", best);
+        load[best] += u;
+        CPU_SET(best, &t->info.cpus);
+    }
+    dlist_iter_free(i);
+    free(load);
+}
+
+/* SCHED_DEADLINE threads must be allowed on every CPU, and the cyclic
+ * executive has a single thread. */
+static
+int check_affinity (thrd_pool_t *pool)
+{
+    diter_t *i;
+    int ret = 0;
+
+    if (pool->policy == THRD_POLICY_RM) {
+        return 0;
+    }
+    if (pool->partitioned) {
+        return -1;
+    }
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (CPU_COUNT(&t->info.cpus) > 0) {
+            ret = -1;
+        }
+    }
+    dlist_iter_free(i);
+    return ret;
+}
+
+/* Relative deadline of a task, in nanoseconds */
+static
+uint64_t deadline_ns (const thrd_t *t)
+{
+    return rtutils_time_iszero(&t->info.deadline)
+           ? period_ns(t)
+           : rtutils_time2ns(&t->info.deadline);
+}
+
+/* Two tasks interfere unless they are pinned on different CPUs. Tasks
+ * which are free to migrate are pessimistically considered as sharing a
+ * single CPU with everybody. */
+static
+int interfere (const thrd_t *t0, const thrd_t *t1)
+{
+    return CPU_COUNT(&t0->info.cpus) != 1
+        || CPU_COUNT(&t1->info.cpus) != 1
+        || CPU_EQUAL(&t0->info.cpus, &t1->info.cpus);
+}
+
+/* Response time analysis for fixed priorities. The iteration stops as
+ * soon as the response time exceeds the deadline. */
+static
+uint64_t response_time (thrd_pool_t *pool, const thrd_t *t)
+{
+    uint64_t r, prev;
+    uint64_t deadline = deadline_ns(t);
+    diter_t *i;
+
+    r = t->wcet;
+    do {
+        prev = r;
+        r = t->wcet;
+
+        i = dlist_iter_new(&pool->threads);
+        while (diter_hasnext(i)) {
+            const thrd_t *h = (const thrd_t *) diter_next(i);
+            uint64_t period = period_ns(h);
+
+            if (h->priority > t->priority && interfere(h, t)) {
+                r += (prev + period - 1) / period * h->wcet;
+            }
+        }
+        dlist_iter_free(i);
+    } while (r != prev && r <= deadline);
+
+    return r;
+}
+
+/* Schedulability test over the calibrated execution times: Response Time
+ * Analysis under Rate Monotonic, density test under EDF. The latter
+ * checks the same bound applied by SCHED_DEADLINE admission (total
+ * bandwidth within the available CPUs). Returns 0 if the task set is
+ * schedulable. */
+static
+int admission_test (thrd_pool_t *pool, const cpu_set_t *avail)
+{
+    diter_t *i;
+    unsigned n = 0;
+    uint64_t density = 0;
+    int ret = 0;
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        const thrd_t *t = (const thrd_t *) diter_next(i);
+        uint64_t deadline = deadline_ns(t);
+
+        if (pool->policy == THRD_POLICY_EDF) {
+            uint64_t runtime = rtutils_time2ns(&t->info.runtime);
+
+            density += runtime * THRD_PART_FULL / deadline;
+            LOG_FMT("Task %u: WCET %llu ns, budget %llu ns, "
+                    "deadline %llu ns", n,
+                    (unsigned long long) t->wcet,
+                    (unsigned long long) runtime,
+                    (unsigned long long) deadline);
+            if (runtime > deadline) ret = -1;
+        } else {
+            uint64_t r = response_time(pool, t);
+
+            LOG_FMT("Task %u: WCET %llu ns, response %llu ns, "
+                    "deadline %llu ns%s", n,
+                    (unsigned long long) t->wcet,
+                    (unsigned long long) r,
+                    (unsigned long long) deadline,
+                    r > deadline ? " (UNSCHEDULABLE)" : "");
+            if (r > deadline) ret = -1;
+        }
+        n ++;
+    }
+    dlist_iter_free(i);
+
+    if (pool->policy == THRD_POLICY_EDF) {
+        LOG_FMT("EDF density: %llu.%04llu over %d CPUs",
+                (unsigned long long) density / THRD_PART_FULL,
+                (unsigned long long) density % THRD_PART_FULL / 100,
+                CPU_COUNT(avail));
+        if (density > (uint64_t) CPU_COUNT(avail) * THRD_PART_FULL) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/* Sets the admission outcome (THRD_GATE_*) of the threads still waiting
+ * for it, and wakes them up. */
+static
+void release (thrd_pool_t *pool, int gate)
+{
+    diter_t *i;
+
+    pthread_mutex_lock(&pool->lock);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (t->gate == THRD_GATE_WAIT) {
+            t->gate = gate;
+        }
+    }
+    dlist_iter_free(i);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Placement of the calibrated threads, which are waiting at the gate:
+ * partition() can use their measured execution time, then each of them
+ * moves on its CPU before being released. */
+static
+void repartition (thrd_pool_t *pool, const cpu_set_t *avail)
+{
+    diter_t *i;
+    int err;
+
+    partition(pool, avail);
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (t->gate == THRD_GATE_WAIT && (t->status & THRD_ALIVE)) {
+            err = pthread_setaffinity_np(t->handler, sizeof(cpu_set_t),
+                                         &t->info.cpus);
+            if (err) {
+                ERR_FMT("Cannot pin thread '%s': %s",
+                        t->info.name ? t->info.name : "?", strerror(err));
+            }
+        }
+    }
+    dlist_iter_free(i);
+}
+
+/* Admission phase: waits for the calibration of the threads which are
+ * not admitted yet, then runs the schedulability test. The refused
+ * threads get destroyed. */
+static
+int admit (thrd_pool_t *pool)
+{
+    diter_t *i;
+    struct timespec now;
+    cpu_set_t avail;
+    int pending;
+
+    pthread_mutex_lock(&pool->lock);
+    do {
+        pending = 0;
+        i = dlist_iter_new(&pool->threads);
+        while (diter_hasnext(i)) {
+            thrd_t *t = (thrd_t *) diter_next(i);
+
+            if (t->gate == THRD_GATE_WAIT && (t->status & THRD_ALIVE)
+                    && !t->calibrated) {
+                pending = 1;
+            }
+        }
+        dlist_iter_free(i);
+        if (pending) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+    } while (pending);
+    pthread_mutex_unlock(&pool->lock);
+
+    available_cpus(&avail);
+    if (pool->partitioned) {
+        repartition(pool, &avail);
+    }
+    if (admission_test(pool, &avail)) {
+        if (pool->admission == THRD_ADMIT_REJECT) {
+            release(pool, THRD_GATE_KILL);
+            return -1;
+        }
+        LOG_MSG("WARNING: the task set may be unschedulable");
+    }
+
+    /* Startup delays count from the end of the calibration. */
+    i = dlist_iter_new(&pool->threads);
+    rtutils_get_now(&now);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (t->gate == THRD_GATE_WAIT) {
+            set_start(t, &now);
+        }
+    }
+    dlist_iter_free(i);
+
+    release(pool, THRD_GATE_GO);
+    return 0;
+}
+
+/* Rate Monotonic priorities after a change of the task set. Threads
+ * running under SCHED_DEADLINE are left alone. */
+static
+void reprioritize (thrd_pool_t *pool)
+{
+    #ifndef RT_DISABLE
+    diter_t *i;
+    #endif
+
+    set_rm_priorities(pool);
+
+    #ifndef RT_DISABLE
+    /* Against rerank(), run by the tasks changing their period */
+    pthread_mutex_lock(&pool->watch);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+        uint8_t status = __atomic_load_n(&t->status, __ATOMIC_ACQUIRE);
+        struct sched_param param = {
+            .sched_priority = t->priority
+        };
+
+        /* A thread which already returned is not scheduled anymore */
+        if ((status & (THRD_ALIVE | THRD_EXITED | THRD_DEADLINE))
+                == THRD_ALIVE) {
+            pthread_setschedparam(t->handler, SCHED_FIFO, &param);
+        }
+    }
+    dlist_iter_free(i);
+    pthread_mutex_unlock(&pool->watch);
+    #endif
+}
+
+static
+void free_thread (void *thrd)
+{
+    thrd_t *t;
+
+    t = (thrd_t *)thrd;
+
+    if (t->status & THRD_ALIVE) {
+        pthread_join(t->handler, NULL);
+    }
+    if (t->counters) {
+        perfctr_close(t->counters);
+    }
+    free(t);
+}
+
+/* Removes a thread from the pool, joining it if it was started. */
+static
+void unlink_thread (thrd_pool_t *pool, thrd_t *thrd)
+{
+    diter_t *i;
+
+    pthread_mutex_lock(&pool->watch);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        if (diter_next(i) == thrd) {
+            diter_remove(i, NULL);
+            break;
+        }
+    }
+    dlist_iter_free(i);
+    pthread_mutex_unlock(&pool->watch);
+
+    free_thread(thrd);
+}
+
+/* Removes a thread from the pool, which may be running. */
+static
+void detach_thread (thrd_pool_t *pool, thrd_t *thrd)
+{
+    if ((pool->status & THRD_POOL_ACTIVE) == 0) {
+        unlink_thread(pool, thrd);
+    } else if (pool->policy == THRD_POLICY_CYCLIC) {
+        cyclic_pause(pool);
+        unlink_thread(pool, thrd);
+        cyclic_start(pool);
+    } else {
+        unlink_thread(pool, thrd);
+        reprioritize(pool);
+    }
+}
+
+/* Starts a thread on an active pool. On failure the thread is still in
+ * the list. */
+static
+int hot_start (thrd_pool_t *pool, thrd_t *thrd)
+{
+    struct timespec now;
+    cpu_set_t avail;
+    int err;
+
+    if (check_affinity(pool)) {
+        pool->status |= THRD_ERR_AFFINITY;
+        return -1;
+    }
+    if (pool->policy == THRD_POLICY_CYCLIC) {
+        set_rm_priorities(pool);
+        return cyclic_start(pool);
+    }
+    if (pool->partitioned && pool->admission == THRD_ADMIT_OFF) {
+        available_cpus(&avail);
+        partition(pool, &avail);
+    }
+    reprioritize(pool);
+
+    thrd->policy = pool->policy;
+    rtutils_get_now(&now);
+    err = startup(thrd, &now);
+    if (err) {
+        pool->status |= THRD_ERR_LIBRARY;
+        pool->err = err;
+        return -1;
+    }
+
+    if (pool->admission != THRD_ADMIT_OFF
+            && admit(pool)) {
+        pool->status |= THRD_ERR_UNSCHED;
+        return -1;
+    }
+    return 0;
+}
+
+const thrd_rtstats_t * thrd_add (thrd_pool_t *pool,
+                                 const thrd_info_t * new_thrd)
+{
+    thrd_t *item;
+
+    /* There's no pending error */
+    assert((pool->status & THRD_ERR_ALL) == 0);
+    assert(new_thrd->callback);
+
+    DEBUG_MSG("Added another thread");
+
+    item = (thrd_t *) calloc(1, sizeof(thrd_t));
+    assert(item);
+    item->status = THRD_INITIALIZED;
+    item->pool = pool;
+    item->id = ++ pool->last_id;
+    memcpy((void *)&item->info, (const void *)new_thrd,
+           sizeof(thrd_info_t));
+    item->period = rtutils_time2ns(&item->info.period);
+
+    /* The dispatcher of the cyclic executive walks the list: it must be
+     * paused before changing it. */
+    if ((pool->status & THRD_POOL_ACTIVE)
+            && pool->policy == THRD_POLICY_CYCLIC) {
+        cyclic_pause(pool);
+    }
+
+    /* New thread is added to the thread list */
+    pthread_mutex_lock(&pool->watch);
+    pool->threads = dlist_append(pool->threads, (void *)item);
+    pthread_mutex_unlock(&pool->watch);
+
+    /* On a running pool the thread starts immediately. */
+    /* On failure the context is destroyed: by the thread itself if it got
+     * started, here otherwise. */
+    if ((pool->status & THRD_POOL_ACTIVE) && hot_start(pool, item)) {
+        if ((item->status & (THRD_ALIVE | THRD_READY)) == 0
+                && item->info.destroy) {
+            item->info.destroy(item->info.context);
+        }
+        detach_thread(pool, item);
+        return NULL;
+    }
+
+    return &item->statistics;
+}
+
+int thrd_remove (thrd_pool_t *pool, const thrd_rtstats_t *stats)
+{
+    diter_t *i;
+    thrd_t *found = NULL;
+
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        if (&t->statistics == stats) {
+            found = t;
+            break;
+        }
+    }
+    dlist_iter_free(i);
+
+    if (found == NULL) {
+        return -1;
+    }
+
+    /* The thread notices the request at its next activation. */
+    __atomic_store_n(&found->stop, 1, __ATOMIC_RELEASE);
+    detach_thread(pool, found);
+    return 0;
+}
+
+/* Watchdog. The monitor thread compares the heartbeat of each task with
+ * the one seen at the previous checks: a task whose heartbeat doesn't
+ * move for too long is reported once, until it moves again. */
+
+static const char * const event_names[] = {
+    [THRD_EVENT_RELEASE] = "release",
+    [THRD_EVENT_START] = "start",
+    [THRD_EVENT_FINISH] = "finish",
+    [THRD_EVENT_MISS] = "deadline miss",
+    [THRD_EVENT_SKIP] = "skip",
+    [THRD_EVENT_LOCK] = "lock wait",
+    [THRD_EVENT_XRUN] = "xrun",
+    [THRD_EVENT_FAULT] = "page fault"
+};
+
+/* Set by the stalled thread once its stack is written */
+static int stack_dumped;
+
+/* Runs on the stalled thread: writes its stack, and lets the callback
+ * go on. backtrace() was primed when the thread started, and
+ * backtrace_symbols_fd() doesn't allocate. */
+static
+void watchdog_signal (int sig)
+{
+    void *frames[THRD_WATCHDOG_DEPTH];
+    int n;
+
+    n = backtrace(frames, THRD_WATCHDOG_DEPTH);
+    backtrace_symbols_fd(frames, n, STDERR_FILENO);
+    __atomic_store_n(&stack_dumped, 1, __ATOMIC_RELEASE);
+}
+
+/* A change in the state of a task, copied under pool::watch and written
+ * after releasing it: the monitor runs with the highest priority, and
+ * the threads changing the task set must not wait for the standard
+ * error. */
+struct stall {
+    const thrd_t *thrd;         /* The task, compared only once the lock
+                                 * is released; */
+    unsigned id;                /* Its thrd_t::id; */
+    int resumed;                /* Running again, nothing else is set; */
+    char name[THRD_WATCHDOG_NAME];
+    int inside;                 /* Stalled in its callback; */
+    uint64_t now;               /* Time of the check (ns); */
+    uint64_t elapsed;           /* Since the last heartbeat (ns); */
+    uint64_t period;            /* Period of the task (ns); */
+    int priority;               /* Priority of the task; */
+    thrd_rtstats_t stats;       /* Statistics of the task; */
+    unsigned nevents;           /* Recent events, oldest first. */
+    thrd_event_t events[THRD_WATCHDOG_EVENTS];
+};
+
+/* Identifies the task of a report */
+static
+void watchdog_name (struct stall *st, const thrd_t *t)
+{
+    st->thrd = t;
+    st->id = t->id;
+    snprintf(st->name, THRD_WATCHDOG_NAME, "%s",
+             t->info.name ? t->info.name : "?");
+}
+
+/* Fills the report of a stalled task. The task doesn't write its trace
+ * while stalled. */
+static
+void watchdog_copy (struct stall *st, const thrd_t *t, uint64_t now)
+{
+    uint64_t head, n;
+
+    st->inside = t->heartbeat & 1;
+    st->now = now;
+    st->elapsed = now - t->beat_time;
+    st->period = period_ns(t);
+    st->priority = t->priority;
+    thrd_rtstats_snapshot(&t->statistics, &st->stats);
+
+    head = __atomic_load_n(&t->trace_head, __ATOMIC_ACQUIRE);
+    n = head > THRD_WATCHDOG_EVENTS ? head - THRD_WATCHDOG_EVENTS : 0;
+    for (st->nevents = 0; n < head; n ++) {
+        st->events[st->nevents ++] = t->trace[n & (THRD_TRACE_EVENTS - 1)];
+    }
+}
+
+/* Asks the thread running a stalled task for its stack, and waits for
+ * it a little. The task is looked up again, since it may have been
+ * removed meanwhile. */
+static
+void watchdog_stack (thrd_pool_t *pool, const struct stall *st)
+{
+    struct timespec poll = { .tv_sec = 0, .tv_nsec = 1000000 };
+    pthread_t handler;
+    diter_t *i;
+    thrd_t *t = NULL;
+    unsigned n;
+    int err = -1;
+
+    ERR_MSG("\tStack:");
+    fflush(stderr);
+    __atomic_store_n(&stack_dumped, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&pool->watch);
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *cand = (thrd_t *) diter_next(i);
+
+        if (cand == st->thrd && cand->id == st->id) {
+            t = cand;
+            break;
+        }
+    }
+    dlist_iter_free(i);
+    if (t) {
+        handler = pool->policy == THRD_POLICY_CYCLIC
+                  ? pool->cyclic.handler : t->handler;
+        err = pthread_kill(handler, SIGRTMIN);
+    }
+    pthread_mutex_unlock(&pool->watch);
+
+    if (err) {
+        return;
+    }
+    for (n = 0; n < 100; n ++) {
+        if (__atomic_load_n(&stack_dumped, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+        nanosleep(&poll, NULL);
+    }
+    ERR_MSG("\t(no answer)");
+}
+
+/* Writes the state and the recent events of a stalled task */
+static
+void watchdog_report (thrd_pool_t *pool, const struct stall *st)
+{
+    unsigned n;
+
+    if (st->resumed) {
+        ERR_FMT("Watchdog: thread '%s' running again", st->name);
+        return;
+    }
+
+    ERR_FMT("Watchdog: thread '%s' stalled %s for %llu ms", st->name,
+            st->inside ? "in its callback" : "out of its callback",
+            (unsigned long long) (st->elapsed / 1000000));
+    ERR_FMT("\tPeriod %llu ns, priority %d, %llu activations, worst "
+            "response %llu ns, %llu deadline misses",
+            (unsigned long long) st->period, st->priority,
+            (unsigned long long) st->stats.n_executions,
+            (unsigned long long) st->stats.wcrt,
+            (unsigned long long) st->stats.dmiss_count);
+
+    ERR_MSG("\tRecent events (ns before now):");
+    for (n = 0; n < st->nevents; n ++) {
+        const thrd_event_t *ev = &st->events[n];
+
+        ERR_FMT("\t\t%12llu %s (%u)",
+                (unsigned long long) (st->now > ev->time
+                                      ? st->now - ev->time : 0),
+                ev->type < sizeof(event_names) / sizeof(event_names[0])
+                ? event_names[ev->type] : "?", ev->arg);
+    }
+
+    if (st->inside) {
+        watchdog_stack(pool, st);
+    }
+}
+
+/* Checks the heartbeat of a task. Tasks which never ran, or are
+ * terminating, are not watched. Returns non-zero if the task stalled or
+ * resumed, filling the report. */
+static
+int watchdog_check (thrd_pool_t *pool, thrd_t *t, uint64_t now,
+                    struct stall *st)
+{
+    uint64_t beat = __atomic_load_n(&t->heartbeat, __ATOMIC_RELAXED);
+    uint64_t limit;
+    int resumed;
+
+    if (beat != t->beat_seen || beat == 0
+            || __atomic_load_n(&t->stop, __ATOMIC_ACQUIRE)) {
+        resumed = t->stalled;
+        t->beat_seen = beat;
+        t->beat_time = now;
+        t->stalled = 0;
+        if (resumed) {
+            watchdog_name(st, t);
+            st->resumed = 1;
+        }
+        return resumed;
+    }
+
+    limit = pool->watchdog * period_ns(t);
+    if (limit < THRD_WATCHDOG_MIN) {
+        limit = THRD_WATCHDOG_MIN;
+    }
+    if (!t->stalled && now - t->beat_time > limit) {
+        t->stalled = 1;
+        watchdog_name(st, t);
+        st->resumed = 0;
+        watchdog_copy(st, t, now);
+        return 1;
+    }
+    return 0;
+}
+
+/* At most one change is reported per check, the list being walked under
+ * the lock: the tasks following it are checked at the next tick. */
+static
+void * watchdog_routine (void *arg)
+{
+    thrd_pool_t *pool = (thrd_pool_t *) arg;
+    struct timespec tick = rtutils_ns2time(THRD_WATCHDOG_TICK);
+    struct timespec now;
+    struct stall *st;
+    diter_t *i;
+    int found;
+
+    backtrace_prime();
+    st = (struct stall *) malloc(sizeof(struct stall));
+    assert(st);
+
+    while (__atomic_load_n(&pool->watching, __ATOMIC_ACQUIRE)) {
+        nanosleep(&tick, NULL);
+        rtutils_get_now(&now);
+
+        found = 0;
+        pthread_mutex_lock(&pool->watch);
+        i = dlist_iter_new(&pool->threads);
+        while (!found && diter_hasnext(i)) {
+            found = watchdog_check(pool, (thrd_t *) diter_next(i),
+                                   rtutils_time2ns(&now), st);
+        }
+        dlist_iter_free(i);
+        pthread_mutex_unlock(&pool->watch);
+
+        if (found) {
+            watchdog_report(pool, st);
+        }
+    }
+    free(st);
+    return NULL;
+}
+
+/* Starts the monitor, above the priority of any task, so that a task
+ * spinning in its callback doesn't prevent the report. */
+static
+int watchdog_start (thrd_pool_t *pool)
+{
+    struct sigaction sa;
+    pthread_attr_t attr;
+    sigset_t all, old;
+    int err;
+
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_handler = watchdog_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGRTMIN, &sa, NULL);
+
+    err = pthread_attr_init(&attr);
+    assert(err == 0);
+
+    #ifndef RT_DISABLE
+    {
+        struct sched_param param = {
+            .sched_priority = sched_get_priority_max(SCHED_FIFO)
+        };
+
+        err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        assert(err == 0);
+        err = pthread_attr_setschedparam(&attr, &param);
+        assert(err == 0);
+        err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        assert(err == 0);
+    }
+    #endif
+
+    __atomic_store_n(&pool->watching, 1, __ATOMIC_RELEASE);
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    err = pthread_create(&pool->watcher, &attr, watchdog_routine,
+                         (void *) pool);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0) {
+        __atomic_store_n(&pool->watching, 0, __ATOMIC_RELEASE);
+        pool->err = err;
+        return -1;
+    }
+    return 0;
+}
+
+int thrd_start (thrd_pool_t *pool)
+{
+    diter_t *i;
+    int err;
+    struct timespec now;
+    cpu_set_t avail;
+
+    if (dlist_empty(pool->threads)) {
+        pool->status |= THRD_ERR_EMPTY;
+        return -1;
+    }
+
+    if (check_affinity(pool)) {
+        pool->status |= THRD_ERR_AFFINITY;
+        return -1;
+    }
 
-/* All error OR-ed, for cleanup, used by strerr */
-#define THRD_ERR_ALL \
-    ( THRD_ERR_LIBRARY | THRD_ERR_CLOSED | THRD_ERR_NULLPER | \
-      THRD_ERR_EMPTY )
+    /* Placement goes first, since it reorders the list. With admission
+     * control it waits for the calibration (see admit()). */
+    if (pool->partitioned && pool->admission == THRD_ADMIT_OFF) {
+        available_cpus(&avail);
+        partition(pool, &avail);
+    }
 
-/* Test for the condition variable of thrd_sync_t */
-#define THRD_POOL_CONDITION \
-    ( THRD_POOL_ACTIVE | THRD_POOL_KILLALL )
+    /* We need to bulid the priority set the first time. Later changes
+     * of the task set are handled by reprioritize(). */
+    if ((pool->status & THRD_POOL_SORTED) == 0) {
+        if (set_rm_priorities(pool) == -1) {
+            pool->status |= THRD_ERR_NULLPER;
+            return -1;
+        }
+    }
 
-struct thrd_pool {
-    dlist_t *threads;        /**< List of thrd_t objects (@see thrd.c); */
-    size_t nthreads;         /**< Number of sampling threads; */
+    pool->status |= THRD_POOL_ACTIVE;
+    if (pool->watchdog && watchdog_start(pool)) {
+        pool->status |= THRD_ERR_LIBRARY;
+        return -1;
+    }
+    if (pool->policy == THRD_POLICY_CYCLIC) {
+        return cyclic_start(pool);
+    }
 
-    uint8_t status;          /**< Status flags: */
-    int err;                 /**< Stores error codes; */
-    int minprio;             /**< Minimum priority. */
+    /* Start each thread. */
+    i = dlist_iter_new(&pool->threads);
+    rtutils_get_now(&now);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        t->policy = pool->policy;
+        err = startup(t, &now);
+        if (err) {
+            /* Threads waiting for calibration must not stay blocked. */
+            release(pool, THRD_GATE_KILL);
+            pool->status |= THRD_ERR_LIBRARY;
+            pool->err = err;
+            dlist_iter_free(i);
+
+            return -1;
+        }
+    }
+    dlist_iter_free(i);
+
+    if (pool->admission != THRD_ADMIT_OFF && admit(pool)) {
+        pool->status |= THRD_ERR_UNSCHED;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Simulation (see thrd_simulate()). Each task has at most one pending
+ * activation, as the thread running it would have: the next one is
+ * released once the current one finished and its release time came. */
+struct sim_task {
+    thrd_t *thrd;
+    uint64_t period;        /* Period (ns); */
+    uint64_t deadline;      /* Relative deadline (ns); */
+    int cpu;                /* CPU the task is pinned on, or -1; */
+    int last;               /* CPU of the last run, or -1; */
+    uint64_t next;          /* Next release (ns); */
+
+    int active;             /* An activation is pending; */
+    int started;            /* The activation got a CPU; */
+    int seen;               /* Already considered by the dispatch; */
+    uint64_t release;       /* Release of the activation (ns); */
+    uint64_t due;           /* Absolute deadline (ns); */
+    uint64_t start;         /* Start of the activation (ns); */
+    uint64_t exec;          /* Execution time (ns); */
+    uint64_t left;          /* Execution time still required (ns). */
 };
 
-/* Internal descriptor for a thread */
-typedef struct {
+/* Order of the pending activations: Rate Monotonic priority, or earliest
+ * deadline (ties broken by priority) under THRD_POLICY_EDF. */
+static
+int sim_before (thrd_policy_t policy, const struct sim_task *a,
+                const struct sim_task *b)
+{
+    if (policy == THRD_POLICY_EDF && a->due != b->due) {
+        return a->due < b->due;
+    }
+    return a->thrd->priority > b->thrd->priority;
+}
 
-    int priority;               /* Thread's priority; */
-    pthread_t handler;          /* Handler of the thread; */
-    uint8_t status;             /* Status flags; */
-    thrd_info_t info;           /* User defined thread info. Defined in
-                                   headers/thrd.h; */
+/* Releases the next activation of a task */
+static
+void sim_release (struct sim_task *st, const thrd_sim_t *sim)
+{
+    st->active = 1;
+    st->started = 0;
+    st->release = st->next;
+    st->due = st->release + st->deadline;
+    st->next += st->period;
+    st->exec = st->left = sim->exec(st->thrd->info.context);
+}
 
-    struct timespec start;      /* Pool start time, used for computing the
-                                   delay during startup phase; */
+/* Accounts an activation finished at time f, like the thread would */
+static
+void sim_finish (struct sim_task *st, uint64_t f)
+{
+    struct timespec next = rtutils_ns2time(st->next);
+    unsigned skipped;
 
-    thrd_rtstats_t statistics;  /* Statistics about the task. */
-} thrd_t; 
+    skipped = overrun(st->thrd, &next, f, st->period);
+    st->next = rtutils_time2ns(&next);
+    update_statistics(&st->thrd->statistics, st->release, st->start, f,
+                      st->exec, st->due < f, skipped, 0, 0, 0, NULL);
+    st->active = 0;
+}
 
+/* Free CPU for a task: the one it is pinned on, otherwise the one it
+ * last ran on, otherwise the first one. Returns -1 if none is free. */
 static
-void update_statistics (thrd_rtstats_t *stats, uint64_t r, uint64_t f,
-                        int deadline_miss)
+int sim_cpu (struct sim_task * const *running, unsigned cpus,
+             const struct sim_task *st)
 {
-    uint64_t response = f - r;
+    unsigned c;
 
-    stats->response_times += response;
-    stats->n_executions ++;
-    if (stats->wcrt < response) {
-        stats->wcrt = response;
+    if (st->cpu >= 0) {
+        return running[st->cpu] ? -1 : st->cpu;
     }
-    if (deadline_miss) {
-        stats->dmiss_count ++;
-        DEBUG_MSG("Deadline miss");
+    if (st->last >= 0 && !running[st->last]) {
+        return st->last;
     }
+    for (c = 0; c < cpus; c ++) {
+        if (!running[c]) return c;
+    }
+    return -1;
 }
 
-/* Each real-time thread of this project actually corresponds to the
- * execution of this routine. */
+/* Simulation of preemptive scheduling on the given CPUs: at each event
+ * the pending activations, in order of priority, get a free CPU among
+ * the ones they are allowed on. */
 static
-void * thread_routine (void * arg)
+void sim_preemptive (thrd_pool_t *pool, const thrd_sim_t *sim,
+                     struct sim_task *tasks, unsigned n)
 {
-    /* Thread management information is transparently keeped into the
-     * thread stack. The external callback system gives the abstraction. */
-    thrd_t *thrd = (thrd_t *)arg;
-    struct timespec next_act;
-    struct timespec finish_time;
-    struct timespec arrival_time;
-    void *context;
+    const uint64_t length = rtutils_time2ns(&sim->length);
+    struct sim_task **running, *best;
+    uint64_t now = 0, step;
+    unsigned k, c;
+    int cpu;
 
-    context = thrd->info.context;
+    running = (struct sim_task **) calloc(sim->cpus,
+                                          sizeof(struct sim_task *));
+    assert(running);
 
-    /* If the user declared an initialization function we execute it. */
-    if (thrd->info.init) {
-        if (thrd->info.init(context)) {
-            /* The user aborted thread startup. If there's a destructor
-             * callback it's time to call it. */
-            if (thrd->info.destroy) {
-                thrd->info.destroy(context);
+    while (now < length) {
+        for (k = 0; k < n; k ++) {
+            if (!tasks[k].active && tasks[k].next <= now) {
+                sim_release(&tasks[k], sim);
             }
-            pthread_exit(NULL);
         }
-    }
-
-    /* Wait delayed activation. */
-    rtutils_wait(&thrd->start);
 
-    /* Periodic loop: at each cycle the next absoute activation time is
-     * computed. */
-    rtutils_get_now(&next_act);
-    for (;;) {
-        rtutils_time_copy(&arrival_time, &next_act);
-        rtutils_time_increment(&next_act, &thrd->info.period);
+        /* Dispatch, by decreasing priority */
+        memset(running, 0, sim->cpus * sizeof(struct sim_task *));
+        for (k = 0; k < n; k ++) {
+            tasks[k].seen = !tasks[k].active;
+        }
+        for (;;) {
+            best = NULL;
+            for (k = 0; k < n; k ++) {
+                if (!tasks[k].seen && (best == NULL ||
+                        sim_before(pool->policy, &tasks[k], best))) {
+                    best = &tasks[k];
+                }
+            }
+            if (best == NULL) break;
 
-        if (thrd->info.callback(context)) {
-            /* Thread required to shut down. If there's a destructor
-             * callback it shall be called now. */
-            if (thrd->info.destroy) {
-                thrd->info.destroy(context);
+            best->seen = 1;
+            if ((cpu = sim_cpu(running, sim->cpus, best)) == -1) {
+                continue;
+            }
+            running[cpu] = best;
+            best->last = cpu;
+            if (!best->started) {
+                best->started = 1;
+                best->start = now;
             }
-            pthread_exit(NULL);
         }
-        rtutils_get_now(&finish_time);
 
-        update_statistics(&thrd->statistics,
-                          rtutils_time2ns(&arrival_time),
-                          rtutils_time2ns(&finish_time),
-                          rtutils_time_cmp(&next_act, &finish_time) > 0);
+        /* Next event: a release or a completion */
+        step = length - now;
+        for (k = 0; k < n; k ++) {
+            if (!tasks[k].active && tasks[k].next - now < step) {
+                step = tasks[k].next - now;
+            }
+        }
+        for (c = 0; c < sim->cpus; c ++) {
+            if (running[c] && running[c]->left < step) {
+                step = running[c]->left;
+            }
+        }
 
-        rtutils_wait(&next_act);
+        now += step;
+        for (c = 0; c < sim->cpus; c ++) {
+            if (running[c] == NULL) continue;
+            running[c]->left -= step;
+            if (running[c]->left == 0) {
+                sim_finish(running[c], now);
+            }
+        }
     }
-
-    pthread_exit(NULL);
+    free(running);
 }
 
-/* Thread startup */
+/* Simulation of the cyclic executive, mirroring cyclic_routine() and
+ * cyclic_dispatch(): late frames run back to back. */
 static
-int startup(thrd_t *thrd, struct timespec *enabtime)
-{   
-    #ifndef RT_DISABLE
-    pthread_attr_t attr;
-    struct sched_param param = {
-        .sched_priority = thrd->priority
-    };
-    #endif
+void sim_cyclic (thrd_pool_t *pool, const thrd_sim_t *sim)
+{
+    const uint64_t length = rtutils_time2ns(&sim->length);
+    struct thrd_cyclic *cyc = &pool->cyclic;
+    uint64_t frame = 0, now = 0, deadline, exec;
+    unsigned f = 0, k, skipped;
 
-    int err;
+    while (frame < length) {
+        for (k = cyc->first[f]; k < cyc->first[f + 1]; k ++) {
+            thrd_t *t = cyc->slots[k];
 
-    DEBUG_TIMESPEC("Activating thread with period", thrd->info.period);
+            if (rtutils_time2ns(&t->next) > frame) continue;
 
-    /* Build activation time for this call of start: we make a copy of the
-     * enable time and increment it with thread specification delay.
-     */
-    memcpy((void *) &thrd->start, (const void *)enabtime,
-           sizeof(struct timespec));
-    rtutils_time_increment(&thrd->start, &thrd->info.delay);
+            exec = sim->exec(t->info.context);
+            deadline = frame + (rtutils_time_iszero(&t->info.deadline)
+                                ? t->cyc_period
+                                : rtutils_time2ns(&t->info.deadline));
+            t->next = rtutils_ns2time(frame + t->cyc_period);
+            skipped = overrun(t, &t->next, now + exec, t->cyc_period);
+            update_statistics(&t->statistics, frame, now, now + exec,
+                              exec, deadline < now + exec, skipped, 0, 0,
+                              0, NULL);
+            now += exec;
+        }
+        frame += cyc->minor;
+        f = (f + 1) % cyc->nframes;
+        if (now < frame) {
+            now = frame;
+        }
+    }
+}
 
-    /* Setting stats to zero */
-    memset(&thrd->statistics, 0, sizeof(thrd_rtstats_t));
+int thrd_simulate (thrd_pool_t *pool, const thrd_sim_t *sim)
+{
+    struct sim_task *tasks;
+    struct timespec origin;
+    cpu_set_t avail;
+    unsigned n = 0, k;
+    diter_t *i;
+    int unsched;
 
-    #ifndef RT_DISABLE
-        /* Setting thread as real-time, scheduled as FIFO and with the given
-         * priority. */
-        err = pthread_attr_init(&attr);
-        assert(err == 0);
-        err = pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
-        assert(err == 0);
-        err = pthread_attr_setschedparam(&attr, &param);
-        assert(err == 0);
-        err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
-        assert(err == 0);
+    assert((pool->status & THRD_POOL_ACTIVE) == 0);
+    assert(sim->cpus > 0 && sim->cpus <= CPU_SETSIZE && sim->exec);
 
-        err = pthread_create(&thrd->handler, &attr, thread_routine,
-                             (void *) thrd);
-        pthread_attr_destroy(&attr);
-    #else
-        err = pthread_create(&thrd->handler, NULL, thread_routine,
-                             (void *) thrd);
-    #endif
+    if (dlist_empty(pool->threads)) {
+        pool->status |= THRD_ERR_EMPTY;
+        return -1;
+    }
+    if (check_affinity(pool)) {
+        pool->status |= THRD_ERR_AFFINITY;
+        return -1;
+    }
 
-    if (err != 0) return err;
+    /* The declared budgets stand for the calibration, and are needed by
+     * the partitioning */
+    memset(&origin, 0, sizeof(struct timespec));
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
 
-    /* Activation achieved: update flags. */
-    thrd->status |= THRD_ALIVE;
-    return 0;
-}
+        if (rtutils_time_iszero(&t->info.period)) {
+            dlist_iter_free(i);
+            pool->status |= THRD_ERR_NULLPER;
+            return -1;
+        }
+        t->policy = pool->policy;
+        t->wcet = rtutils_time2ns(&t->info.runtime);
+        set_start(t, &origin);
+        n ++;
+    }
+    dlist_iter_free(i);
 
-const thrd_rtstats_t * thrd_add (thrd_pool_t *pool,
-                                 const thrd_info_t * new_thrd)
-{
-    thrd_t *item;
+    CPU_ZERO(&avail);
+    for (k = 0; k < sim->cpus; k ++) {
+        CPU_SET(k, &avail);
+    }
+    if (pool->partitioned) {
+        partition(pool, &avail);
+    }
+    set_rm_priorities(pool);
 
-    /* There's no pending error */
-    assert((pool->status & THRD_ERR_ALL) == 0);
-    assert(new_thrd->callback);
+    if (pool->policy == THRD_POLICY_CYCLIC) {
+        i = dlist_iter_new(&pool->threads);
+        while (diter_hasnext(i)) {
+            thrd_t *t = (thrd_t *) diter_next(i);
 
-    DEBUG_MSG("Added another thread");
+            t->status |= THRD_READY;
+            rtutils_time_copy(&t->next, &t->start);
+        }
+        dlist_iter_free(i);
+        cyclic_build(pool, &origin);
+        unsched = cyclic_test(pool);
+        if (unsched) {
+            LOG_MSG("WARNING: the task set may be unschedulable");
+        }
+        sim_cyclic(pool, sim);
+        return unsched ? 1 : 0;
+    }
+    unsched = admission_test(pool, &avail);
+    if (unsched) {
+        LOG_MSG("WARNING: the task set may be unschedulable");
+    }
 
-    if (pool->status & THRD_POOL_ACTIVE) {
-        pool->status |= THRD_ERR_CLOSED;
-        return NULL;
+    tasks = (struct sim_task *) calloc(n, sizeof(struct sim_task));
+    assert(tasks);
+    k = 0;
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+        struct sim_task *st = &tasks[k ++];
+        int cpu = -1;
+
+        if (CPU_COUNT(&t->info.cpus) == 1) {
+            for (cpu = 0; !CPU_ISSET(cpu, &t->info.cpus); cpu ++);
+            if (cpu >= sim->cpus) {
+                cpu = -1;
+            } else {
+                LOG_FMT("Task '%s' on CPU %d",
+                        t->info.name ? t->info.name : "?", cpu);
+            }
+        }
+        st->thrd = t;
+        st->period = period_ns(t);
+        st->deadline = deadline_ns(t);
+        st->cpu = cpu;
+        st->last = -1;
+        st->next = rtutils_time2ns(&t->start);
     }
+    dlist_iter_free(i);
 
-    item = (thrd_t *) malloc(sizeof(thrd_t));
-    assert(item);
-    item->status = THRD_INITIALIZED;
-    memcpy((void *)&item->info, (const void *)new_thrd,
-           sizeof(thrd_info_t));
+    sim_preemptive(pool, sim, tasks, n);
+    free(tasks);
+    return unsched ? 1 : 0;
+}
 
-    /* New thread is added to the thread list */
-    pool->threads = dlist_append(pool->threads, (void *)item);
+/* Names of thrd_overrun_t, in the trace */
+static const char * const overrun_names[] = {
+    [THRD_OVERRUN_CATCHUP] = "catchup",
+    [THRD_OVERRUN_SKIP] = "skip",
+    [THRD_OVERRUN_DEGRADE] = "degrade"
+};
 
-    return &item->statistics;
+/* Opens a record of the Trace Event Format, timestamps are microseconds */
+static
+void trace_event (FILE *out, const char *name, char phase, int pid,
+                  unsigned tid, uint64_t time)
+{
+    fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,"
+                 "\"tid\":%u,\"ts\":%llu.%03u", name, phase, pid, tid,
+            (unsigned long long) (time / 1000), (unsigned) (time % 1000));
 }
 
-/* Comparsion between threads, allows to determine which has the smallest
- * period.
- */
+/* Closes a record having a duration */
 static
-int prio_cmp (const thrd_t *t0, const thrd_t *t1)
+void trace_duration (FILE *out, uint64_t duration)
 {
-    return rtutils_time_cmp(&t0->info.period, &t1->info.period);
+    fprintf(out, ",\"dur\":%llu.%03u}",
+            (unsigned long long) (duration / 1000),
+            (unsigned) (duration % 1000));
 }
 
-/* Sorts the list basing on the period, getting a rate-monotonic priority
- * assignment */
+/* Writes the trace of a task. The ring is copied between two readings of
+ * the head: the events overwritten meanwhile are discarded, and so are
+ * the ones recorded after the first reading. */
 static
-int set_rm_priorities (dlist_t **threads, int minprio)
+void trace_write (FILE *out, const thrd_t *thrd, int pid,
+                  thrd_event_t *copy)
 {
-    diter_t *i;
-    dlist_t *ts;
+    uint64_t head, last, first, n, start = 0;
+    const char *name;
+    int started = 0;
 
-    /* Sort by period */
-    ts = *threads = dlist_sort(*threads, (dcmp_func_t) prio_cmp);
-    i = dlist_iter_new(&ts);
+    head = __atomic_load_n(&thrd->trace_head, __ATOMIC_ACQUIRE);
+    memcpy(copy, thrd->trace, sizeof(thrd_event_t) * THRD_TRACE_EVENTS);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    last = __atomic_load_n(&thrd->trace_head, __ATOMIC_RELAXED);
 
-    /* Assign priorities */
-    while (diter_hasnext(i)) {
-        thrd_t *t;
+    first = head > THRD_TRACE_EVENTS ? head - THRD_TRACE_EVENTS : 0;
+    if (last >= THRD_TRACE_EVENTS && last - THRD_TRACE_EVENTS + 1 > first) {
+        first = last - THRD_TRACE_EVENTS + 1;
+    }
 
-        t = (thrd_t *) diter_next(i);
-        t->priority = minprio ++;
+    /* Besides the name, the track keeps what the simulator needs (see
+     * thrd_simulate()) */
+    name = thrd->info.name ? thrd->info.name : "Thread";
+    fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                 "\"tid\":%u,\"args\":{\"name\":\"%s\",\"period_ns\":%llu,"
+                 "\"deadline_ns\":%llu,\"overrun\":\"%s\",\"catchup\":%u}}",
+            pid, thrd->id, name,
+            (unsigned long long) period_ns(thrd),
+            (unsigned long long) deadline_ns(thrd),
+            overrun_names[thrd->info.overrun], thrd->info.catchup);
+
+    for (n = first; n < head; n ++) {
+        const thrd_event_t *ev = &copy[n & (THRD_TRACE_EVENTS - 1)];
+
+        switch (ev->type) {
+            case THRD_EVENT_RELEASE:
+                trace_event(out, "Release", 'i', pid, thrd->id, ev->time);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            case THRD_EVENT_START:
+                start = ev->time;
+                started = 1;
+                break;
+            case THRD_EVENT_FINISH:
+                /* The start may have been overwritten */
+                if (started) {
+                    trace_event(out, name, 'X', pid, thrd->id, start);
+                    fprintf(out, ",\"args\":{\"exec_ns\":%u}", ev->arg);
+                    trace_duration(out, ev->time - start);
+                }
+                started = 0;
+                break;
+            case THRD_EVENT_MISS:
+                trace_event(out, "Deadline miss", 'i', pid, thrd->id,
+                            ev->time);
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"late_ns\":%u}}",
+                        ev->arg);
+                break;
+            case THRD_EVENT_SKIP:
+                trace_event(out, "Skip", 'i', pid, thrd->id, ev->time);
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"skipped\":%u}}",
+                        ev->arg);
+                break;
+            case THRD_EVENT_LOCK:
+                trace_event(out, "Lock wait", 'X', pid, thrd->id,
+                            ev->time - ev->arg);
+                trace_duration(out, ev->arg);
+                break;
+            case THRD_EVENT_XRUN:
+                trace_event(out, "Xrun", 'i', pid, thrd->id, ev->time);
+                fprintf(out, ",\"s\":\"t\"}");
+                break;
+            case THRD_EVENT_FAULT:
+                trace_event(out, "Page fault", 'i', pid, thrd->id,
+                            ev->time);
+                fprintf(out, ",\"s\":\"t\",\"args\":{\"faults\":%u}}",
+                        ev->arg);
+                break;
+        }
     }
-    dlist_iter_free(i);
-    return 0;
 }
 
-int thrd_start (thrd_pool_t *pool)
+int thrd_trace_dump (thrd_pool_t *pool, const char *path)
 {
+    thrd_event_t *copy;
     diter_t *i;
-    int err;
-    struct timespec now;
+    FILE *out;
+    int pid, err;
 
-    if (dlist_empty(pool->threads)) {
-        pool->status |= THRD_ERR_EMPTY;
+    if ((out = fopen(path, "w")) == NULL) {
         return -1;
     }
+    copy = (thrd_event_t *) malloc(sizeof(thrd_event_t) *
+                                   THRD_TRACE_EVENTS);
+    assert(copy);
 
-    /* We need to bulid the priority set the first time.
-     *
-     * Currently this "first time" check is useless, since for the moment
-     * this structure is not supporting thread stopping.
-     */
-    if ((pool->status & THRD_POOL_SORTED) == 0) {
-        if (set_rm_priorities(&pool->threads, pool->minprio) == -1) {
-            pool->status |= THRD_ERR_NULLPER;
-            return -1;
-        }
-    }
+    pid = (int) getpid();
+    fprintf(out, "{\"traceEvents\":[\n{\"name\":\"process_name\","
+                 "\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\""
+                 PACKAGE_NAME "\"}}", pid);
 
-    /* Start each thread. */
-    pool->status |= THRD_POOL_ACTIVE;
     i = dlist_iter_new(&pool->threads);
-    rtutils_get_now(&now);
     while (diter_hasnext(i)) {
-        err = startup((thrd_t *) diter_next(i), &now);
-        if (err) {
-            pool->status |= THRD_ERR_LIBRARY;
-            pool->err = err;
-            dlist_iter_free(i);
-
-            return -1;
-        }
+        trace_write(out, (const thrd_t *) diter_next(i), pid, copy);
     }
     dlist_iter_free(i);
+    free(copy);
 
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    err = ferror(out);
+    if (fclose(out) || err) {
+        if (err) errno = EIO;
+        return -1;
+    }
     return 0;
 }
 
@@ -308,19 +2968,21 @@ const char * thrd_strerr (thrd_pool_t *pool, thrd_err_t err)
     switch (err) {
         case THRD_ERR_LIBRARY:
             return strerror(pool->err);
-        case THRD_ERR_CLOSED:
-            return "Cannot add a thread on a running pool";
         case THRD_ERR_NULLPER:
             return "Null period for RM thread";
         case THRD_ERR_EMPTY:
             return "No threads subscribed";
+        case THRD_ERR_AFFINITY:
+            return "Only Rate Monotonic threads can be pinned";
+        case THRD_ERR_UNSCHED:
+            return "The task set is not schedulable";
     }
     return "Unknown";
 }
 
 thrd_err_t thrd_interr (thrd_pool_t *pool)
 {
-    uint8_t status = pool->status;
+    uint16_t status = pool->status;
     pool->status &= ~THRD_ERR_ALL;  /* Reset pending errors */
     return status & THRD_ERR_ALL;
 }
@@ -328,29 +2990,46 @@ thrd_err_t thrd_interr (thrd_pool_t *pool)
 thrd_pool_t * thrd_new (unsigned minprio)
 {
     thrd_pool_t *pool;
+    pthread_mutexattr_t attr;
 
     pool = (thrd_pool_t *) calloc(1, sizeof(thrd_pool_t));
     assert(pool);
     pool->minprio = minprio + sched_get_priority_min(SCHED_FIFO);
 
+    /* The lock is shared with the real-time threads during admission */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&pool->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&pool->cond, NULL);
+    pthread_mutex_init(&pool->watch, NULL);
+
     return pool;
 }
 
-static
-void free_thread (void *thrd)
+void thrd_destroy (thrd_pool_t *pool)
 {
-    thrd_t *t;
+    diter_t *i;
 
-    t = (thrd_t *)thrd;
+    if (__atomic_load_n(&pool->watching, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&pool->watching, 0, __ATOMIC_RELEASE);
+        pthread_join(pool->watcher, NULL);
+    }
 
-    if (t->status & THRD_ALIVE) {
-        pthread_join(t->handler, NULL);
+    /* Threads still waiting for the admission must quit, the others
+     * quit at their next activation */
+    i = dlist_iter_new(&pool->threads);
+    while (diter_hasnext(i)) {
+        thrd_t *t = (thrd_t *) diter_next(i);
+
+        __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
     }
-    free(t);
-}
+    dlist_iter_free(i);
+    release(pool, THRD_GATE_KILL);
+    cyclic_pause(pool);
 
-void thrd_destroy (thrd_pool_t *pool)
-{
     dlist_free(pool->threads, free_thread);
+    free(pool->cyclic.first);
+    free(pool->cyclic.slots);
 }
 
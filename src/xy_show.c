@@ -0,0 +1,175 @@
+/*
+ * Copyright 2010 Giovanni Simoni
+ *
+ * This file is part of Soto.
+ *
+ * Soto is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Soto is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Soto.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "headers/xy_show.h"
+#include "headers/logging.h"
+#include "headers/alsagw.h"
+#include "headers/constants.h"
+#include "headers/rtutils.h"
+#include "headers/plotting.h"
+#include "headers/sampthread.h"
+
+struct xyth_data {
+    alsagw_frame_t *buffer;
+    snd_pcm_uframes_t buflen;
+    genth_t *sampth;
+    uint64_t seen;          /* Slots of the sampler seen so far; */
+
+    plotgr_t *xy;
+    plotgr_t *corr;
+
+    /* Exponentially weighted sums for the correlation: they are updated
+     * with the new frames only (see sampth_get_fresh()), instead of being
+     * recomputed. */
+    double sxy, sxx, syy;
+    double correlation;
+
+    int16_t history[XY_CORR_HISTORY];   /* Circular correlation history; */
+    unsigned head;                      /* Oldest value of the history. */
+};
+
+static
+int destroy_cb (void *arg)
+{
+    struct xyth_data *ctx = (struct xyth_data *)arg;
+
+    free(ctx->buffer);
+    free(arg);
+
+    return 0;
+}
+
+static
+void update_correlation (struct xyth_data *ctx, snd_pcm_uframes_t nframes)
+{
+    const alsagw_frame_t *f = ctx->buffer;
+    double sxy = 0, sxx = 0, syy = 0;
+    double x, y;
+    unsigned i;
+
+    /* Nothing new, the sums are not decayed either. */
+    if (nframes == 0) {
+        return;
+    }
+    for (i = 0; i < nframes; i ++) {
+        x = f[i].ch0;
+        y = f[i].ch1;
+        sxy += x * y;
+        sxx += x * x;
+        syy += y * y;
+    }
+    ctx->sxy = ctx->sxy * XY_CORR_FORGET + sxy;
+    ctx->sxx = ctx->sxx * XY_CORR_FORGET + sxx;
+    ctx->syy = ctx->syy * XY_CORR_FORGET + syy;
+
+    /* Silence is uncorrelated. */
+    if (ctx->sxx > 0 && ctx->syy > 0) {
+        ctx->correlation = ctx->sxy / sqrt(ctx->sxx * ctx->syy);
+    } else {
+        ctx->correlation = 0;
+    }
+}
+
+static
+void show_correlation (struct xyth_data *ctx, uint64_t stamp)
+{
+    unsigned i, j;
+
+    ctx->history[ctx->head] = (int16_t)(ctx->correlation * INT16_MAX);
+    ctx->head = (ctx->head + 1) % XY_CORR_HISTORY;
+
+    /* Oldest value on the left */
+    j = ctx->head;
+    for (i = 0; i < XY_CORR_HISTORY; i ++) {
+        plot_graphic_set(ctx->corr, i, ctx->history[j]);
+        j = (j + 1) % XY_CORR_HISTORY;
+    }
+    plot_graphic_stamp(ctx->corr, stamp);
+    plot_graphic_commit(ctx->corr);
+}
+
+static
+int thread_cb (void *arg)
+{
+    struct xyth_data *ctx = (struct xyth_data *)arg;
+    snd_pcm_uframes_t nframes;
+    uint64_t stamp;
+
+    stamp = sampth_get_fresh(ctx->sampth, ctx->buffer, &ctx->seen,
+                             &nframes);
+
+    /* Frames are pairs of int16, just what the scatter wants. */
+    plot_graphic_stamp(ctx->xy, stamp);
+    plot_graphic_scatter(ctx->xy, (const int16_t *)ctx->buffer, nframes);
+
+    update_correlation(ctx, nframes);
+    show_correlation(ctx, stamp);
+
+    return 0;
+}
+
+const thrd_rtstats_t * xyth_subscribe (genth_t **handle,
+                                       thrd_pool_t *pool,
+                                       genth_t *sampth,
+                                       plotgr_t *xy,
+                                       plotgr_t *corr)
+{
+    struct xyth_data *ctx;
+    thrd_info_t thi;
+
+    memset(&thi, 0, sizeof(thrd_info_t));
+    thi.init = NULL;
+    thi.callback = thread_cb;
+    thi.destroy = destroy_cb;
+    thi.name = "XY show";
+    thi.stack_size = TASK_STACK_SIZE;
+
+    ctx = (struct xyth_data *) calloc(1, sizeof(struct xyth_data));
+    assert(ctx);
+    thi.context = (void *) ctx;
+
+    /* Common startup delay. */
+    thi.delay.tv_sec = SAMP_STARTUP_DELAY_SEC;
+    thi.delay.tv_nsec = SAMP_STARTUP_DELAY_nSEC;
+
+    /* The startup delay must be incremented in order to allow the
+     * sampling thread to fill at least one buffer. The same value is used
+     * to set the period: a late activation just finds more new frames. */
+    rtutils_time_increment(&thi.delay, sampth_get_period(sampth));
+    rtutils_time_copy(&thi.period, &thi.delay);
+
+    /* Skipped activations only thin out the scatter plot */
+    thi.overrun = THRD_OVERRUN_SKIP;
+
+    ctx->buflen = sampth_get_size(sampth);
+    ctx->buffer = calloc(ctx->buflen, sizeof(alsagw_frame_t));
+    assert(ctx->buffer);
+
+    ctx->xy = xy;
+    ctx->corr = corr;
+    ctx->sampth = sampth;
+
+    /* On failure the context is released by destroy_cb() */
+    return genth_subscribe(handle, pool, &thi);
+}